@@ -43,7 +43,19 @@ varying vec4 vWorldPos;
 
 #ifdef MORPH_ENABLED
     attribute vec3 aMorphDelta;
-    uniform float uMorphWeight;
+    #if defined(GL3) && (defined(MORPHSLOT) || defined(INSTANCED))
+        // Веса всех компонентов сцены. Ячейка задаётся параметром своего материала или приходит с данными инстанса
+        uniform sampler2D sMorphWeights6;
+        #ifdef MORPHSLOT
+            uniform vec2 cMorphSlot;
+        #else
+            attribute vec4 iTexCoord7;
+        #endif
+        #define MORPH_WEIGHT_BUFFER
+    #else
+        // Параметры материала связываются по имени без префикса "c"
+        uniform float cMorphWeight;
+    #endif
 #endif
 
 void VS()
@@ -51,8 +63,15 @@ void VS()
     mat4 modelMatrix = iModelMatrix;
     vec3 modelPos = iPos;
 
-    #ifdef MORPH_ENABLED
-        modelPos += aMorphDelta * uMorphWeight;
+    #ifdef MORPH_WEIGHT_BUFFER
+        #ifdef MORPHSLOT
+            vec2 morphSlot = cMorphSlot;
+        #else
+            vec2 morphSlot = iTexCoord7.xy;
+        #endif
+        modelPos += aMorphDelta * texelFetch(sMorphWeights6, ivec2(morphSlot), 0).r;
+    #elif defined(MORPH_ENABLED)
+        modelPos += aMorphDelta * cMorphWeight;
     #endif
     vec3 worldPos = GetWorldPos(modelMatrix, modelPos);
     gl_Position = GetClipPos(worldPos);
@@ -6,12 +6,16 @@
 #include "Fog.hlsl"
 
 #ifdef MORPH_ENABLED
-Texture1D tMorphWeigthMap : register(t6);
-// Texture2D tMorphTextureMap : register(t7);
-
-SamplerState sMorphWeigthMap : register(s6);
-// SamplerState sMorphTextureMap : register(s7);
-float cMorphWeight;
+    #if defined(D3D11) && (defined(MORPHSLOT) || defined(INSTANCED))
+        // Веса всех компонентов сцены. Ячейка задаётся параметром своего материала или приходит с данными инстанса
+        Texture2D tMorphWeights : register(t6);
+        #define MORPH_WEIGHT_BUFFER
+        #ifdef MORPHSLOT
+            float2 cMorphSlot;
+        #endif
+    #else
+        float cMorphWeight;
+    #endif
 #endif
 
 void VS(float4 iPos : POSITION,
@@ -77,6 +81,9 @@ void VS(float4 iPos : POSITION,
     #ifdef MORPH_ENABLED
         float3 aMorphDelta : TEXCOORD1,
     #endif
+    #if defined(MORPH_WEIGHT_BUFFER) && !defined(MORPHSLOT)
+        float4 iMorphSlot : TEXCOORD7,
+    #endif
     out float4 oPos : OUTPOSITION)
 {
     // Define a 0,0 UV coord if not expected from the vertex data
@@ -85,7 +92,14 @@ void VS(float4 iPos : POSITION,
     #endif
     float3 modelPos = iPos.xyz;
 
-    #ifdef MORPH_ENABLED
+    #ifdef MORPH_WEIGHT_BUFFER
+        #ifdef MORPHSLOT
+            float2 morphSlot = cMorphSlot;
+        #else
+            float2 morphSlot = iMorphSlot.xy;
+        #endif
+        modelPos += aMorphDelta * tMorphWeights.Load(int3(morphSlot, 0)).r;
+    #elif defined(MORPH_ENABLED)
         modelPos += aMorphDelta * cMorphWeight;
     #endif
     float4x3 modelMatrix = iModelMatrix;
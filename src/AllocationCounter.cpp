@@ -0,0 +1,95 @@
+#include "AllocationCounter.h"
+
+#ifdef TRACK_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Замена глобальных operator new/delete. Считаются только выделения через new,
+// включая контейнеры Urho3D; malloc сторонних библиотек не учитывается
+static std::atomic<u64> allocationCount{0};
+
+static void* CountedAllocate(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* ptr = CountedAllocate(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if (void* ptr = CountedAllocate(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+u64 GetAllocationCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+bool IsAllocationTrackingEnabled()
+{
+    return true;
+}
+
+#else
+
+u64 GetAllocationCount()
+{
+    return 0;
+}
+
+bool IsAllocationTrackingEnabled()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+
+/// Return the number of heap allocations made through operator new by all threads since start.
+/// Always 0 unless the project is configured with TRACK_ALLOCATIONS.
+u64 GetAllocationCount();
+/// Return true if operator new is replaced by the counting version.
+bool IsAllocationTrackingEnabled();
@@ -0,0 +1,541 @@
+#include "FBXBenchmark.h"
+#include "MorphGeometry.h"
+#include "MorphStreamCodec.h"
+#include "SceneUtils.h"
+#include "AllocationCounter.h"
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/Drawable.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/GraphicsEvents.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/Graphics/Renderer.h>
+#include <Urho3D/Graphics/Viewport.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+
+#include <algorithm>
+
+using namespace Urho3D;
+
+// Через сколько кадров каждый меш переключает активный морф, а в Headless ещё и режим:
+// потоковая поза или вес одного морфа
+static const i32 MORPH_SWITCH_FRAMES = 120;
+// Размер кадра для FrameInfo, в Headless нет окна
+static const IntVector2 BENCHMARK_VIEW_SIZE(1280, 720);
+// Каналов в потоковой позе, как у захвата лица
+static const i32 MAX_STREAMED_CHANNELS = 52;
+// Однократные замеры повторяются, пока не займут хотя бы столько
+static const i64 MIN_MEASURE_USEC = 200000;
+
+bool ParseBenchmarkArguments(const Vector<String>& arguments, FBXBenchmarkSettings& settings)
+{
+    bool benchmark = false;
+    for (i32 i = 0; i + 1 < arguments.Size(); ++i)
+    {
+        String argument = arguments[i].ToLower();
+        const String& value = arguments[i + 1];
+        if (argument == "-benchmark")
+        {
+            settings.modelPath = value;
+            benchmark = true;
+        }
+        else if (argument == "-benchmarkframes")
+            settings.frames = Max(ToI32(value), 1);
+        else if (argument == "-benchmarkwarmup")
+            settings.warmupFrames = Max(ToI32(value), 0);
+        else if (argument == "-benchmarktimestep")
+            settings.timeStep = Max(ToFloat(value), 0.0001f);
+        else if (argument == "-benchmarkoutput")
+            settings.outputPath = value;
+        else if (argument == "-benchmarkmaxallocations")
+            settings.maxAllocations = Max(ToI32(value), 0);
+        else if (argument == "-benchmarkmindecoderate")
+            settings.minDecodeRate = Max(ToFloat(value), 0.0f);
+    }
+    return benchmark;
+}
+
+FBXBenchmark::FBXBenchmark(Context* context) : Object(context)
+{
+}
+
+bool FBXBenchmark::Run(Scene* scene, Node* cameraNode, const FBXBenchmarkSettings& settings)
+{
+    Log* log = GetSubsystem<Log>();
+    auto* engine = GetSubsystem<Engine>();
+    auto* renderer = GetSubsystem<Renderer>();
+    // Без Graphics (-headless) кадр ведётся вручную
+    const bool headless = !GetSubsystem<Graphics>() || !renderer;
+    if (!scene->GetComponent<Octree>() || !cameraNode->GetComponent<Camera>())
+    {
+        log->Write(LOG_ERROR, "Benchmark needs a scene with an octree and a camera");
+        return false;
+    }
+
+    // Траектория строится вокруг всех морф-мешей сцены
+    BoundingBox bounds;
+    for (MorphGeometry* geometry : findAllComponents<MorphGeometry>(scene))
+        bounds.Merge(geometry->GetWorldBoundingBox());
+    if (!bounds.Defined())
+    {
+        log->Write(LOG_ERROR, "Benchmark scene has no morph meshes");
+        return false;
+    }
+    center_ = bounds.Center();
+    radius_ = Max((bounds.max_ - bounds.min_).Length() * 0.5f, M_EPSILON);
+
+    log->Write(LOG_INFO, "Benchmark " + settings.modelPath + ": " + String(settings.warmupFrames) + " warmup + " +
+        String(settings.frames) + " frames, step " + String(settings.timeStep) + " s" + (headless ? ", headless" : ""));
+    if (!MeasureImport(settings))
+        return false;
+
+    geometries_ = findAllComponents<MorphGeometry>(scene);
+    if (headless)
+    {
+        // В Headless соотношение сторон не берётся из окна
+        cameraNode->GetComponent<Camera>()->SetAspectRatio((float)BENCHMARK_VIEW_SIZE.x_ / BENCHMARK_VIEW_SIZE.y_);
+        streamWeights_.Resize(geometries_.Size());
+        for (i32 i = 0; i < geometries_.Size(); ++i)
+            streamWeights_[i].Resize(geometries_[i]->GetNumMorphers(), 0.0f);
+    }
+    else
+    {
+        renderer->SetViewport(0, new Viewport(context_, scene, cameraNode->GetComponent<Camera>()));
+        // Ограничение частоты кадров ждало бы внутри кадра, в том числе для окна без фокуса
+        engine->SetMaxFps(0);
+        engine->SetMaxInactiveFps(0);
+        SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(FBXBenchmark, HandleBeginFrame));
+        SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(FBXBenchmark, HandlePostUpdate));
+        SubscribeToEvent(E_BEGINRENDERING, URHO3D_HANDLER(FBXBenchmark, HandleBeginRendering));
+        SubscribeToEvent(E_ENDRENDERING, URHO3D_HANDLER(FBXBenchmark, HandleEndRendering));
+        SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(FBXBenchmark, HandleEndFrame));
+    }
+
+    PrepareMorphs();
+    frames_.Clear();
+    frames_.Reserve(settings.frames);
+    const i32 total = settings.warmupFrames + settings.frames;
+    for (i32 frame = 0; frame < total && !engine->IsExiting(); ++frame)
+    {
+        ApplyScript(scene, cameraNode, frame, settings);
+        current_ = FBXBenchmarkFrame{};
+        if (headless)
+            RunHeadlessFrame(scene, cameraNode, frame, settings);
+        else
+            RunRenderedFrame(frame, settings);
+        current_.morphSwitch = frame % MORPH_SWITCH_FRAMES == 0;
+        if (frame >= settings.warmupFrames)
+            frames_.Push(current_);
+    }
+    UnsubscribeFromAllEvents();
+
+    String summaryPath = GetPath(settings.outputPath) + GetFileName(settings.outputPath) + "_summary.csv";
+    if (!WriteFrames(settings.outputPath) || !WriteSummary(summaryPath))
+        return false;
+    const bool allocationsPassed = CheckAllocations(settings);
+    MeasurePoseEvaluate(scene);
+    return MeasureChannelDecode(scene, settings) && allocationsPassed;
+}
+
+void FBXBenchmark::PrepareMorphs()
+{
+    // Всё, что сценарий использует по ходу замера, создаётся заранее: смена морфа берёт готовую
+    // геометрию канала, потоковая поза - свой динамический поток смещений
+    for (i32 i = 0; i < geometries_.Size(); ++i)
+    {
+        MorphGeometry* geometry = geometries_[i];
+        MorphMeshData* data = geometry->GetMeshData();
+        if (!data || !data->IsCommitted())
+            continue;
+        for (const String& name : geometry->GetMorpherNames())
+            data->GetGeometry(name);
+        if (i < streamWeights_.Size() && !streamWeights_[i].Empty())
+        {
+            geometry->SetStreamedPose(streamWeights_[i]);
+            geometry->ClearPose();
+        }
+    }
+}
+
+void FBXBenchmark::RunRenderedFrame(i32 frame, const FBXBenchmarkSettings& settings)
+{
+    auto* engine = GetSubsystem<Engine>();
+    auto* renderer = GetSubsystem<Renderer>();
+    // Сценарий и анимация идут с постоянным шагом, а не с измеренным временем кадра
+    engine->SetNextTimeStep(settings.timeStep);
+    engine->RunFrame();
+    current_.visible = (i32)renderer->GetNumGeometries();
+    current_.batches = (i32)renderer->GetNumBatches();
+}
+
+void FBXBenchmark::RunHeadlessFrame(Scene* scene, Node* cameraNode, i32 frame, const FBXBenchmarkSettings& settings)
+{
+    timer_.Reset();
+    allocations_ = GetAllocationCount();
+
+    // Те же события, что посылает Engine::Update; сцена обновляется по E_UPDATE
+    {
+        using namespace Update;
+        VariantMap& eventData = GetEventDataMap();
+        eventData[P_TIMESTEP] = settings.timeStep;
+        SendEvent(E_UPDATE, eventData);
+        SendEvent(E_POSTUPDATE, eventData);
+    }
+    Mark(current_.update, current_.updateAllocations);
+
+    // Потоковые позы, как от MorphWeightReceiver: веса части каналов меняются каждый кадр. Меши по очереди
+    // переходят к весу одного морфа, чтобы замер проходил и через вес в материале (-materialweights)
+    const float time = frame * settings.timeStep;
+    for (i32 i = 0; i < geometries_.Size(); ++i)
+    {
+        Vector<float>& weights = streamWeights_[i];
+        if (weights.Empty())
+            continue;
+        if ((frame / MORPH_SWITCH_FRAMES + i) % 2)
+        {
+            if (frame % MORPH_SWITCH_FRAMES == 0)
+                geometries_[i]->ClearPose();
+            continue;
+        }
+        for (i32 k = 0; k < weights.Size() && k < MAX_STREAMED_CHANNELS; ++k)
+            weights[k] = 0.5f + 0.5f * Sin(time * 90.0f + k * 37.0f + i * 30.0f);
+        geometries_[i]->SetStreamedPose(weights);
+    }
+    Mark(current_.pose, current_.poseAllocations);
+
+    // Подготовка как в View::Update, без очередей отрисовки
+    Camera* camera = cameraNode->GetComponent<Camera>();
+    Octree* octree = scene->GetComponent<Octree>();
+    FrameInfo frameInfo;
+    frameInfo.frameNumber_ = frame;
+    frameInfo.timeStep_ = settings.timeStep;
+    frameInfo.viewSize_ = BENCHMARK_VIEW_SIZE;
+    frameInfo.camera_ = camera;
+    octree->Update(frameInfo);
+    FrustumOctreeQuery query(drawables_, camera->GetFrustum(), DRAWABLE_GEOMETRY, camera->GetViewMask());
+    octree->GetDrawables(query);
+    i32 batches = 0;
+    for (Drawable* drawable : drawables_)
+    {
+        drawable->MarkInView(frameInfo);
+        drawable->UpdateBatches(frameInfo);
+        batches += (i32)drawable->GetBatches().Size();
+    }
+    for (Drawable* drawable : drawables_)
+    {
+        if (drawable->GetUpdateGeometryType() != UPDATE_NONE)
+            drawable->UpdateGeometry(frameInfo);
+    }
+    Mark(current_.prepare, current_.prepareAllocations);
+    current_.visible = drawables_.Size();
+    current_.batches = batches;
+}
+
+bool FBXBenchmark::MeasureImport(const FBXBenchmarkSettings& settings)
+{
+    Log* log = GetSubsystem<Log>();
+    // Данные остаются на CPU: замер не пишет файлы каналов и не трогает загруженную сцену
+    FBXImportOptions options = settings.importOptions;
+    options.residency = MORPH_RESIDENCY_KEEP_ALL;
+    HiresTimer timer;
+    Vector<SharedPtr<MorphMeshData>> meshes;
+    if (!LoadFBXMeshes(context_, settings.modelPath, options, meshes))
+    {
+        log->Write(LOG_ERROR, "Benchmark can't import " + settings.modelPath);
+        return false;
+    }
+    const i64 parse = timer.GetUSec(false);
+    i32 vertices = 0;
+    for (const SharedPtr<MorphMeshData>& data : meshes)
+    {
+        if (data->GetVertexCount() && data->GetIndexCount() && data->Commit())
+            vertices += data->GetVertexCount();
+    }
+    const i64 total = timer.GetUSec(false);
+
+    const String line = "Benchmark import: " + String(meshes.Size()) + " meshes, " + String(vertices) + " vertices, " +
+        String((float)(parse / 1000.0)) + " ms load, " + String((float)((total - parse) / 1000.0)) + " ms commit";
+    log->Write(LOG_INFO, line);
+    PrintLine(line);
+    return true;
+}
+
+void FBXBenchmark::MeasurePoseEvaluate(Scene* scene)
+{
+    Log* log = GetSubsystem<Log>();
+    // Все каналы с одинаковым весом - худший случай позы
+    Vector<MorphMeshData*> meshes;
+    Vector<Vector<String>> names;
+    Vector<Vector<float>> weights;
+    i32 channels = 0;
+    for (MorphGeometry* geometry : findAllComponents<MorphGeometry>(scene))
+    {
+        MorphMeshData* data = geometry->GetMeshData();
+        if (!data || !data->IsCommitted() || data->GetMorphers().Empty() || meshes.Contains(data))
+            continue;
+        meshes.Push(data);
+        names.Push(data->GetMorphers().Keys());
+        weights.Push(Vector<float>(names.Back().Size(), 1.0f / names.Back().Size()));
+        channels += names.Back().Size();
+    }
+    if (meshes.Empty())
+        return;
+
+    Vector<Vector3> deltas;
+    HiresTimer timer;
+    i32 passes = 0;
+    do
+    {
+        for (i32 i = 0; i < meshes.Size(); ++i)
+            meshes[i]->EvaluatePose(names[i], weights[i], deltas);
+        ++passes;
+    } while (timer.GetUSec(false) < MIN_MEASURE_USEC);
+    const i64 usec = timer.GetUSec(false) / passes;
+
+    const String line = "Benchmark pose evaluate: " + String(meshes.Size()) + " meshes, " + String(channels) +
+        " channels, " + String(usec) + " us for all meshes";
+    log->Write(LOG_INFO, line);
+    PrintLine(line);
+}
+
+bool FBXBenchmark::MeasureChannelDecode(Scene* scene, const FBXBenchmarkSettings& settings)
+{
+    // Ограничение объёма каналов, которые одновременно держатся в памяти ради замера
+    static const u64 MAX_DECODE_BYTES = 64 * 1024 * 1024;
+
+    Log* log = GetSubsystem<Log>();
+    Vector<Vector<unsigned char>> encoded;
+    u64 encodedBytes = 0;
+    u64 rawBytes = 0;
+    HashSet<MorphMeshData*> measured;
+    Vector<i32> indexes;
+    Vector<Vector3> deltas;
+    for (MorphGeometry* geometry : findAllComponents<MorphGeometry>(scene))
+    {
+        MorphMeshData* data = geometry->GetMeshData();
+        if (!data || measured.Contains(data))
+            continue;
+        measured.Insert(data);
+        for (const auto& pair : data->GetMorphers())
+        {
+            if (rawBytes >= MAX_DECODE_BYTES)
+                break;
+            if (!data->EnsureChannelResident(pair.first_) || !data->GetChannelDeltas(pair.first_, indexes, deltas) ||
+                indexes.Empty())
+                continue;
+            encoded.Resize(encoded.Size() + 1);
+            EncodeMorphChannel(indexes, deltas, encoded.Back());
+            encodedBytes += encoded.Back().Size();
+            rawBytes += (u64)indexes.Size() * (sizeof(i32) + sizeof(Vector3));
+        }
+    }
+    if (auto* registry = GetSubsystem<MorphMeshRegistry>())
+        registry->EnforceChannelBudget();
+    if (encoded.Empty())
+    {
+        log->Write(LOG_INFO, "Benchmark scene has no morph channels to decode");
+        return settings.minDecodeRate <= 0.0f;
+    }
+
+    HiresTimer timer;
+    i32 passes = 0;
+    do
+    {
+        for (const Vector<unsigned char>& channel : encoded)
+        {
+            if (!DecodeMorphChannel(channel.Buffer(), channel.Size(), indexes, deltas))
+            {
+                log->Write(LOG_ERROR, "Benchmark channel decode failed");
+                return false;
+            }
+        }
+        ++passes;
+    } while (timer.GetUSec(false) < MIN_MEASURE_USEC);
+    const double seconds = timer.GetUSec(false) / 1000000.0;
+    const float rate = (float)(rawBytes * passes / seconds / 1e9);
+
+    const String line = "Benchmark channel decode: " + String(encoded.Size()) + " channels, " +
+        String((u32)(encodedBytes / 1024)) + " KB encoded, " + String((u32)(rawBytes / 1024)) + " KB decoded, " +
+        String(rate) + " GB/s";
+    log->Write(LOG_INFO, line);
+    PrintLine(line);
+    if (settings.minDecodeRate > 0.0f && rate < settings.minDecodeRate)
+    {
+        const String error = "Channel decode is slower than " + String(settings.minDecodeRate) + " GB/s";
+        log->Write(LOG_ERROR, error);
+        PrintLine(error, true);
+        return false;
+    }
+    return true;
+}
+
+bool FBXBenchmark::CheckAllocations(const FBXBenchmarkSettings& settings)
+{
+    if (settings.maxAllocations < 0)
+        return true;
+    Log* log = GetSubsystem<Log>();
+    if (!IsAllocationTrackingEnabled())
+    {
+        log->Write(LOG_ERROR, "Allocation check needs a build with TRACK_ALLOCATIONS");
+        return false;
+    }
+    // Кадр после прогрева не должен выделять память ни в одной фазе: камера и веса меняют только значения,
+    // смена морфа и потоковые позы берут геометрии, созданные в PrepareMorphs(). Вес доходит до шейдера
+    // через MorphWeightBuffer или выбором готовой копии материала
+    i32 failed = 0;
+    for (i32 i = 0; i < frames_.Size(); ++i)
+    {
+        const FBXBenchmarkFrame& f = frames_[i];
+        const u64 allocations = f.updateAllocations + f.poseAllocations + f.prepareAllocations + f.renderAllocations +
+            f.presentAllocations;
+        if (allocations <= (u64)settings.maxAllocations)
+            continue;
+        if (failed++ < 10)
+            log->Write(LOG_ERROR, "Benchmark frame " + String(i) + " made " + String(allocations) + " allocations");
+    }
+    if (failed)
+    {
+        log->Write(LOG_ERROR, String(failed) + " frames exceed " + String(settings.maxAllocations) + " allocations");
+        PrintLine(String(failed) + " frames exceed " + String(settings.maxAllocations) + " allocations", true);
+        return false;
+    }
+    log->Write(LOG_INFO, "Benchmark allocation check passed");
+    PrintLine("Benchmark allocation check passed");
+    return true;
+}
+
+void FBXBenchmark::ApplyScript(Scene* scene, Node* cameraNode, i32 frame, const FBXBenchmarkSettings& settings)
+{
+    // Один оборот за весь замер, расстояние и высота колеблются, чтобы меши входили в кадр и выходили из него
+    const i32 total = settings.warmupFrames + settings.frames;
+    const float angle = 360.0f * frame / total;
+    const float fov = cameraNode->GetComponent<Camera>()->GetFov();
+    const float distance = radius_ / Tan(fov * 0.5f) * (1.0f + 0.4f * Sin(angle * 3.0f));
+    const Vector3 offset(Sin(angle), 0.3f * Sin(angle * 2.0f), Cos(angle));
+    cameraNode->SetPosition(center_ + offset * distance);
+    cameraNode->LookAt(center_);
+
+    const float time = frame * settings.timeStep;
+    i32 index = 0;
+    for (MorphGeometry* geometry : geometries_)
+    {
+        const i32 count = geometry->GetNumMorphers();
+        if (count && frame % MORPH_SWITCH_FRAMES == 0)
+            geometry->SetActiveMorpher((frame / MORPH_SWITCH_FRAMES + index) % count);
+        geometry->SetMorphWeight(0.5f + 0.5f * Sin(time * 180.0f + index * 30.0f));
+        ++index;
+    }
+}
+
+void FBXBenchmark::Mark(i64& time, u64& allocations)
+{
+    time = timer_.GetUSec(true);
+    const u64 count = GetAllocationCount();
+    allocations = count - allocations_;
+    allocations_ = count;
+}
+
+void FBXBenchmark::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+{
+    timer_.Reset();
+    allocations_ = GetAllocationCount();
+}
+
+void FBXBenchmark::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    Mark(current_.update, current_.updateAllocations);
+}
+
+void FBXBenchmark::HandleBeginRendering(StringHash eventType, VariantMap& eventData)
+{
+    Mark(current_.prepare, current_.prepareAllocations);
+}
+
+void FBXBenchmark::HandleEndRendering(StringHash eventType, VariantMap& eventData)
+{
+    Mark(current_.render, current_.renderAllocations);
+}
+
+void FBXBenchmark::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    Mark(current_.present, current_.presentAllocations);
+}
+
+bool FBXBenchmark::WriteFrames(const String& path)
+{
+    File file(context_, path, FILE_WRITE);
+    if (!file.IsOpen())
+    {
+        GetSubsystem<Log>()->Write(LOG_ERROR, "Can't write benchmark frames to " + path);
+        return false;
+    }
+    file.WriteLine("frame,update_us,pose_us,prepare_us,render_us,present_us,total_us,visible,batches,"
+        "update_allocs,pose_allocs,prepare_allocs,render_allocs,present_allocs,morph_switch");
+    for (i32 i = 0; i < frames_.Size(); ++i)
+    {
+        const FBXBenchmarkFrame& f = frames_[i];
+        file.WriteLine(String(i) + "," + String(f.update) + "," + String(f.pose) + "," + String(f.prepare) + "," +
+            String(f.render) + "," + String(f.present) + "," + String(f.update + f.pose + f.prepare + f.render + f.present) + "," +
+            String(f.visible) + "," + String(f.batches) + "," + String(f.updateAllocations) + "," + String(f.poseAllocations) + "," +
+            String(f.prepareAllocations) + "," + String(f.renderAllocations) + "," + String(f.presentAllocations) + "," +
+            String(f.morphSwitch ? 1 : 0));
+    }
+    return true;
+}
+
+// Перцентиль по ближайшему рангу, values отсортированы
+static i64 GetPercentile(const Vector<i64>& values, float percentile)
+{
+    if (values.Empty())
+        return 0;
+    i32 rank = CeilToInt(percentile / 100.0f * values.Size()) - 1;
+    return values[Clamp(rank, 0, (i32)values.Size() - 1)];
+}
+
+bool FBXBenchmark::WriteSummary(const String& path)
+{
+    static const float PERCENTILES[] = { 50.0f, 90.0f, 95.0f, 99.0f, 100.0f };
+    static const char* PHASES[] = { "update", "pose", "prepare", "render", "present", "total" };
+
+    File file(context_, path, FILE_WRITE);
+    if (!file.IsOpen())
+    {
+        GetSubsystem<Log>()->Write(LOG_ERROR, "Can't write benchmark summary to " + path);
+        return false;
+    }
+    file.WriteLine("phase,mean_us,p50_us,p90_us,p95_us,p99_us,max_us");
+
+    Log* log = GetSubsystem<Log>();
+    Vector<i64> values;
+    values.Reserve(frames_.Size());
+    for (i32 phase = 0; phase < 6; ++phase)
+    {
+        values.Clear();
+        i64 sum = 0;
+        for (const FBXBenchmarkFrame& f : frames_)
+        {
+            const i64 phases[] = { f.update, f.pose, f.prepare, f.render, f.present,
+                f.update + f.pose + f.prepare + f.render + f.present };
+            const i64 value = phases[phase];
+            values.Push(value);
+            sum += value;
+        }
+        std::sort(values.Begin(), values.End());
+
+        String line = String(PHASES[phase]) + "," + String(values.Empty() ? 0 : sum / (i64)values.Size());
+        for (float percentile : PERCENTILES)
+            line += "," + String(GetPercentile(values, percentile));
+        file.WriteLine(line);
+        log->Write(LOG_INFO, "Benchmark " + line);
+        PrintLine("Benchmark " + line);
+    }
+    return true;
+}
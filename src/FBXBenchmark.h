@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Scene/Scene.h>
+#include "FBXLoader.h"
+
+namespace Urho3D {
+    class Drawable;
+    class MorphGeometry;
+}
+
+// Параметры режима замера. Командная строка:
+//   -benchmark <fbx> [-headless] [-materialweights] [-benchmarkframes N] [-benchmarkwarmup N] [-benchmarktimestep s]
+//   [-benchmarkoutput file.csv] [-benchmarkmaxallocations N] [-benchmarkmindecoderate GB/s]
+// Путь к FBX задаётся относительно каталога программы, как в LoadFBXToNode
+struct FBXBenchmarkSettings
+{
+    Urho3D::String modelPath;
+    // Параметры, с которыми вьюер загрузил сцену, для замера импорта
+    FBXImportOptions importOptions;
+    Urho3D::String outputPath = "benchmark.csv";
+    // Кадры прогрева в статистику не входят
+    i32 warmupFrames = 30;
+    i32 frames = 600;
+    float timeStep = 1.0f / 60.0f;
+    // Замер завершается ошибкой, если установившийся кадр после прогрева выделил за все фазы
+    // больше памяти (-1 - без проверки). Работает только со сборкой TRACK_ALLOCATIONS
+    i32 maxAllocations = -1;
+    // Замер завершается ошибкой, если распаковка каналов морфов (DecodeMorphChannel) медленнее,
+    // в ГБ распакованных данных в секунду (0 - без проверки)
+    float minDecodeRate = 0.0f;
+};
+
+/// Fill the settings from the command line. Returns false if benchmark mode was not requested.
+bool ParseBenchmarkArguments(const Urho3D::Vector<Urho3D::String>& arguments, FBXBenchmarkSettings& settings);
+
+// Время кадра на CPU по фазам, в микросекундах
+struct FBXBenchmarkFrame
+{
+    // От E_BEGINFRAME до E_POSTUPDATE: события обновления, обновление сцены, смена морфов
+    i64 update;
+    // Только Headless: потоковые позы всех мешей (сумма каналов и запись в поток смещений)
+    i64 pose;
+    // До E_BEGINRENDERING: Renderer::Update (октодерево, отсечение, UpdateBatches, UpdateGeometry)
+    // и начало кадра Graphics, включая загрузку буфера весов. В Headless - те же шаги View::Update вручную
+    i64 prepare;
+    // От E_BEGINRENDERING до E_ENDRENDERING: отрисовка представлений и UI, загрузка данных на GPU
+    i64 render;
+    // До E_ENDFRAME: вывод кадра, без VSync сюда попадает ожидание GPU
+    i64 present;
+    // Геометрии и вызовы отрисовки по статистике Renderer
+    i32 visible;
+    i32 batches;
+    // Выделения памяти по фазам, 0 без TRACK_ALLOCATIONS
+    u64 updateAllocations;
+    u64 poseAllocations;
+    u64 prepareAllocations;
+    u64 renderAllocations;
+    u64 presentAllocations;
+    // Сценарий переключил активные морфы
+    bool morphSwitch;
+};
+
+// Детерминированный замер: камера облетает сцену по фиксированной траектории, веса и активные
+// морфы меняются по сценарию, кадры идут с постоянным шагом. С окном каждый кадр - полный
+// Engine::RunFrame с отрисовкой, фазы отмечаются событиями движка. В режиме Headless рендера нет:
+// кадр ведётся вручную, меши по очереди получают потоковые позы, замеряется только CPU.
+// В обоих режимах один раз замеряются импорт файла, вычисление позы и распаковка каналов
+class FBXBenchmark : public Urho3D::Object
+{
+    URHO3D_OBJECT(FBXBenchmark, Object);
+
+public:
+    explicit FBXBenchmark(Urho3D::Context* context);
+
+    /// Run all frames and write the per-frame CSV and the percentile summary. Returns false on failure.
+    bool Run(Urho3D::Scene* scene, Urho3D::Node* cameraNode, const FBXBenchmarkSettings& settings);
+
+    const Urho3D::Vector<FBXBenchmarkFrame>& GetFrames() const { return frames_; }
+
+private:
+    void ApplyScript(Urho3D::Scene* scene, Urho3D::Node* cameraNode, i32 frame, const FBXBenchmarkSettings& settings);
+    // Геометрии каналов и потоковых поз, которые сценарий использует по ходу замера
+    void PrepareMorphs();
+    void RunRenderedFrame(i32 frame, const FBXBenchmarkSettings& settings);
+    void RunHeadlessFrame(Urho3D::Scene* scene, Urho3D::Node* cameraNode, i32 frame, const FBXBenchmarkSettings& settings);
+    bool WriteFrames(const Urho3D::String& path);
+    bool WriteSummary(const Urho3D::String& path);
+    bool CheckAllocations(const FBXBenchmarkSettings& settings);
+    // Повторный импорт файла сцены без создания узлов и буферов
+    bool MeasureImport(const FBXBenchmarkSettings& settings);
+    // Сумма всех каналов каждого меша сцены на CPU
+    void MeasurePoseEvaluate(Urho3D::Scene* scene);
+    // Скорость распаковки каналов сцены, перекодированных в формат файла каналов
+    bool MeasureChannelDecode(Urho3D::Scene* scene, const FBXBenchmarkSettings& settings);
+    // Отметка конца фазы: время и выделения с прошлой отметки
+    void Mark(i64& time, u64& allocations);
+    void HandleBeginFrame(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandlePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleBeginRendering(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleEndRendering(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleEndFrame(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    Urho3D::Vector<FBXBenchmarkFrame> frames_;
+    // Меши сцены и веса их потоковых поз в Headless
+    Urho3D::Vector<Urho3D::MorphGeometry*> geometries_;
+    Urho3D::Vector<Urho3D::Vector<float>> streamWeights_;
+    // Видимые объекты кадра в Headless
+    Urho3D::Vector<Urho3D::Drawable*> drawables_;
+    // Текущий кадр, заполняется обработчиками событий
+    FBXBenchmarkFrame current_{};
+    Urho3D::HiresTimer timer_;
+    u64 allocations_ = 0;
+    Urho3D::Vector3 center_;
+    float radius_ = 1.0f;
+};
@@ -0,0 +1,363 @@
+#include "FBXBinaryReader.h"
+#include <Urho3D/IO/FileSystem.h>
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+using namespace Urho3D;
+
+static const char FBX_BINARY_MAGIC[] = "Kaydara FBX Binary  ";
+// Магия, 0x1A 0x00 и номер версии
+static const u64 FBX_HEADER_SIZE = 27;
+// Глубже вложенность в FBX не встречается, ограничение защищает от испорченных файлов
+static const i32 FBX_MAX_DEPTH = 64;
+
+// Значения в файле little-endian и не выровнены
+template <class T> static T ReadValue(const unsigned char* data)
+{
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+FBXMappedFile::~FBXMappedFile()
+{
+    Close();
+}
+
+bool FBXMappedFile::Open(const String& path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileW(GetWideNativePath(path).CString(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = (u64)size.QuadPart;
+#else
+    int file = open(GetNativePath(path).CString(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // Отображение остаётся действительным после закрытия дескриптора
+    close(file);
+    if (view == MAP_FAILED)
+        return false;
+    // Записи читаются один раз подряд
+    madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = (u64)info.st_size;
+#endif
+    return true;
+}
+
+void FBXMappedFile::Close()
+{
+    if (!data_)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+    file_ = nullptr;
+    mapping_ = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data_), (size_t)size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+i64 FBXProperty::GetInt() const
+{
+    switch (type)
+    {
+    case 'Y': return ReadValue<i16>(data);
+    case 'C': return data[0] ? 1 : 0;
+    case 'I': return ReadValue<i32>(data);
+    case 'L': return ReadValue<i64>(data);
+    case 'F': return (i64)ReadValue<float>(data);
+    case 'D': return (i64)ReadValue<double>(data);
+    default: return 0;
+    }
+}
+
+double FBXProperty::GetDouble() const
+{
+    switch (type)
+    {
+    case 'F': return ReadValue<float>(data);
+    case 'D': return ReadValue<double>(data);
+    case 'Y':
+    case 'C':
+    case 'I':
+    case 'L':
+        return (double)GetInt();
+    default: return 0.0;
+    }
+}
+
+String FBXProperty::GetString() const
+{
+    if (type != 'S' && type != 'R')
+        return String::EMPTY;
+    return String(reinterpret_cast<const char*>(data), size);
+}
+
+bool FBXProperty::Equals(const char* text) const
+{
+    const u32 length = (u32)strlen(text);
+    return type == 'S' && size == length && memcmp(data, text, length) == 0;
+}
+
+bool FBXRecord::Is(const char* text) const
+{
+    const u32 length = (u32)strlen(text);
+    return nameLength == length && memcmp(name, text, length) == 0;
+}
+
+u32 GetFBXArrayElementSize(char type)
+{
+    switch (type)
+    {
+    case 'f':
+    case 'i':
+        return 4;
+    case 'd':
+    case 'l':
+        return 8;
+    case 'b':
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+bool IsFBXBinary(const unsigned char* data, u64 size)
+{
+    return size >= FBX_HEADER_SIZE && memcmp(data, FBX_BINARY_MAGIC, sizeof(FBX_BINARY_MAGIC)) == 0;
+}
+
+bool FBXBinaryDocument::ParseProperties(u64 offset, u64 end, u32 count, String& error)
+{
+    for (u32 i = 0; i < count; ++i)
+    {
+        if (offset >= end)
+        {
+            error = "Property list is truncated";
+            return false;
+        }
+        FBXProperty property{ (char)data_[offset], nullptr, 0, 0, 0 };
+        ++offset;
+        u64 valueSize = 0;
+        switch (property.type)
+        {
+        case 'C': valueSize = 1; break;
+        case 'Y': valueSize = 2; break;
+        case 'I':
+        case 'F':
+            valueSize = 4;
+            break;
+        case 'D':
+        case 'L':
+            valueSize = 8;
+            break;
+        case 'S':
+        case 'R':
+            if (offset + 4 > end)
+            {
+                error = "String property is truncated";
+                return false;
+            }
+            valueSize = ReadValue<u32>(data_ + offset);
+            offset += 4;
+            break;
+        default:
+        {
+            const u32 elementSize = GetFBXArrayElementSize(property.type);
+            if (!elementSize || offset + 12 > end)
+            {
+                error = String("Unknown property type ") + String((int)property.type);
+                return false;
+            }
+            property.arrayLength = ReadValue<u32>(data_ + offset);
+            property.encoding = ReadValue<u32>(data_ + offset + 4);
+            valueSize = ReadValue<u32>(data_ + offset + 8);
+            offset += 12;
+            if (property.encoding > 1 || (property.encoding == 0 && valueSize != (u64)property.arrayLength * elementSize))
+            {
+                error = "Array property has wrong encoding";
+                return false;
+            }
+            break;
+        }
+        }
+        if (offset + valueSize > end)
+        {
+            error = "Property value is truncated";
+            return false;
+        }
+        property.data = data_ + offset;
+        property.size = (u32)valueSize;
+        properties_.Push(property);
+        offset += valueSize;
+    }
+    return true;
+}
+
+bool FBXBinaryDocument::ParseList(u64& offset, u64 end, i32 depth, i32& first, String& error)
+{
+    // С версии 7500 смещения и размеры в заголовке записи 64-битные
+    const bool wide = version_ >= 7500;
+    const u64 headerSize = wide ? 25 : 13;
+    first = -1;
+    if (depth > FBX_MAX_DEPTH)
+    {
+        error = "Records are nested too deep";
+        return false;
+    }
+
+    i32 previous = -1;
+    while (offset + headerSize <= end)
+    {
+        const unsigned char* header = data_ + offset;
+        const u64 endOffset = wide ? ReadValue<u64>(header) : ReadValue<u32>(header);
+        const u64 numProperties = wide ? ReadValue<u64>(header + 8) : ReadValue<u32>(header + 4);
+        const u64 propertyListLength = wide ? ReadValue<u64>(header + 16) : ReadValue<u32>(header + 8);
+        const u32 nameLength = header[headerSize - 1];
+
+        // Нулевая запись закрывает список
+        if (endOffset == 0)
+        {
+            offset += headerSize;
+            return true;
+        }
+        const u64 propertiesBegin = offset + headerSize + nameLength;
+        if (endOffset > end || endOffset <= offset || propertiesBegin + propertyListLength > endOffset)
+        {
+            error = String("Record at ") + String(offset) + " has wrong size";
+            return false;
+        }
+
+        const i32 index = records_.Size();
+        records_.Push({ reinterpret_cast<const char*>(header + headerSize), nameLength, properties_.Size(),
+            (i32)numProperties, -1, -1 });
+        if (!ParseProperties(propertiesBegin, propertiesBegin + propertyListLength, (u32)numProperties, error))
+            return false;
+
+        u64 childOffset = propertiesBegin + propertyListLength;
+        if (childOffset < endOffset)
+        {
+            i32 firstChild;
+            if (!ParseList(childOffset, endOffset, depth + 1, firstChild, error))
+                return false;
+            records_[index].firstChild = firstChild;
+        }
+
+        if (previous >= 0)
+            records_[previous].nextSibling = index;
+        else
+            first = index;
+        previous = index;
+        offset = endOffset;
+    }
+    // Верхний уровень может закончиться без нулевой записи перед подвалом файла
+    return depth == 0 || offset == end;
+}
+
+bool FBXBinaryDocument::Parse(const unsigned char* data, u64 size, String& error)
+{
+    records_.Clear();
+    properties_.Clear();
+    data_ = data;
+    size_ = size;
+    if (!IsFBXBinary(data, size))
+    {
+        error = "Not a binary FBX file";
+        return false;
+    }
+    version_ = ReadValue<u32>(data + 23);
+    if (version_ < 7000)
+    {
+        error = String("Unsupported FBX version ") + String(version_);
+        return false;
+    }
+
+    u64 offset = FBX_HEADER_SIZE;
+    i32 first;
+    if (!ParseList(offset, size, 0, first, error))
+        return false;
+    if (records_.Empty())
+    {
+        error = "File has no records";
+        return false;
+    }
+    return true;
+}
+
+i32 FBXBinaryDocument::FindChild(i32 parent, const char* name) const
+{
+    i32 child = parent < 0 ? GetFirstRoot() : records_[parent].firstChild;
+    while (child >= 0 && !records_[child].Is(name))
+        child = records_[child].nextSibling;
+    return child;
+}
+
+bool DecodeFBXArray(const FBXProperty& property, void* dst)
+{
+    const u64 size = (u64)property.arrayLength * GetFBXArrayElementSize(property.type);
+    if (!size)
+        return true;
+    if (property.encoding == 0)
+    {
+        memcpy(dst, property.data, size);
+        return true;
+    }
+    uLongf length = (uLongf)size;
+    return uncompress(static_cast<Bytef*>(dst), &length, property.data, (uLong)property.size) == Z_OK && length == size;
+}
+
+String GetFBXObjectName(const FBXProperty& property)
+{
+    if (property.type != 'S')
+        return String::EMPTY;
+    // Имя и класс разделены "\0\1"
+    const char* text = reinterpret_cast<const char*>(property.data);
+    u32 length = 0;
+    while (length < property.size && text[length] != '\0')
+        ++length;
+    return String(text, length);
+}
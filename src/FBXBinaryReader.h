@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+
+// Чтение бинарного FBX 7.x без FBX SDK. Файл отображается в память, записи разбираются
+// в плоский список, значения свойств читаются прямо из отображения
+
+// Отображение файла в память только для чтения
+class FBXMappedFile
+{
+public:
+    FBXMappedFile() = default;
+    ~FBXMappedFile();
+    FBXMappedFile(const FBXMappedFile&) = delete;
+    FBXMappedFile& operator =(const FBXMappedFile&) = delete;
+
+    bool Open(const Urho3D::String& path);
+    void Close();
+
+    const unsigned char* GetData() const { return data_; }
+    u64 GetSize() const { return size_; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    u64 size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+// Свойство записи. Для массивов data указывает на данные после заголовка массива
+struct FBXProperty
+{
+    // Код типа из файла: Y C I F D L - числа, S R - строка и данные, f d l i b - массивы
+    char type;
+    const unsigned char* data;
+    // Байт данных в файле: у массивов - сжатый размер, у строк - длина
+    u32 size;
+    u32 arrayLength;
+    // 0 - данные как есть, 1 - zlib
+    u32 encoding;
+
+    bool IsArray() const { return type >= 'a' && type <= 'z'; }
+    i64 GetInt() const;
+    double GetDouble() const;
+    Urho3D::String GetString() const;
+    /// Return whether the string property equals the text.
+    bool Equals(const char* text) const;
+};
+
+// Запись файла. Дочерние записи связаны через nextSibling, -1 - конец списка
+struct FBXRecord
+{
+    const char* name;
+    u32 nameLength;
+    i32 firstProperty;
+    i32 numProperties;
+    i32 firstChild;
+    i32 nextSibling;
+
+    bool Is(const char* text) const;
+};
+
+class FBXBinaryDocument
+{
+public:
+    /// Parse the record tree of a mapped binary FBX. The data must outlive the document.
+    bool Parse(const unsigned char* data, u64 size, Urho3D::String& error);
+
+    u32 GetVersion() const { return version_; }
+    const FBXRecord& GetRecord(i32 index) const { return records_[index]; }
+    const FBXProperty& GetProperty(const FBXRecord& record, i32 index) const { return properties_[record.firstProperty + index]; }
+    /// Return the first top-level record, -1 if the file has none.
+    i32 GetFirstRoot() const { return records_.Empty() ? -1 : 0; }
+    /// Return the first child of the record with the name, -1 if there is none. Parent -1 searches top-level records.
+    i32 FindChild(i32 parent, const char* name) const;
+
+private:
+    bool ParseList(u64& offset, u64 end, i32 depth, i32& first, Urho3D::String& error);
+    bool ParseProperties(u64 offset, u64 end, u32 count, Urho3D::String& error);
+
+    const unsigned char* data_ = nullptr;
+    u64 size_ = 0;
+    u32 version_ = 0;
+    Urho3D::Vector<FBXRecord> records_;
+    Urho3D::Vector<FBXProperty> properties_;
+};
+
+/// Return whether the data starts with the binary FBX magic.
+bool IsFBXBinary(const unsigned char* data, u64 size);
+/// Return bytes per element of the array type, 0 for other types.
+u32 GetFBXArrayElementSize(char type);
+/// Copy or inflate the array into dst, which must hold arrayLength elements of the array type.
+bool DecodeFBXArray(const FBXProperty& property, void* dst);
+/// Return the object name part of "Name\0\1Class" name properties.
+Urho3D::String GetFBXObjectName(const FBXProperty& property);
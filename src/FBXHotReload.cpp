@@ -0,0 +1,159 @@
+#include "FBXHotReload.h"
+#include "MorphGeometry.h"
+#include "SceneUtils.h"
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+
+using namespace Urho3D;
+
+FBXReloadThread::FBXReloadThread(Context* context, const String& path, const FBXImportOptions& options) :
+    context_(context),
+    path_(path),
+    options_(options)
+{
+    options_.arena = nullptr;
+}
+
+void FBXReloadThread::ThreadFunction()
+{
+    HiresTimer timer;
+    success_ = LoadFBXMeshes(context_, path_, options_, meshes_);
+    seconds_ = timer.GetUSec(false) / 1000000.0f;
+    done_.store(true, std::memory_order_release);
+}
+
+FBXHotReloader::FBXHotReloader(Context* context) : Object(context)
+{
+}
+
+FBXHotReloader::~FBXHotReloader()
+{
+    Stop();
+}
+
+bool FBXHotReloader::Start(Scene* scene, const String& path, const FBXImportOptions& options)
+{
+    Stop();
+    scene_ = scene;
+    path_ = path;
+    options_ = options;
+    options_.arena = nullptr;
+
+    // Путь разрешается так же, как в ImportFBXScene
+    String fullPath = GetSubsystem<FileSystem>()->GetProgramDir() + path;
+    fileName_ = GetFileNameAndExtension(fullPath);
+    watcher_ = new FileWatcher(context_);
+    if (!watcher_->StartWatching(GetPath(fullPath), false))
+    {
+        watcher_.Reset();
+        GetSubsystem<Log>()->Write(LOG_WARNING, "Can't watch " + fullPath + " for hot reload");
+        return false;
+    }
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(FBXHotReloader, HandleUpdate));
+    GetSubsystem<Log>()->Write(LOG_INFO, "Watching " + fullPath + " for hot reload");
+    return true;
+}
+
+void FBXHotReloader::Stop()
+{
+    UnsubscribeFromEvent(E_UPDATE);
+    if (watcher_)
+    {
+        watcher_->StopWatching();
+        watcher_.Reset();
+    }
+    // Ожидание незавершённого импорта
+    thread_.Reset();
+    pending_ = false;
+}
+
+void FBXHotReloader::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    // FileWatcher сам выжидает паузу после последней записи в файл
+    String changed;
+    while (watcher_->GetNextChange(changed))
+    {
+        if (GetFileNameAndExtension(changed).Compare(fileName_, false) == 0)
+            pending_ = true;
+    }
+
+    if (thread_ && thread_->IsDone())
+    {
+        thread_->Stop();
+        ApplyReload();
+        thread_.Reset();
+    }
+
+    if (pending_ && !thread_)
+    {
+        pending_ = false;
+        GetSubsystem<Log>()->Write(LOG_INFO, "Reimport " + path_ + " in background");
+        thread_ = new FBXReloadThread(context_, path_, options_);
+        if (!thread_->Run())
+        {
+            thread_.Reset();
+            GetSubsystem<Log>()->Write(LOG_ERROR, "Can't start hot reload thread");
+        }
+    }
+}
+
+void FBXHotReloader::ApplyReload()
+{
+    Log* log = GetSubsystem<Log>();
+    if (!thread_->success_ || !scene_)
+    {
+        log->Write(LOG_WARNING, "Hot reload of " + path_ + " failed, keep the loaded meshes");
+        return;
+    }
+
+    // Новые данные по имени FBX-узла. Одноимённые меши сопоставляются по порядку
+    HashMap<String, Vector<SharedPtr<MorphMeshData>>> reloaded;
+    for (const SharedPtr<MorphMeshData>& data : thread_->meshes_)
+        reloaded[data->GetSourceMesh()].Push(data);
+
+    HiresTimer timer;
+    i32 changed = 0;
+    i32 unchanged = 0;
+    for (MorphGeometry* geometry : findAllComponents<MorphGeometry>(scene_.Get()))
+    {
+        // Старые данные удерживаются до конца итерации, после замены они могут освободиться.
+        // Одинаковые меши разделяют данные с источником первого из них, поэтому меш
+        // ищется по источнику компонента
+        SharedPtr<MorphMeshData> current(geometry->GetMeshData());
+        if (!current || geometry->GetSourceFile() != path_)
+            continue;
+        const String sourceMesh = geometry->GetSourceMesh();
+
+        auto it = reloaded.Find(sourceMesh);
+        if (it == reloaded.End() || it->second_.Empty())
+        {
+            log->Write(LOG_WARNING, "Mesh " + sourceMesh + " was removed from " + path_);
+            continue;
+        }
+        SharedPtr<MorphMeshData> data = it->second_.Front();
+        it->second_.Erase(0);
+
+        if (data->GetContentHash() == current->GetContentHash())
+        {
+            ++unchanged;
+            continue;
+        }
+        // Узел, материал, активный морф и вес сохраняются, меняются только буферы и каналы
+        geometry->SetMeshData(data);
+        geometry->Commit();
+        ++changed;
+        log->Write(LOG_INFO, "Hot reload updated mesh " + sourceMesh);
+    }
+
+    for (const auto& pair : reloaded)
+    {
+        if (!pair.second_.Empty())
+            log->Write(LOG_INFO, "Mesh " + pair.first_ + " was added to " + path_ + ", restart to show it");
+    }
+
+    log->Write(LOG_INFO, "Hot reload of " + path_ + ": " + String(changed) + " changed, " + String(unchanged) +
+        " unchanged, import " + String(thread_->seconds_) + " s, swap " + String(timer.GetUSec(false) / 1000.0f) + " ms");
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/IO/FileWatcher.h>
+#include <Urho3D/Scene/Scene.h>
+#include "FBXLoader.h"
+
+#include <atomic>
+
+// Фоновый импорт всех мешей файла для горячей перезагрузки
+class FBXReloadThread : public Urho3D::Thread
+{
+public:
+    FBXReloadThread(Urho3D::Context* context, const Urho3D::String& path, const FBXImportOptions& options);
+
+    void ThreadFunction() override;
+    bool IsDone() const { return done_.load(std::memory_order_acquire); }
+
+    Urho3D::Context* context_;
+    Urho3D::String path_;
+    FBXImportOptions options_;
+    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::MorphMeshData>> meshes_;
+    bool success_ = false;
+    float seconds_ = 0.0f;
+
+private:
+    std::atomic<bool> done_{false};
+};
+
+// Следит за исходным FBX и после его изменения повторно импортирует файл в фоне. Меши сравниваются
+// с загруженными по хэшу содержимого, заменяются только изменившиеся данные MorphGeometry, а узлы,
+// камера и UI остаются как есть
+class FBXHotReloader : public Urho3D::Object
+{
+    URHO3D_OBJECT(FBXHotReloader, Object);
+
+public:
+    explicit FBXHotReloader(Urho3D::Context* context);
+    ~FBXHotReloader() override;
+
+    /// Watch the file (path as given to LoadFBXToNode) and reload the meshes of scene imported from it.
+    bool Start(Urho3D::Scene* scene, const Urho3D::String& path, const FBXImportOptions& options);
+    void Stop();
+
+private:
+    void HandleUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void ApplyReload();
+
+    Urho3D::WeakPtr<Urho3D::Scene> scene_;
+    Urho3D::String path_;
+    Urho3D::String fileName_;
+    FBXImportOptions options_;
+    Urho3D::SharedPtr<Urho3D::FileWatcher> watcher_;
+    Urho3D::UniquePtr<FBXReloadThread> thread_;
+    // Файл изменился во время импорта, нужен ещё один проход
+    bool pending_ = false;
+};
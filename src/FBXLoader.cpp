@@ -1,5 +1,7 @@
 #include "FBXLoader.h"
 #include "MorphGeometry.h"
+#include "FBXMeshBuilder.h"
+#include "FBXNativeLoader.h"
 #include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/Graphics/CustomGeometry.h>
 #include <Urho3D/Graphics/Material.h>
@@ -8,20 +10,16 @@
 #include <Urho3D/Engine/Engine.h>
 #include <Urho3D/IO/Log.h>
 #include <Urho3D/Core/Context.h>
-#include <fbxsdk.h>
+#include <Urho3D/Container/HashSet.h>
 #include <Urho3D/Container/Vector.h>
+#ifdef FBX_SDK_ENABLED
+#include "FBXMeshStreams.h"
+#include <fbxsdk.h>
+#endif
 
 using namespace Urho3D;
 
-const float MODEL_MULTIPLIER = 1.0f;
-
-struct ControlPointsMorph {
-    // Если 0 - изменний не требуется
-    // Имеет размер равный количеству контрольных точек
-    Vector<Vector3> diff;
-    // Название морфа из fbx
-    String name;
-};
+#ifdef FBX_SDK_ENABLED
 
 struct ControlPoints {
     // Контрольные точки, используемые fbx
@@ -29,18 +27,18 @@ struct ControlPoints {
     // Количество контрольных точек
     int count;
     // Активыне морфы контрольных точек в fbx
-    Vector<ControlPointsMorph> morphs;
+    Vector<FBXMorphChannel> morphs;
 };
 
 Vector3 toUrho(FbxVector4 v) {
     return Vector3((float)v[0], (float)v[1], (float)v[2]);
 }
 
-ControlPointsMorph LoadPointsMorph(Context* context, FbxBlendShapeChannel* channel, FbxVector4* controlPoints, i32 totalPoints) {
+FBXMorphChannel LoadPointsMorph(Context* context, FbxBlendShapeChannel* channel, FbxVector4* controlPoints, i32 totalPoints, ImportArena& arena) {
     auto* log = context->GetSubsystem<Log>();
     log->Write(LOG_DEBUG, "Start LoadPointsMorph");
-    ControlPointsMorph morph{
-        Vector<Vector3>(totalPoints, Vector3::ZERO),
+    FBXMorphChannel morph{
+        arena.AllocateZeroed<Vector3>(totalPoints),
         channel->GetName()
     };
 
@@ -66,14 +64,37 @@ ControlPointsMorph LoadPointsMorph(Context* context, FbxBlendShapeChannel* chann
     return morph;
 }
 
-ControlPoints LoadControlPointsWithMorphs(Context* context, FbxMesh* fbxMesh) {
+// Каналы с целевой формой, только они попадают в морферы
+int GetMorphChannelCount(FbxMesh* fbxMesh) {
+    int count = 0;
+    for (int deformerIndex = 0; deformerIndex < fbxMesh->GetDeformerCount(FbxDeformer::eBlendShape); ++deformerIndex)
+    {
+        auto* blendShape = static_cast<FbxBlendShape*>(fbxMesh->GetDeformer(deformerIndex, FbxDeformer::eBlendShape));
+        for (int channelIndex = 0; channelIndex < blendShape->GetBlendShapeChannelCount(); ++channelIndex)
+        {
+            FbxBlendShapeChannel* channel = blendShape->GetBlendShapeChannel(channelIndex);
+            if (channel && channel->GetTargetShapeCount() > 0)
+                ++count;
+        }
+    }
+    return count;
+}
+
+// Точный объём временных данных импорта меша, чтобы арена обошлась одним блоком
+u64 GetMeshImportSize(FbxMesh* fbxMesh) {
+    return GetFBXMeshStreamsSize(fbxMesh) +
+        (u64)GetMorphChannelCount(fbxMesh) * fbxMesh->GetControlPointsCount() * sizeof(Vector3);
+}
+
+ControlPoints LoadControlPointsWithMorphs(Context* context, FbxMesh* fbxMesh, ImportArena& arena) {
     auto* log = context->GetSubsystem<Log>();
     log->Write(LOG_DEBUG, "Start LoadControlPointsWithMorphs");
     ControlPoints points{
         fbxMesh->GetControlPoints(),
         fbxMesh->GetControlPointsCount(),
-        Vector<ControlPointsMorph>()
+        Vector<FBXMorphChannel>()
     };
+    points.morphs.Reserve(GetMorphChannelCount(fbxMesh));
 
     for (int deformerIndex = 0; deformerIndex < fbxMesh->GetDeformerCount(); ++deformerIndex)
     {
@@ -86,7 +107,7 @@ ControlPoints LoadControlPointsWithMorphs(Context* context, FbxMesh* fbxMesh) {
             FbxBlendShapeChannel* channel = blendShape->GetBlendShapeChannel(channelIndex);
             if (!channel || channel->GetTargetShapeCount() == 0)
                 continue;
-            ControlPointsMorph morph = LoadPointsMorph(context, channel, points.points, points.count);
+            FBXMorphChannel morph = LoadPointsMorph(context, channel, points.points, points.count, arena);
             points.morphs.Push(morph);
         }
     }
@@ -94,101 +115,81 @@ ControlPoints LoadControlPointsWithMorphs(Context* context, FbxMesh* fbxMesh) {
     return points;
 }
 
-void LoadMorphGeometry(Context* context, ControlPoints points, FbxMesh* fbxMesh, MorphGeometry* morphGeometry) {
-    auto* log = context->GetSubsystem<Log>();
-    Vector<Morpher> morphers{};
-    for (auto m : points.morphs) {
-        morphers.Push({
-            m.name,
-            Vector<i32>(),
-            Vector<Vector3>()
-        });
-    }
-    Vector<MorphVertex> vertices;
-    Vector<i32> indices;
-    for (int i = 0; i < fbxMesh->GetPolygonCount(); ++i)
+void LoadMorphGeometry(Context* context, const ControlPoints& points, FbxMesh* fbxMesh, MorphMeshData* meshData,
+    const FBXImportOptions& options, ImportArena& arena) {
+    // Слои нормалей, UV и касательных читаются один раз на меш
+    FBXMeshStreams streams;
+    ExtractFBXMeshStreams(fbxMesh, arena, streams);
+    BuildFBXMorphMesh(context, streams, points.morphs, meshData, options, fbxMesh->GetName(), arena);
+}
+
+// Данные меша без узла и буферов, можно вызывать не из основного потока
+SharedPtr<MorphMeshData> LoadFBXMeshData(Context* context, FbxMesh* fbxMesh, const FBXImportOptions& options)
+{
+    // Временные данные предыдущего меша больше не нужны
+    ImportArena localArena;
+    ImportArena& arena = options.arena ? *options.arena : localArena;
+    arena.Reset();
+    arena.Reserve(GetMeshImportSize(fbxMesh));
+    ControlPoints controlPoints = LoadControlPointsWithMorphs(context, fbxMesh, arena);
+    SharedPtr<MorphMeshData> meshData(new MorphMeshData(context));
+    meshData->SetResidency(options.residency);
+    meshData->SetOccluderSettings(options.occluders);
+    LoadMorphGeometry(context, controlPoints, fbxMesh, meshData, options, arena);
+    if (fbxMesh->GetNode())
+        meshData->SetSource(options.sourceFile, fbxMesh->GetNode()->GetName());
+    return meshData;
+}
+
+// Дочерние меши узла, которые можно слить: одинаковое локальное преобразование.
+// Материал у всех морф-мешей один (MORPH_MATERIAL), поэтому он в ключ не входит
+Vector<Vector<FbxNode*>> GroupSiblingMeshes(FbxNode* fbxNode)
+{
+    Vector<Vector<FbxNode*>> groups;
+    Vector<FbxAMatrix> transforms;
+    for (int i = 0; i < fbxNode->GetChildCount(); ++i)
     {
-        int polySize = fbxMesh->GetPolygonSize(i);
-        if (polySize != 3)
-        {
-            log->Write(LOG_ERROR, "Can't process non-triangulated polygon");
+        FbxNode* child = fbxNode->GetChild(i);
+        if (!child->GetMesh())
             continue;
-        }
-
-        for (int j = 0; j < polySize; ++j)
+        FbxAMatrix transform = child->EvaluateLocalTransform();
+        i32 group = 0;
+        while (group < transforms.Size() && transforms[group] != transform)
+            ++group;
+        if (group == transforms.Size())
         {
-            int ctrlPointIndex = fbxMesh->GetPolygonVertex(i, j);
-            FbxVector4 pos = points.points[ctrlPointIndex];
-            Vector3 position = toUrho(pos);
-            position *= MODEL_MULTIPLIER;
-
-            // Нормаль
-            Vector3 normal = Vector3::UP;
-            FbxVector4 fbxNormal;
-            if (fbxMesh->GetPolygonVertexNormal(i, j, fbxNormal))
-                normal = toUrho(pos);
-
-            // UV
-            Vector2 uv = Vector2::ZERO;
-            FbxStringList uvSetNames;
-            fbxMesh->GetUVSetNames(uvSetNames);
-            if (uvSetNames.GetCount() > 0)
-            {
-                FbxVector2 fbxUV;
-                bool unmapped;
-                if (fbxMesh->GetPolygonVertexUV(i, j, uvSetNames[0], fbxUV, unmapped))
-                    uv = Vector2((float)fbxUV[0], 1.0f - (float)fbxUV[1]);
-            }
-
-            MorphVertex vertex;
-            vertex.position_ = position;
-            vertex.normal_ = normal;
-            vertex.texCoord_ = uv;
-            vertex.tangent_ = Vector4(1.0f, 0.0f, 0.0f, 1.0f);
-
-            vertices.Push(vertex);
-            indices.Push(vertices.Size() - 1);
-            for (int k = 0; k < points.morphs.Size(); ++k) {
-                auto m = points.morphs[k];
-                Vector3 diffV = m.diff[ctrlPointIndex];
-                if (diffV != Vector3::ZERO) {
-                    morphers[k].morphDeltas.Push(diffV);
-                    morphers[k].indexes.Push(vertices.Size() - 1);
-                }
-            }
+            transforms.Push(transform);
+            groups.Resize(groups.Size() + 1);
         }
+        groups[group].Push(child);
     }
-    morphGeometry->SetVertices(vertices);
-    morphGeometry->SetIndices(indices);
-    for (auto m : morphers) {
-        morphGeometry->AddMorpher(m);
+    return groups;
+}
+
+// Сливает меши группы в один, каналы частей сохраняются с префиксом имени узла
+SharedPtr<MorphMeshData> LoadFBXMergedMeshData(Context* context, const Vector<FbxNode*>& group, const FBXImportOptions& options)
+{
+    // Сжатие применяется к общему набору морферов, а не к частям
+    FBXImportOptions partOptions = options;
+    partOptions.compressMorphs = false;
+    // Каналы частей нужны в памяти до слияния
+    partOptions.residency = MORPH_RESIDENCY_KEEP_ALL;
+
+    Vector<SharedPtr<MorphMeshData>> parts;
+    Vector<String> partNames;
+    for (FbxNode* fbxNode : group)
+    {
+        parts.Push(LoadFBXMeshData(context, fbxNode->GetMesh(), partOptions));
+        partNames.Push(fbxNode->GetName());
     }
+    return MergeFBXMeshData(context, parts, partNames, options);
 }
 
-SharedPtr<Node> BuildUrhoGeometryMorphFromFBXMeshNew(Context* context, FbxMesh* fbxMesh) 
+SharedPtr<Node> BuildUrhoGeometryMorphFromFBXMeshNew(Context* context, FbxMesh* fbxMesh, const FBXImportOptions& options)
 {
     auto* log = context->GetSubsystem<Log>();
     log->Write(LOG_INFO, "RUN BuildUrhoGeometryMorphFromFBXMeshNew");
-    SharedPtr<Node> node(new Node(context));
-
-    ControlPoints controlPoints = LoadControlPointsWithMorphs(context, fbxMesh);
-    auto* morphGeometry = node->CreateComponent<MorphGeometry>();
-    node->SetName(fbxMesh->GetName());
-    LoadMorphGeometry(context, controlPoints, fbxMesh, morphGeometry);
-
-    auto* cache = context->GetSubsystem<ResourceCache>();
-    auto* material = cache->GetResource<Material>("Materials/Morph.xml");
-    if (material) {
-        Technique* tech = material->GetTechnique(0);
-        Pass* pass = tech->GetPass(0);
-        pass->SetVertexShaderDefines("MORPH_ENABLED");
-        morphGeometry->SetMaterial(material);
-    }
-
-    morphGeometry->Commit();
-    log->Write(LOG_INFO, "Success compete BuildUrhoGeometryMorphFromFBXMesh");
-
-    return node;
+    return BuildMorphNode(context, LoadFBXMeshData(context, fbxMesh, options), fbxMesh->GetName());
 }
 
 SharedPtr<Node> BuildUrhoGeometryMorphFromFBXMesh(Context* context, FbxMesh* fbxMesh)
@@ -302,7 +303,7 @@ SharedPtr<Node> BuildUrhoGeometryMorphFromFBXMesh(Context* context, FbxMesh* fbx
     morphGeometry->SetIndices(indices);
 
     auto* cache = context->GetSubsystem<ResourceCache>();
-    auto* material = cache->GetResource<Material>("Materials/Morph.xml");
+    auto* material = cache->GetResource<Material>(MORPH_MATERIAL);
     if (material) {
         Technique* tech = material->GetTechnique(0);
         Pass* pass = tech->GetPass(0);
@@ -322,52 +323,27 @@ SharedPtr<Node> BuildUrhoGeometryFromFBXMesh(Context* context, FbxMesh* fbxMesh)
 {
     auto* log = context->GetSubsystem<Log>();
     log->Write(LOG_INFO, "RUN BuildUrhoGeometryFromFBXMesh");
-    FbxVector4* controlPoints = fbxMesh->GetControlPoints();
+    ImportArena arena;
+    arena.Reserve(GetFBXMeshStreamsSize(fbxMesh));
+    FBXMeshStreams streams;
+    ExtractFBXMeshStreams(fbxMesh, arena, streams);
+    Vector<MorphVertex> vertices;
+    Vector<i32> indices;
+    BuildFBXMeshGeometry(context, streams, MODEL_MULTIPLIER, arena, vertices, indices);
+
     SharedPtr<Node> node(new Node(context));
     CustomGeometry* geom = node->CreateComponent<CustomGeometry>();
     geom->SetNumGeometries(1);
     geom->SetDynamic(false);
     geom->BeginGeometry(0, TRIANGLE_LIST);
 
-    for (int i = 0; i < fbxMesh->GetPolygonCount(); ++i)
+    for (i32 index : indices)
     {
-        int polySize = fbxMesh->GetPolygonSize(i);
-        if (polySize != 3) 
-        {
-            context->GetSubsystem<Log>()->Write(LOG_ERROR, "Can't process non-triangulated polygon");
-            return SharedPtr<Node>();
-        }
-
-        for (int j = 0; j < polySize; ++j)
-        {
-            int ctrlPointIndex = fbxMesh->GetPolygonVertex(i, j);
-            FbxVector4 pos = controlPoints[ctrlPointIndex];
-            Vector3 position((float)pos[0], (float)pos[1], (float)pos[2]);
-            position *= MODEL_MULTIPLIER;
-
-            // Нормаль
-            Vector3 normal = Vector3::UP;
-            FbxVector4 fbxNormal;
-            if (fbxMesh->GetPolygonVertexNormal(i, j, fbxNormal))
-                normal = Vector3((float)fbxNormal[0], (float)fbxNormal[1], (float)fbxNormal[2]);
-
-            // UV
-            Vector2 uv = Vector2::ZERO;
-            FbxStringList uvSetNames;
-            fbxMesh->GetUVSetNames(uvSetNames);
-            if (uvSetNames.GetCount() > 0)
-            {
-                FbxVector2 fbxUV;
-                bool unmapped;
-                if (fbxMesh->GetPolygonVertexUV(i, j, uvSetNames[0], fbxUV, unmapped))
-                    uv = Vector2((float)fbxUV[0], 1.0f - (float)fbxUV[1]);
-            }
-
-            geom->DefineVertex(position);
-            geom->DefineNormal(normal);
-            geom->DefineTexCoord(uv);
-            geom->DefineTangent(Vector4(1.0f, 0.0f, 0.0f, 1.0f));
-        }
+        const MorphVertex& vertex = vertices[index];
+        geom->DefineVertex(vertex.position_);
+        geom->DefineNormal(vertex.normal_);
+        geom->DefineTexCoord(vertex.texCoord_);
+        geom->DefineTangent(vertex.tangent_);
     }
 
     geom->Commit();
@@ -400,91 +376,217 @@ FbxMesh* GetFirstMeshFromScene(Log* log, FbxScene* scene)
 }
 
 
-FbxScene* ImportFBXScene(Context* context, FbxManager* manager, const String& fbxPath)
+// Меш узла для перечитывания каналов, false если файл не открылся
+bool LoadFBXSourceMeshSDK(Context* context, const String& fbxPath, const String& nodeName,
+    Vector<SharedPtr<MorphMeshData>>& meshes)
 {
-    
-    auto* log = context->GetSubsystem<Log>();
-    log->Write(LOG_INFO, "RUN ImportFBXScene");
-
-    FbxIOSettings* ioSettings = FbxIOSettings::Create(manager, IOSROOT);
-    manager->SetIOSettings(ioSettings);
+    FbxScene* scene = ImportFBXScene(context, fbxPath);
+    if (!scene)
+        return false;
 
-    String path = context->GetSubsystem<FileSystem>()->GetProgramDir() + fbxPath;
-    FbxImporter* importer = FbxImporter::Create(manager, "scene");
-    if (!importer->Initialize(path.CString(), -1, manager->GetIOSettings()))
+    FbxNode* fbxNode = scene->GetRootNode()->FindChild(nodeName.CString());
+    FbxMesh* fbxMesh = fbxNode ? fbxNode->GetMesh() : nullptr;
+    if (fbxMesh)
     {
-        log->Write(LOG_ERROR, String("FBX Import Error: ") + importer->GetStatus().GetErrorString());
-        manager->Destroy();
-        return nullptr;
+        SharedPtr<MorphMeshData> reloaded(new MorphMeshData(context));
+        ImportArena arena;
+        arena.Reserve(GetMeshImportSize(fbxMesh));
+        LoadMorphGeometry(context, LoadControlPointsWithMorphs(context, fbxMesh, arena), fbxMesh, reloaded, FBXImportOptions(), arena);
+        meshes.Push(reloaded);
     }
-
-    FbxScene* scene = FbxScene::Create(manager, "scene");
-    log->Write(LOG_INFO, String("Load fbx file with ") + String(scene->GetNodeCount()) + String(" nodes\n"));
-    importer->Import(scene);
-    importer->Destroy();
-
-    return scene;
+    ReleaseFBXScene(scene);
+    return true;
 }
 
-void LoadFBXNodeRecursive(Context* context, Node* parentNode, FbxNode* fbxNode, SharedPtr<Node>  nodeLoader (Context* context, FbxMesh* fbxMesh))
+void LoadFBXNodeRecursive(Context* context, Node* parentNode, FbxNode* fbxNode, const FBXImportOptions& options,
+    SharedPtr<Node> nodeLoader (Context* context, FbxMesh* fbxMesh, const FBXImportOptions& options), bool meshMerged = false)
 {
     // Создаём новый Urho3D Node с именем из FBX
     Node* node = parentNode->CreateChild(fbxNode->GetName());
 
-    // Загружаем геометрию, если есть FbxMesh
+    // Загружаем геометрию, если есть FbxMesh и она не слита с соседями
     FbxMesh* fbxMesh = fbxNode->GetMesh();
-    if (fbxMesh)
+    if (fbxMesh && !meshMerged)
     {
         // Заменяешь на MorphGeometry, если нужно
-        SharedPtr<Node> morphGeom = nodeLoader(context, fbxMesh);
+        SharedPtr<Node> morphGeom = nodeLoader(context, fbxMesh, options);
         if (morphGeom)
             node->AddChild(morphGeom);
     }
 
+    // Дочерние меши с общим материалом и преобразованием рисуются одной геометрией
+    HashSet<FbxNode*> merged;
+    if (options.mergeStaticMeshes)
+    {
+        for (const Vector<FbxNode*>& group : GroupSiblingMeshes(fbxNode))
+        {
+            if (group.Size() < 2)
+                continue;
+            SharedPtr<MorphMeshData> meshData = LoadFBXMergedMeshData(context, group, options);
+            node->AddChild(BuildMorphNode(context, meshData, meshData->GetSourceMesh()));
+            for (FbxNode* part : group)
+                merged.Insert(part);
+        }
+    }
+
     // Рекурсивно обходим дочерние узлы
     for (int i = 0; i < fbxNode->GetChildCount(); ++i)
     {
         FbxNode* childFBX = fbxNode->GetChild(i);
-        LoadFBXNodeRecursive(context, node, childFBX, nodeLoader);
+        LoadFBXNodeRecursive(context, node, childFBX, options, nodeLoader, merged.Contains(childFBX));
     }
 }
 
 
-SharedPtr<Node> LoadFBXToNode(Context* context, const String& fbxPath)
+void LoadFBXMeshDataRecursive(Context* context, FbxNode* fbxNode, const FBXImportOptions& options,
+    Vector<SharedPtr<MorphMeshData>>& meshes, bool meshMerged = false)
 {
-    auto* log = context->GetSubsystem<Log>();
-    FbxManager* manager = FbxManager::Create();
-    if (!manager)
+    FbxMesh* fbxMesh = fbxNode->GetMesh();
+    if (fbxMesh && !meshMerged)
     {
-        log->Write(LOG_ERROR, "Failed to create FBX Manager");
-        return nullptr;
+        SharedPtr<MorphMeshData> meshData = LoadFBXMeshData(context, fbxMesh, options);
+        meshData->CalculateHash();
+        meshes.Push(meshData);
+    }
+
+    // Слияние как в LoadFBXNodeRecursive, чтобы имена совпали при горячей перезагрузке
+    HashSet<FbxNode*> merged;
+    if (options.mergeStaticMeshes)
+    {
+        for (const Vector<FbxNode*>& group : GroupSiblingMeshes(fbxNode))
+        {
+            if (group.Size() < 2)
+                continue;
+            SharedPtr<MorphMeshData> meshData = LoadFBXMergedMeshData(context, group, options);
+            meshData->CalculateHash();
+            meshes.Push(meshData);
+            for (FbxNode* part : group)
+                merged.Insert(part);
+        }
     }
-    FbxScene* scene = ImportFBXScene(context, manager, fbxPath);
+
+    for (int i = 0; i < fbxNode->GetChildCount(); ++i)
+    {
+        FbxNode* childFBX = fbxNode->GetChild(i);
+        LoadFBXMeshDataRecursive(context, childFBX, options, meshes, merged.Contains(childFBX));
+    }
+}
+
+bool LoadFBXMeshesSDK(Context* context, const String& fbxPath, const FBXImportOptions& options,
+    Vector<SharedPtr<MorphMeshData>>& meshes)
+{
+    FbxScene* scene = ImportFBXScene(context, fbxPath, options.profile);
+    if (!scene)
+        return false;
+
+    ImportArena arena;
+    FBXImportOptions sourceOptions = options;
+    sourceOptions.sourceFile = fbxPath;
+    sourceOptions.arena = &arena;
+    LoadFBXMeshDataRecursive(context, scene->GetRootNode(), sourceOptions, meshes);
+    ReleaseFBXScene(scene);
+    return true;
+}
+
+SharedPtr<Node> LoadFBXToNodeSDK(Context* context, const String& fbxPath, const FBXImportOptions& options)
+{
+    auto* log = context->GetSubsystem<Log>();
+    FbxScene* scene = ImportFBXScene(context, fbxPath, options.profile);
     if (!scene)
     {
         log->Write(LOG_ERROR, "Failed to load FBX scene");
-        manager->Destroy();
         return SharedPtr<Node>();
     }
 
     SharedPtr<Node> node(new Node(context));
     node->SetName("FBXImpoted");
 
+    // Одна арена на весь импорт, сбрасывается перед каждым мешем
+    ImportArena arena;
+    FBXImportOptions sourceOptions = options;
+    sourceOptions.sourceFile = fbxPath;
+    sourceOptions.arena = &arena;
 
     SharedPtr<Node> resultMorhp = SharedPtr<Node>(node->CreateChild("Morph"));
-    LoadFBXNodeRecursive(context, resultMorhp, scene->GetRootNode(), [](Context* ctx, FbxMesh* mesh) {
-        return BuildUrhoGeometryMorphFromFBXMeshNew(ctx, mesh);
+    LoadFBXNodeRecursive(context, resultMorhp, scene->GetRootNode(), sourceOptions, [](Context* ctx, FbxMesh* mesh, const FBXImportOptions& opts) {
+        return BuildUrhoGeometryMorphFromFBXMeshNew(ctx, mesh, opts);
     });
     resultMorhp->SetPosition(Vector3(0, 0, 0));
     node->AddChild(resultMorhp);
 
     // SharedPtr<Node> resultSimple = SharedPtr<Node>(node->CreateChild("Simple"));
-    // LoadFBXNodeRecursive(context, resultSimple, scene->GetRootNode(), [](Context* ctx, FbxMesh* mesh) {
+    // LoadFBXNodeRecursive(context, resultSimple, scene->GetRootNode(), options, [](Context* ctx, FbxMesh* mesh, const FBXImportOptions& opts) {
     //     return BuildUrhoGeometryFromFBXMesh(ctx, mesh);
     // });
     // node->AddChild(resultSimple);
-    manager->Destroy();
+    ReleaseFBXScene(scene);
+    log->Write(LOG_INFO, String("Import arena: ") + String(arena.GetNumAllocations()) + " allocations, " +
+        String(arena.GetNumHeapAllocations()) + " heap allocations, peak " + String(arena.GetPeakBytes()) + " bytes");
     log->Write(LOG_INFO, "Complete LoadFBXToNode");
     return node;
 }
+#endif
+
+// Повторное чтение каналов меша для MORPH_RESIDENCY_RELOAD
+bool ReloadFBXMorphers(MorphMeshData* data)
+{
+    Context* context = data->GetContext();
+    auto* log = context->GetSubsystem<Log>();
+    log->Write(LOG_INFO, String("Reload morphers of ") + data->GetSourceMesh() + " from " + data->GetSourceFile());
+
+    // Каналы восстанавливаются без сжатия, индексы вершин совпадают с исходным импортом
+    Vector<SharedPtr<MorphMeshData>> meshes;
+    bool loaded = LoadFBXMeshesNative(context, data->GetSourceFile(), FBXImportOptions(), meshes, data->GetSourceMesh());
+#ifdef FBX_SDK_ENABLED
+    if (!loaded)
+        loaded = LoadFBXSourceMeshSDK(context, data->GetSourceFile(), data->GetSourceMesh(), meshes);
+#endif
+    if (!loaded)
+        return false;
+    if (meshes.Empty())
+    {
+        log->Write(LOG_ERROR, String("Can't find mesh ") + data->GetSourceMesh() + " in " + data->GetSourceFile());
+        return false;
+    }
+    if (meshes[0]->GetVertexCount() != data->GetVertexCount())
+    {
+        log->Write(LOG_ERROR, String("Source mesh ") + data->GetSourceMesh() + " was changed since import");
+        return false;
+    }
+    data->RestoreMorphers(meshes[0]->GetMorphers(), MorphBasis());
+    return true;
+}
+
+bool LoadFBXMeshes(Context* context, const String& fbxPath, const FBXImportOptions& options,
+    Vector<SharedPtr<MorphMeshData>>& meshes)
+{
+    // ASCII и старые файлы встроенный парсер не читает, для них остаётся SDK
+    if (options.parser != FBX_PARSER_SDK && LoadFBXMeshesNative(context, fbxPath, options, meshes))
+        return true;
+#ifdef FBX_SDK_ENABLED
+    if (options.parser != FBX_PARSER_NATIVE)
+        return LoadFBXMeshesSDK(context, fbxPath, options, meshes);
+#endif
+    context->GetSubsystem<Log>()->Write(LOG_ERROR, "Can't load " + fbxPath + " without FBX SDK");
+    return false;
+}
+
+SharedPtr<Node> LoadFBXToNode(Context* context, const String& fbxPath, const FBXImportOptions& options)
+{
+    auto* log = context->GetSubsystem<Log>();
+    auto* registry = context->GetSubsystem<MorphMeshRegistry>();
+    if (registry && !registry->GetReloader())
+        registry->SetReloader(ReloadFBXMorphers);
+
+    SharedPtr<Node> node;
+    if (options.parser != FBX_PARSER_SDK)
+        node = LoadFBXToNodeNative(context, fbxPath, options);
+#ifdef FBX_SDK_ENABLED
+    if (!node && options.parser != FBX_PARSER_NATIVE)
+        node = LoadFBXToNodeSDK(context, fbxPath, options);
+#endif
+    if (!node)
+        log->Write(LOG_ERROR, "Failed to load FBX scene");
+    return node;
+}
 
@@ -3,9 +3,51 @@
 #include <Urho3D/Scene/Node.h>
 #include <Urho3D/Container/Ptr.h>
 #include <Urho3D/Core/Object.h>
+#include "MorphCompression.h"
+#include "MorphMeshData.h"
+#include "ImportArena.h"
+#include "FBXManagerPool.h"
 
 namespace Urho3D {
     class Context;
 }
 
-Urho3D::SharedPtr<Urho3D::Node> LoadFBXToNode(Urho3D::Context* context, const Urho3D::String& path);
+// Чем читается файл
+enum FBXParser
+{
+    // Встроенный парсер, для ASCII и старых файлов - FBX SDK
+    FBX_PARSER_AUTO,
+    FBX_PARSER_SDK,
+    // Только бинарный FBX 7.x без SDK
+    FBX_PARSER_NATIVE,
+};
+
+struct FBXImportOptions
+{
+    // Разложение каналов меша по общему базису при импорте. Сжатие только для хранения: уменьшает
+    // данные морфов на CPU, поток смещений активного морфа на GPU остаётся полного размера
+    bool compressMorphs = false;
+    Urho3D::MorphCompressionSettings compression;
+    // Слияние соседних мешей с общим материалом и преобразованием в одну геометрию.
+    // Каналы частей получают имена "<узел>.<канал>"
+    bool mergeStaticMeshes = false;
+    // Упрощённые окклюдеры для крупных мешей
+    Urho3D::MorphOccluderSettings occluders;
+    // Какие данные остаются на CPU после загрузки буферов
+    Urho3D::MorphResidency residency = Urho3D::MORPH_RESIDENCY_KEEP_ALL;
+    // Разделы файла, которые читает SDK. Загрузчику нужны только меши и blend shape
+    FBXImportProfile profile = FBX_PROFILE_GEOMETRY_MORPHS;
+    FBXParser parser = FBX_PARSER_AUTO;
+    // Заполняется LoadFBXToNode, нужен для MORPH_RESIDENCY_RELOAD
+    Urho3D::String sourceFile;
+    // Заполняется LoadFBXToNode: арена для временных данных импорта
+    Urho3D::ImportArena* arena = nullptr;
+};
+
+Urho3D::SharedPtr<Urho3D::Node> LoadFBXToNode(Urho3D::Context* context, const Urho3D::String& path,
+    const FBXImportOptions& options = FBXImportOptions());
+
+/// Import the meshes of the file as uncommitted, hashed mesh data named after their FBX nodes,
+/// without creating nodes or GPU buffers. Safe to call from a background thread.
+bool LoadFBXMeshes(Urho3D::Context* context, const Urho3D::String& path, const FBXImportOptions& options,
+    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::MorphMeshData>>& meshes);
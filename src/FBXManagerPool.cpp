@@ -0,0 +1,143 @@
+#include "FBXManagerPool.h"
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <fbxsdk.h>
+
+using namespace Urho3D;
+
+// Больше простаивающих менеджеров не держим: параллельных импортов столько не бывает
+static const i32 FBX_POOL_MAX_IDLE = 4;
+
+struct FBXPooledManager
+{
+    FbxManager* manager;
+    // Импортёр создаётся вместе с менеджером и переиспользуется для следующих файлов
+    FbxImporter* importer;
+    // Пул остановлен, пока сцена была в работе: менеджер удаляется при возврате
+    bool discard;
+};
+
+static Mutex poolMutex;
+static Vector<FBXPooledManager> idleManagers;
+static Vector<FBXPooledManager> busyManagers;
+
+static void DestroyPooledManager(FBXPooledManager& entry)
+{
+    entry.importer->Destroy();
+    entry.manager->Destroy();
+}
+
+static void ApplyImportProfile(FbxIOSettings* ioSettings, FBXImportProfile profile)
+{
+    const bool full = profile == FBX_PROFILE_FULL;
+    ioSettings->SetBoolProp(IMP_FBX_MATERIAL, full);
+    ioSettings->SetBoolProp(IMP_FBX_TEXTURE, full);
+    ioSettings->SetBoolProp(IMP_FBX_LINK, full);
+    ioSettings->SetBoolProp(IMP_FBX_GOBO, full);
+    ioSettings->SetBoolProp(IMP_FBX_ANIMATION, full);
+    ioSettings->SetBoolProp(IMP_FBX_CHARACTER, full);
+    ioSettings->SetBoolProp(IMP_FBX_CONSTRAINT, full);
+    ioSettings->SetBoolProp(IMP_FBX_EXTRACT_EMBEDDED_FILE, full);
+    ioSettings->SetBoolProp(IMP_FBX_MODEL, true);
+    ioSettings->SetBoolProp(IMP_FBX_GLOBAL_SETTINGS, true);
+    ioSettings->SetBoolProp(IMP_FBX_SHAPE, profile != FBX_PROFILE_GEOMETRY);
+}
+
+static bool AcquireManager(FBXPooledManager& entry)
+{
+    {
+        MutexLock lock(poolMutex);
+        if (!idleManagers.Empty())
+        {
+            entry = idleManagers.Back();
+            idleManagers.Pop();
+            busyManagers.Push(entry);
+            return true;
+        }
+    }
+
+    // Создание менеджера - самая дорогая часть подготовки SDK, выполняется вне блокировки
+    entry.manager = FbxManager::Create();
+    if (!entry.manager)
+        return false;
+    entry.manager->SetIOSettings(FbxIOSettings::Create(entry.manager, IOSROOT));
+    entry.importer = FbxImporter::Create(entry.manager, "importer");
+    entry.discard = false;
+
+    MutexLock lock(poolMutex);
+    busyManagers.Push(entry);
+    return true;
+}
+
+static void ReleaseManager(FbxManager* manager)
+{
+    MutexLock lock(poolMutex);
+    for (i32 i = 0; i < busyManagers.Size(); ++i)
+    {
+        if (busyManagers[i].manager != manager)
+            continue;
+        FBXPooledManager entry = busyManagers[i];
+        busyManagers.EraseSwap(i);
+        if (entry.discard || idleManagers.Size() >= FBX_POOL_MAX_IDLE)
+            DestroyPooledManager(entry);
+        else
+            idleManagers.Push(entry);
+        return;
+    }
+}
+
+FbxScene* ImportFBXScene(Context* context, const String& fbxPath, FBXImportProfile profile)
+{
+    auto* log = context->GetSubsystem<Log>();
+    log->Write(LOG_INFO, "RUN ImportFBXScene");
+
+    FBXPooledManager entry;
+    if (!AcquireManager(entry))
+    {
+        log->Write(LOG_ERROR, "Failed to create FBX Manager");
+        return nullptr;
+    }
+    FbxIOSettings* ioSettings = entry.manager->GetIOSettings();
+    ApplyImportProfile(ioSettings, profile);
+
+    // Относительные пути задаются от каталога программы, абсолютные приходят из ResourceCache
+    String path = IsAbsolutePath(fbxPath) ? fbxPath : context->GetSubsystem<FileSystem>()->GetProgramDir() + fbxPath;
+    if (!entry.importer->Initialize(path.CString(), -1, ioSettings))
+    {
+        log->Write(LOG_ERROR, String("FBX Import Error: ") + entry.importer->GetStatus().GetErrorString());
+        ReleaseManager(entry.manager);
+        return nullptr;
+    }
+
+    FbxScene* scene = FbxScene::Create(entry.manager, "scene");
+    if (!entry.importer->Import(scene))
+    {
+        log->Write(LOG_ERROR, String("FBX Import Error: ") + entry.importer->GetStatus().GetErrorString());
+        ReleaseFBXScene(scene);
+        return nullptr;
+    }
+    log->Write(LOG_INFO, String("Load fbx file with ") + String(scene->GetNodeCount()) + String(" nodes\n"));
+    return scene;
+}
+
+void ReleaseFBXScene(FbxScene* scene)
+{
+    if (!scene)
+        return;
+    FbxManager* manager = scene->GetFbxManager();
+    scene->Destroy();
+    ReleaseManager(manager);
+}
+
+void ShutdownFBXManagerPool()
+{
+    MutexLock lock(poolMutex);
+    for (FBXPooledManager& entry : idleManagers)
+        DestroyPooledManager(entry);
+    idleManagers.Clear();
+    for (FBXPooledManager& entry : busyManagers)
+        entry.discard = true;
+}
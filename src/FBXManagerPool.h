@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+
+namespace Urho3D {
+    class Context;
+}
+
+namespace fbxsdk {
+    class FbxScene;
+}
+
+// Какие данные SDK читает из файла. Пропущенные разделы не разбираются и не занимают память сцены
+enum FBXImportProfile
+{
+    // Всё, что умеет SDK: материалы, текстуры, анимация, встроенные файлы
+    FBX_PROFILE_FULL,
+    // Иерархия узлов, меши и blend shape - всё, что использует загрузчик
+    FBX_PROFILE_GEOMETRY_MORPHS,
+    // Только иерархия и меши, без каналов морфов
+    FBX_PROFILE_GEOMETRY,
+};
+
+/// Import the file into a new scene using a manager and importer from the shared pool.
+/// Relative paths are resolved from the program directory. Thread safe: concurrent imports take
+/// different managers. The scene must be returned with ReleaseFBXScene().
+fbxsdk::FbxScene* ImportFBXScene(Urho3D::Context* context, const Urho3D::String& fbxPath,
+    FBXImportProfile profile = FBX_PROFILE_GEOMETRY_MORPHS);
+
+/// Destroy the scene and return its manager to the pool.
+void ReleaseFBXScene(fbxsdk::FbxScene* scene);
+
+/// Destroy all idle managers. Managers of scenes still in use are destroyed on release.
+void ShutdownFBXManagerPool();
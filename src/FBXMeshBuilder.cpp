@@ -0,0 +1,332 @@
+#include "FBXMeshBuilder.h"
+#include "MorphGeometry.h"
+#include "PolygonTriangulation.h"
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Technique.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FBX_STREAMS_SSE2
+#endif
+
+using namespace Urho3D;
+
+const float MODEL_MULTIPLIER = 1.0f;
+const char* MORPH_MATERIAL = "Materials/Morph.xml";
+
+void ConvertDoublesToFloats(const double* src, float* dst, int count)
+{
+    int i = 0;
+#ifdef FBX_STREAMS_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 low = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+        __m128 high = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(low, high));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = (float)src[i];
+}
+
+// Меньшие диапазоны не окупают постановку в очередь
+static const int TRIANGULATION_RANGE_POLYGONS = 4096;
+
+struct TriangulationTask
+{
+    const FBXMeshStreams* streams;
+    const int* polygonStarts;
+    const int* polygonSizes;
+    // Номер первого треугольника каждого полигона
+    const int* triangleOffsets;
+    float scale;
+    MorphVertex* vertices;
+    i32* indices;
+};
+
+struct TriangulationRange
+{
+    const TriangulationTask* task;
+    int first;
+    int last;
+};
+
+static void TriangulateRange(const TriangulationRange& range)
+{
+    const TriangulationTask& task = *range.task;
+    const FBXMeshStreams& streams = *task.streams;
+    Vector<Vector3> corners;
+    Vector<i32> triangles;
+    Vector<i32> remaining;
+
+    for (int polygon = range.first; polygon < range.last; ++polygon)
+    {
+        const int start = task.polygonStarts[polygon];
+        const int size = task.polygonSizes[polygon];
+
+        corners.Resize(size);
+        for (int j = 0; j < size; ++j)
+        {
+            const int polygonVertex = start + j;
+            MorphVertex& vertex = task.vertices[polygonVertex];
+            vertex.position_ = streams.controlPoints[streams.polygonVertices[polygonVertex]] * task.scale;
+            vertex.normal_ = streams.normals ? streams.normals[polygonVertex] : Vector3::UP;
+            vertex.texCoord_ = streams.uvs ? streams.uvs[polygonVertex] : Vector2::ZERO;
+            vertex.tangent_ = streams.tangents ? streams.tangents[polygonVertex] : Vector4(1.0f, 0.0f, 0.0f, 1.0f);
+            corners[j] = vertex.position_;
+        }
+
+        if (size < 3)
+            continue;
+        i32* output = task.indices + task.triangleOffsets[polygon] * 3;
+        if (size == 3)
+        {
+            output[0] = start;
+            output[1] = start + 1;
+            output[2] = start + 2;
+            continue;
+        }
+        triangles.Resize((size - 2) * 3);
+        TriangulatePolygon(corners.Buffer(), size, triangles.Buffer(), remaining);
+        for (i32 i = 0; i < triangles.Size(); ++i)
+            output[i] = start + triangles[i];
+    }
+}
+
+static void TriangulateRangeWork(const WorkItem* item, i32 threadIndex)
+{
+    TriangulateRange(*static_cast<const TriangulationRange*>(item->aux_));
+}
+
+int BuildFBXMeshGeometry(Context* context, const FBXMeshStreams& streams, float scale,
+    ImportArena& arena, Vector<MorphVertex>& vertices, Vector<i32>& indices)
+{
+    const int polygonCount = streams.polygonCount;
+    int* triangleOffsets = arena.Allocate<int>(polygonCount);
+    int triangleCount = 0;
+    int skipped = 0;
+    for (int polygon = 0; polygon < polygonCount; ++polygon)
+    {
+        triangleOffsets[polygon] = triangleCount;
+        if (streams.polygonSizes[polygon] >= 3)
+            triangleCount += streams.polygonSizes[polygon] - 2;
+        else
+            ++skipped;
+    }
+
+    vertices.Resize(streams.polygonVertexCount);
+    indices.Resize(triangleCount * 3);
+
+    TriangulationTask task{ &streams, streams.polygonStarts, streams.polygonSizes, triangleOffsets, scale, vertices.Buffer(), indices.Buffer() };
+    Vector<TriangulationRange> ranges;
+    for (int first = 0; first < polygonCount; first += TRIANGULATION_RANGE_POLYGONS)
+        ranges.Push({ &task, first, Min(first + TRIANGULATION_RANGE_POLYGONS, polygonCount) });
+
+    // Диапазоны пишут в непересекающиеся участки вершин и индексов.
+    // Фоновый импорт (горячая перезагрузка) не может ждать очередь основного потока
+    auto* queue = context->GetSubsystem<WorkQueue>();
+    if (!queue || ranges.Size() < 2 || !Thread::IsMainThread())
+    {
+        for (const TriangulationRange& range : ranges)
+            TriangulateRange(range);
+        return skipped;
+    }
+
+    for (TriangulationRange& range : ranges)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = TriangulateRangeWork;
+        item->aux_ = &range;
+        queue->AddWorkItem(item);
+    }
+    queue->Complete(M_MAX_UNSIGNED);
+    return skipped;
+}
+
+// Ненулевые смещения канала по всем вершинам полигонов, память морфера переиспользуется
+static void FillMorpher(const FBXMeshStreams& streams, const FBXMorphChannel& channel, Morpher& morpher) {
+    i32 count = 0;
+    for (int polygonVertex = 0; polygonVertex < streams.polygonVertexCount; ++polygonVertex) {
+        if (channel.diff[streams.polygonVertices[polygonVertex]] != Vector3::ZERO)
+            ++count;
+    }
+    morpher.name = channel.name;
+    morpher.indexes.Resize(count);
+    morpher.morphDeltas.Resize(count);
+    i32 k = 0;
+    for (int polygonVertex = 0; polygonVertex < streams.polygonVertexCount; ++polygonVertex) {
+        const Vector3& diffV = channel.diff[streams.polygonVertices[polygonVertex]];
+        if (diffV != Vector3::ZERO) {
+            morpher.morphDeltas[k] = diffV;
+            morpher.indexes[k++] = polygonVertex;
+        }
+    }
+}
+
+void BuildFBXMorphMesh(Context* context, const FBXMeshStreams& streams, const Vector<FBXMorphChannel>& channels,
+    MorphMeshData* meshData, const FBXImportOptions& options, const String& meshName, ImportArena& arena) {
+    auto* log = context->GetSubsystem<Log>();
+
+    // Вершина i соответствует вершине полигона i, n-угольники триангулируются
+    Vector<MorphVertex> vertices;
+    Vector<i32> indices;
+    int skipped = BuildFBXMeshGeometry(context, streams, MODEL_MULTIPLIER, arena, vertices, indices);
+    if (skipped)
+        log->Write(LOG_WARNING, String("Skip ") + String(skipped) + " degenerate polygons of " + meshName);
+    meshData->SetVertices(vertices);
+    meshData->SetIndices(indices);
+    // Самый узкий формат вершин, в котором меш не теряет данных
+    meshData->SetVertexLayout(streams.uvs ? MORPH_LAYOUT_FULL : MORPH_LAYOUT_NO_TEXCOORD);
+
+    // Сжатию нужны все каналы сразу. Иначе каналы строятся по одному и при MORPH_RESIDENCY_LAZY
+    // сразу уходят в файл каналов
+    if (!options.compressMorphs) {
+        meshData->BeginChannelFile();
+        Morpher morpher;
+        for (const auto& channel : channels) {
+            FillMorpher(streams, channel, morpher);
+            meshData->AddMorpher(morpher);
+        }
+        return;
+    }
+    Vector<Morpher> morphers(channels.Size());
+    for (int k = 0; k < channels.Size(); ++k)
+        FillMorpher(streams, channels[k], morphers[k]);
+    SetMeshMorphers(context, meshData, morphers, options, meshName);
+}
+
+// Каналы записываются как есть или, если включено, сжимаются в общий базис
+void SetMeshMorphers(Context* context, MorphMeshData* meshData, const Vector<Morpher>& morphers,
+    const FBXImportOptions& options, const String& meshName) {
+    auto* log = context->GetSubsystem<Log>();
+    if (options.compressMorphs) {
+        MorphBasis basis;
+        float error;
+        if (CompressMorphers(morphers, options.compression, basis, error)) {
+            log->Write(LOG_INFO, String("Compress ") + String(morphers.Size()) + String(" morphers to ") +
+                String(basis.shapes.Size()) + String(" basis shapes, ") + String(GetMorphBasisSize(basis)) +
+                String(" bytes, error ") + String(error));
+            meshData->SetMorphBasis(basis);
+            return;
+        }
+        log->Write(LOG_DEBUG, String("Morph basis doesn't reduce size for ") + meshName);
+    }
+    meshData->BeginChannelFile();
+    for (const auto& m : morphers) {
+        meshData->AddMorpher(m);
+    }
+}
+
+// Слияние частей в один буфер. Каналы частей сдвигаются на смещение вершин части
+// и получают префикс "<узел>." чтобы оставаться доступными по отдельности. Части должны
+// держать каналы в памяти (MORPH_RESIDENCY_KEEP_ALL)
+SharedPtr<MorphMeshData> MergeFBXMeshData(Context* context, const Vector<SharedPtr<MorphMeshData>>& parts,
+    const Vector<String>& partNames, const FBXImportOptions& options)
+{
+    auto* log = context->GetSubsystem<Log>();
+    i32 vertexCount = 0;
+    i32 indexCount = 0;
+    i32 morpherCount = 0;
+    for (const SharedPtr<MorphMeshData>& part : parts)
+    {
+        vertexCount += part->GetVertices().Size();
+        indexCount += part->GetIndices().Size();
+        morpherCount += part->GetMorphers().Size();
+    }
+
+    Vector<MorphVertex> vertices;
+    Vector<i32> indices;
+    vertices.Reserve(vertexCount);
+    indices.Reserve(indexCount);
+    String name;
+    // UV нужны слитому мешу, если они есть хотя бы у одной части
+    MorphVertexLayout layout = MORPH_LAYOUT_NO_TEXCOORD;
+    for (i32 i = 0; i < parts.Size(); ++i)
+    {
+        const MorphMeshData* part = parts[i];
+        if (part->GetVertexLayout() == MORPH_LAYOUT_FULL)
+            layout = MORPH_LAYOUT_FULL;
+        const i32 offset = vertices.Size();
+        vertices.Push(part->GetVertices());
+        for (i32 index : part->GetIndices())
+            indices.Push(index + offset);
+        name += (name.Empty() ? "" : "+") + partNames[i];
+    }
+
+    SharedPtr<MorphMeshData> meshData(new MorphMeshData(context));
+    // Слитый меш нельзя перечитать по имени узла
+    if (options.residency == MORPH_RESIDENCY_RELOAD)
+    {
+        log->Write(LOG_WARNING, "Merged mesh " + name + " can't reload morphers, keep them in memory");
+        meshData->SetResidency(MORPH_RESIDENCY_GPU_ONLY);
+    }
+    else
+        meshData->SetResidency(options.residency);
+    meshData->SetVertexLayout(layout);
+    meshData->SetOccluderSettings(options.occluders);
+    meshData->SetVertices(vertices);
+    meshData->SetIndices(indices);
+
+    // Без сжатия каналы частей переносятся по одному, как в BuildFBXMorphMesh()
+    const bool streamed = !options.compressMorphs && meshData->BeginChannelFile();
+    Vector<Morpher> morphers;
+    if (!streamed)
+        morphers.Reserve(morpherCount);
+    Morpher morpher;
+    i32 offset = 0;
+    for (i32 i = 0; i < parts.Size(); ++i)
+    {
+        for (const auto& pair : parts[i]->GetMorphers())
+        {
+            morpher = pair.second_;
+            morpher.name = partNames[i] + "." + morpher.name;
+            for (i32& index : morpher.indexes)
+                index += offset;
+            if (streamed)
+                meshData->AddMorpher(morpher);
+            else
+                morphers.Push(morpher);
+        }
+        offset += parts[i]->GetVertices().Size();
+    }
+    if (!streamed)
+        SetMeshMorphers(context, meshData, morphers, options, name);
+    meshData->SetSource(options.sourceFile, name);
+    log->Write(LOG_INFO, String("Merge ") + String(parts.Size()) + " meshes into " + name);
+    return meshData;
+}
+
+SharedPtr<Node> BuildMorphNode(Context* context, MorphMeshData* meshData, const String& name)
+{
+    auto* log = context->GetSubsystem<Log>();
+    SharedPtr<Node> node(new Node(context));
+
+    auto* morphGeometry = node->CreateComponent<MorphGeometry>();
+    node->SetName(name);
+    morphGeometry->SetMeshData(meshData);
+
+    auto* cache = context->GetSubsystem<ResourceCache>();
+    auto* material = cache->GetResource<Material>(MORPH_MATERIAL);
+    if (material) {
+        Technique* tech = material->GetTechnique(0);
+        Pass* pass = tech->GetPass(0);
+        // Повторная установка сбрасывает уже загруженные варианты шейдеров прохода
+        if (!pass->GetVertexShaderDefines().Contains("MORPH_ENABLED"))
+            pass->SetVertexShaderDefines("MORPH_ENABLED");
+        morphGeometry->SetMaterial(material);
+    }
+
+    morphGeometry->Commit();
+    // Данные могли быть заменены уже зарегистрированными, окклюдер берётся у них
+    morphGeometry->SetOccluder(morphGeometry->GetMeshData()->HasOccluder());
+    log->Write(LOG_INFO, "Success compete BuildUrhoGeometryMorphFromFBXMesh");
+
+    return node;
+}
+
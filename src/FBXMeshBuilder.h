@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector2.h>
+#include <Urho3D/Math/Vector3.h>
+#include <Urho3D/Math/Vector4.h>
+#include <Urho3D/Scene/Node.h>
+#include "MorphMeshData.h"
+#include "ImportArena.h"
+#include "FBXLoader.h"
+
+namespace Urho3D {
+    class Context;
+}
+
+// Сборка мешей из данных FBX без зависимости от FBX SDK: общая часть импорта через SDK и встроенного парсера
+
+extern const float MODEL_MULTIPLIER;
+// Материал всех морф-мешей
+extern const char* MORPH_MATERIAL;
+
+// Атрибуты меша, развёрнутые по вершинам полигонов (в порядке PolygonVertexIndex).
+// Массивы размещены в ImportArena или в данных загрузчика и живут до её Reset(). nullptr означает, что слоя в меше нет
+struct FBXMeshStreams
+{
+    // Позиции контрольных точек
+    Urho3D::Vector3* controlPoints = nullptr;
+    int controlPointCount = 0;
+    // Индексы контрольных точек для каждой вершины полигона
+    const int* polygonVertices = nullptr;
+    int polygonVertexCount = 0;
+    // Первая вершина полигона и количество его вершин
+    const int* polygonStarts = nullptr;
+    const int* polygonSizes = nullptr;
+    int polygonCount = 0;
+    Urho3D::Vector3* normals = nullptr;
+    Urho3D::Vector2* uvs = nullptr;
+    Urho3D::Vector4* tangents = nullptr;
+};
+
+// Канал blend shape: смещения всех контрольных точек, нулевые для неизменных
+struct FBXMorphChannel
+{
+    // Размещены в ImportArena
+    Urho3D::Vector3* diff;
+    Urho3D::String name;
+};
+
+/// Convert count doubles to floats.
+void ConvertDoublesToFloats(const double* src, float* dst, int count);
+
+/// Build one vertex per polygon vertex, so vertex i matches polygon vertex i and morph indexes stay
+/// valid, and triangulate all polygons in parallel on the work queue. Returns the number of polygons
+/// with less than 3 corners that were skipped.
+int BuildFBXMeshGeometry(Urho3D::Context* context, const FBXMeshStreams& streams, float scale,
+    Urho3D::ImportArena& arena, Urho3D::Vector<Urho3D::MorphVertex>& vertices, Urho3D::Vector<i32>& indices);
+
+/// Fill the mesh data with vertices, indices, layout and morphers from the streams and channels.
+void BuildFBXMorphMesh(Urho3D::Context* context, const FBXMeshStreams& streams, const Urho3D::Vector<FBXMorphChannel>& channels,
+    Urho3D::MorphMeshData* meshData, const FBXImportOptions& options, const Urho3D::String& meshName, Urho3D::ImportArena& arena);
+
+/// Add the morphers to the mesh data as they are or, if enabled, compressed into a shared basis.
+void SetMeshMorphers(Urho3D::Context* context, Urho3D::MorphMeshData* meshData, const Urho3D::Vector<Urho3D::Morpher>& morphers,
+    const FBXImportOptions& options, const Urho3D::String& meshName);
+
+/// Merge the parts into one mesh. Part channels are offset by the part vertex offset and get
+/// a "<part name>." prefix, so they stay accessible separately.
+Urho3D::SharedPtr<Urho3D::MorphMeshData> MergeFBXMeshData(Urho3D::Context* context,
+    const Urho3D::Vector<Urho3D::SharedPtr<Urho3D::MorphMeshData>>& parts, const Urho3D::Vector<Urho3D::String>& partNames,
+    const FBXImportOptions& options);
+
+/// Create a node with a committed MorphGeometry showing the mesh data.
+Urho3D::SharedPtr<Urho3D::Node> BuildMorphNode(Urho3D::Context* context, Urho3D::MorphMeshData* meshData, const Urho3D::String& name);
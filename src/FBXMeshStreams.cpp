@@ -0,0 +1,189 @@
+#include "FBXMeshStreams.h"
+#include <fbxsdk.h>
+
+using namespace Urho3D;
+
+// Индекс в прямом массиве слоя для каждой вершины полигона, -1 если значения нет
+template <class T>
+static bool ResolveLayerIndices(FbxLayerElementTemplate<T>* element, const FBXMeshStreams& streams,
+    const int* polygonOfVertex, int* result)
+{
+    const int count = streams.polygonVertexCount;
+
+    switch (element->GetMappingMode())
+    {
+    case FbxLayerElement::eByControlPoint:
+        for (int i = 0; i < count; ++i)
+            result[i] = streams.polygonVertices[i];
+        break;
+    case FbxLayerElement::eByPolygonVertex:
+        for (int i = 0; i < count; ++i)
+            result[i] = i;
+        break;
+    case FbxLayerElement::eByPolygon:
+        for (int i = 0; i < count; ++i)
+            result[i] = polygonOfVertex[i];
+        break;
+    case FbxLayerElement::eAllSame:
+        for (int i = 0; i < count; ++i)
+            result[i] = 0;
+        break;
+    default:
+        return false;
+    }
+
+    FbxLayerElement::EReferenceMode reference = element->GetReferenceMode();
+    if (reference == FbxLayerElement::eIndexToDirect || reference == FbxLayerElement::eIndex)
+    {
+        FbxLayerElementArrayTemplate<int>& indexArray = element->GetIndexArray();
+        const int indexCount = indexArray.GetCount();
+        int* indices = indexArray.GetLocked(FbxLayerElementArray::eReadLock);
+        if (!indices)
+            return false;
+        for (int i = 0; i < count; ++i)
+            result[i] = result[i] >= 0 && result[i] < indexCount ? indices[result[i]] : -1;
+        indexArray.Release(&indices);
+    }
+
+    const int directCount = element->GetDirectArray().GetCount();
+    for (int i = 0; i < count; ++i)
+    {
+        if (result[i] >= directCount)
+            result[i] = -1;
+    }
+    return true;
+}
+
+// Прямой массив слоя целиком переводится во float одним проходом
+template <class T>
+static const float* ReadDirectArray(FbxLayerElementTemplate<T>* element, ImportArena& arena)
+{
+    constexpr int components = sizeof(T) / sizeof(double);
+    FbxLayerElementArrayTemplate<T>& direct = element->GetDirectArray();
+    const int count = direct.GetCount();
+    T* data = direct.GetLocked(FbxLayerElementArray::eReadLock);
+    if (!data)
+        return nullptr;
+    float* values = arena.Allocate<float>(Max(count * components, 1));
+    if (count)
+        ConvertDoublesToFloats(reinterpret_cast<const double*>(data), values, count * components);
+    direct.Release(&data);
+    return values;
+}
+
+template <class T>
+static u64 GetLayerSize(FbxLayerElementTemplate<T>* element, int polygonVertexCount, u64 outputSize)
+{
+    if (!element)
+        return 0;
+    // Индексы, прямой массив во float и результат
+    return (u64)polygonVertexCount * (sizeof(int) + outputSize) +
+        (u64)Max(element->GetDirectArray().GetCount(), 1) * (sizeof(T) / sizeof(double)) * sizeof(float);
+}
+
+u64 GetFBXMeshStreamsSize(FbxMesh* fbxMesh)
+{
+    const int pointCount = fbxMesh->GetControlPointsCount();
+    const int polygonVertexCount = fbxMesh->GetPolygonVertexCount();
+    u64 size = (u64)pointCount * (4 * sizeof(float) + sizeof(Vector3));
+    size += (u64)polygonVertexCount * sizeof(int);
+    size += GetLayerSize(fbxMesh->GetElementNormal(), polygonVertexCount, sizeof(Vector3));
+    size += GetLayerSize(fbxMesh->GetElementUV(), polygonVertexCount, sizeof(Vector2));
+    size += GetLayerSize(fbxMesh->GetElementTangent(), polygonVertexCount, sizeof(Vector4));
+    // Таблицы триангуляции
+    size += (u64)fbxMesh->GetPolygonCount() * 3 * sizeof(int);
+    return size;
+}
+
+void ExtractFBXMeshStreams(FbxMesh* fbxMesh, ImportArena& arena, FBXMeshStreams& streams)
+{
+    static_assert(sizeof(FbxVector4) == 4 * sizeof(double), "FbxVector4 must be tightly packed");
+    static_assert(sizeof(FbxVector2) == 2 * sizeof(double), "FbxVector2 must be tightly packed");
+
+    const int pointCount = fbxMesh->GetControlPointsCount();
+    float* values = arena.Allocate<float>(pointCount * 4);
+    if (pointCount)
+        ConvertDoublesToFloats(reinterpret_cast<const double*>(fbxMesh->GetControlPoints()), values, pointCount * 4);
+    streams.controlPoints = arena.Allocate<Vector3>(pointCount);
+    streams.controlPointCount = pointCount;
+    for (int i = 0; i < pointCount; ++i)
+        streams.controlPoints[i] = Vector3(values[i * 4], values[i * 4 + 1], values[i * 4 + 2]);
+
+    streams.polygonVertices = fbxMesh->GetPolygonVertices();
+    streams.polygonVertexCount = fbxMesh->GetPolygonVertexCount();
+    // Таблицы полигонов SDK читаются один раз, дальше триангуляция обходится без FbxMesh
+    const int polygonCount = fbxMesh->GetPolygonCount();
+    int* polygonStarts = arena.Allocate<int>(polygonCount);
+    int* polygonSizes = arena.Allocate<int>(polygonCount);
+    for (int polygon = 0; polygon < polygonCount; ++polygon)
+    {
+        polygonStarts[polygon] = fbxMesh->GetPolygonVertexIndex(polygon);
+        polygonSizes[polygon] = fbxMesh->GetPolygonSize(polygon);
+    }
+    streams.polygonStarts = polygonStarts;
+    streams.polygonSizes = polygonSizes;
+    streams.polygonCount = polygonCount;
+    streams.normals = nullptr;
+    streams.uvs = nullptr;
+    streams.tangents = nullptr;
+
+    // Номер полигона для каждой вершины нужен только слоям с eByPolygon
+    int* polygonOfVertex = nullptr;
+    auto needPolygons = [](FbxLayerElement* element) {
+        return element && element->GetMappingMode() == FbxLayerElement::eByPolygon;
+    };
+    if (needPolygons(fbxMesh->GetElementNormal()) || needPolygons(fbxMesh->GetElementUV()) ||
+        needPolygons(fbxMesh->GetElementTangent()))
+    {
+        polygonOfVertex = arena.Allocate<int>(streams.polygonVertexCount);
+        for (int polygon = 0; polygon < polygonCount; ++polygon)
+        {
+            for (int j = 0; j < polygonSizes[polygon]; ++j)
+                polygonOfVertex[polygonStarts[polygon] + j] = polygon;
+        }
+    }
+
+    int* indices = arena.Allocate<int>(streams.polygonVertexCount);
+    const float* layer;
+    if (FbxGeometryElementNormal* element = fbxMesh->GetElementNormal())
+    {
+        if (ResolveLayerIndices(element, streams, polygonOfVertex, indices) && (layer = ReadDirectArray(element, arena)))
+        {
+            streams.normals = arena.Allocate<Vector3>(streams.polygonVertexCount);
+            for (int i = 0; i < streams.polygonVertexCount; ++i)
+            {
+                const int index = indices[i];
+                streams.normals[i] = index >= 0 ?
+                    Vector3(layer[index * 4], layer[index * 4 + 1], layer[index * 4 + 2]) : Vector3::UP;
+            }
+        }
+    }
+
+    if (FbxGeometryElementUV* element = fbxMesh->GetElementUV())
+    {
+        if (ResolveLayerIndices(element, streams, polygonOfVertex, indices) && (layer = ReadDirectArray(element, arena)))
+        {
+            streams.uvs = arena.Allocate<Vector2>(streams.polygonVertexCount);
+            for (int i = 0; i < streams.polygonVertexCount; ++i)
+            {
+                const int index = indices[i];
+                streams.uvs[i] = index >= 0 ? Vector2(layer[index * 2], 1.0f - layer[index * 2 + 1]) : Vector2::ZERO;
+            }
+        }
+    }
+
+    if (FbxGeometryElementTangent* element = fbxMesh->GetElementTangent())
+    {
+        if (ResolveLayerIndices(element, streams, polygonOfVertex, indices) && (layer = ReadDirectArray(element, arena)))
+        {
+            streams.tangents = arena.Allocate<Vector4>(streams.polygonVertexCount);
+            for (int i = 0; i < streams.polygonVertexCount; ++i)
+            {
+                const int index = indices[i];
+                streams.tangents[i] = index >= 0 ?
+                    Vector4(layer[index * 4], layer[index * 4 + 1], layer[index * 4 + 2], layer[index * 4 + 3] < 0.0f ? -1.0f : 1.0f) :
+                    Vector4(1.0f, 0.0f, 0.0f, 1.0f);
+            }
+        }
+    }
+}
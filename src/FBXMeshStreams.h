@@ -0,0 +1,15 @@
+#pragma once
+
+#include "FBXMeshBuilder.h"
+
+namespace fbxsdk {
+    class FbxMesh;
+}
+
+/// Return the arena bytes ExtractFBXMeshStreams and BuildFBXMeshGeometry need for the mesh.
+u64 GetFBXMeshStreamsSize(fbxsdk::FbxMesh* fbxMesh);
+
+/// Read the polygon tables and the normal, first UV and tangent layer elements of the mesh once,
+/// resolve their mapping and reference modes for every polygon vertex and convert them to float.
+/// Replaces per-vertex GetPolygonVertexNormal / GetPolygonVertexUV queries.
+void ExtractFBXMeshStreams(fbxsdk::FbxMesh* fbxMesh, Urho3D::ImportArena& arena, FBXMeshStreams& streams);
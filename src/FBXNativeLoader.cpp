@@ -0,0 +1,766 @@
+#include "FBXNativeLoader.h"
+#include "FBXBinaryReader.h"
+#include "FBXMeshBuilder.h"
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Urho3D;
+
+enum NativeObjectKind
+{
+    NATIVE_MODEL,
+    NATIVE_MESH,
+    NATIVE_SHAPE,
+    NATIVE_BLEND_SHAPE,
+    NATIVE_CHANNEL,
+};
+
+struct NativeObject
+{
+    i64 id;
+    NativeObjectKind kind;
+    i32 record;
+    String name;
+    // Подключённые объекты в порядке записей Connections
+    Vector<i32> children;
+};
+
+// Объекты сцены, нужные загрузчику, и связи между ними
+struct NativeScene
+{
+    FBXMappedFile file;
+    FBXBinaryDocument document;
+    // Отсортированы по id
+    Vector<NativeObject> objects;
+    // Модели, подключённые к корню сцены
+    Vector<i32> roots;
+
+    i32 FindObject(i64 id) const
+    {
+        auto it = std::lower_bound(objects.Begin(), objects.End(), id,
+            [](const NativeObject& object, i64 value) { return object.id < value; });
+        return it != objects.End() && it->id == id ? (i32)(it - objects.Begin()) : -1;
+    }
+
+    // Первый подключённый объект вида, -1 если его нет
+    i32 FindChild(i32 object, NativeObjectKind kind) const
+    {
+        for (i32 child : objects[object].children)
+        {
+            if (objects[child].kind == kind)
+                return child;
+        }
+        return -1;
+    }
+
+    Vector<i32> GetChildModels(i32 object) const
+    {
+        if (object < 0)
+            return roots;
+        Vector<i32> models;
+        for (i32 child : objects[object].children)
+        {
+            if (objects[child].kind == NATIVE_MODEL)
+                models.Push(child);
+        }
+        return models;
+    }
+};
+
+// Массив свойства, переводимый во float или int. Одна задача очереди на массив
+struct NativeArrayTask
+{
+    const FBXProperty* property;
+    bool floats;
+    void* output;
+    // Выровненная копия для массивов другого типа, nullptr если не нужна
+    void* scratch;
+    bool success;
+};
+
+struct NativeLayer
+{
+    const FBXProperty* direct = nullptr;
+    const FBXProperty* index = nullptr;
+    const FBXProperty* mapping = nullptr;
+    const FBXProperty* reference = nullptr;
+    const float* directValues = nullptr;
+    const int* indexValues = nullptr;
+};
+
+struct NativeChannel
+{
+    String name;
+    const FBXProperty* indexes = nullptr;
+    const FBXProperty* vertices = nullptr;
+    const int* indexValues = nullptr;
+    const float* vertexValues = nullptr;
+};
+
+// Меньшие массивы не окупают постановку в очередь
+static const u32 NATIVE_PARALLEL_MIN_BYTES = 64 * 1024;
+
+static bool LoadNativeScene(const String& path, NativeScene& scene, String& error)
+{
+    if (!scene.file.Open(path))
+    {
+        error = "Can't map " + path;
+        return false;
+    }
+    if (!scene.document.Parse(scene.file.GetData(), scene.file.GetSize(), error))
+        return false;
+
+    const FBXBinaryDocument& document = scene.document;
+    const i32 objectsRecord = document.FindChild(-1, "Objects");
+    const i32 connectionsRecord = document.FindChild(-1, "Connections");
+    if (objectsRecord < 0 || connectionsRecord < 0)
+    {
+        error = "File has no objects";
+        return false;
+    }
+
+    for (i32 child = document.GetRecord(objectsRecord).firstChild; child >= 0; child = document.GetRecord(child).nextSibling)
+    {
+        const FBXRecord& record = document.GetRecord(child);
+        if (record.numProperties < 3)
+            continue;
+        const FBXProperty& subclass = document.GetProperty(record, 2);
+        NativeObjectKind kind;
+        if (record.Is("Model"))
+            kind = NATIVE_MODEL;
+        else if (record.Is("Geometry") && subclass.Equals("Mesh"))
+            kind = NATIVE_MESH;
+        else if (record.Is("Geometry") && subclass.Equals("Shape"))
+            kind = NATIVE_SHAPE;
+        else if (record.Is("Deformer") && subclass.Equals("BlendShape"))
+            kind = NATIVE_BLEND_SHAPE;
+        else if (record.Is("Deformer") && subclass.Equals("BlendShapeChannel"))
+            kind = NATIVE_CHANNEL;
+        else
+            continue;
+        scene.objects.Push({ document.GetProperty(record, 0).GetInt(), kind, child,
+            GetFBXObjectName(document.GetProperty(record, 1)), Vector<i32>() });
+    }
+    std::sort(scene.objects.Begin(), scene.objects.End(),
+        [](const NativeObject& a, const NativeObject& b) { return a.id < b.id; });
+
+    for (i32 child = document.GetRecord(connectionsRecord).firstChild; child >= 0; child = document.GetRecord(child).nextSibling)
+    {
+        const FBXRecord& record = document.GetRecord(child);
+        if (!record.Is("C") || record.numProperties < 3 || !document.GetProperty(record, 0).Equals("OO"))
+            continue;
+        const i32 object = scene.FindObject(document.GetProperty(record, 1).GetInt());
+        if (object < 0)
+            continue;
+        const i64 parentId = document.GetProperty(record, 2).GetInt();
+        if (parentId == 0)
+        {
+            if (scene.objects[object].kind == NATIVE_MODEL)
+                scene.roots.Push(object);
+            continue;
+        }
+        const i32 parent = scene.FindObject(parentId);
+        if (parent >= 0)
+            scene.objects[parent].children.Push(object);
+    }
+    return true;
+}
+
+static const FBXProperty* FindArray(const FBXBinaryDocument& document, i32 record, const char* name)
+{
+    const i32 child = document.FindChild(record, name);
+    if (child < 0 || document.GetRecord(child).numProperties < 1)
+        return nullptr;
+    const FBXProperty& property = document.GetProperty(document.GetRecord(child), 0);
+    return property.IsArray() ? &property : nullptr;
+}
+
+static const FBXProperty* FindString(const FBXBinaryDocument& document, i32 record, const char* name)
+{
+    const i32 child = document.FindChild(record, name);
+    if (child < 0 || document.GetRecord(child).numProperties < 1)
+        return nullptr;
+    const FBXProperty& property = document.GetProperty(document.GetRecord(child), 0);
+    return property.type == 'S' ? &property : nullptr;
+}
+
+// Первый слой элемента, как GetElementNormal() / GetElementUV() в SDK
+static NativeLayer FindLayer(const FBXBinaryDocument& document, i32 geometry, const char* element, const char* direct, const char* index)
+{
+    NativeLayer layer;
+    const i32 record = document.FindChild(geometry, element);
+    if (record < 0)
+        return layer;
+    layer.direct = FindArray(document, record, direct);
+    layer.index = FindArray(document, record, index);
+    layer.mapping = FindString(document, record, "MappingInformationType");
+    layer.reference = FindString(document, record, "ReferenceInformationType");
+    return layer;
+}
+
+static void DecodeArrayTask(NativeArrayTask& task)
+{
+    const FBXProperty& property = *task.property;
+    const char targetType = task.floats ? 'f' : 'i';
+    if (property.type == targetType)
+    {
+        task.success = DecodeFBXArray(property, task.output);
+        return;
+    }
+
+    const unsigned char* source = property.data;
+    if (task.scratch)
+    {
+        if (!DecodeFBXArray(property, task.scratch))
+        {
+            task.success = false;
+            return;
+        }
+        source = static_cast<const unsigned char*>(task.scratch);
+    }
+    const i32 count = (i32)property.arrayLength;
+    if (task.floats && property.type == 'd')
+        ConvertDoublesToFloats(reinterpret_cast<const double*>(source), static_cast<float*>(task.output), count);
+    else if (!task.floats && property.type == 'l')
+    {
+        const i64* values = reinterpret_cast<const i64*>(source);
+        int* output = static_cast<int*>(task.output);
+        for (i32 i = 0; i < count; ++i)
+            output[i] = (int)values[i];
+    }
+    else
+    {
+        task.success = false;
+        return;
+    }
+    task.success = true;
+}
+
+static void DecodeArrayWork(const WorkItem* item, i32 threadIndex)
+{
+    DecodeArrayTask(*static_cast<NativeArrayTask*>(item->aux_));
+}
+
+// Место под массив в арене. Массивы другого типа, сжатые или невыровненные в файле, сначала копируются
+static void* AddArrayTask(Vector<NativeArrayTask>& tasks, ImportArena& arena, const FBXProperty* property, bool floats)
+{
+    if (!property)
+        return nullptr;
+    const i32 count = (i32)property->arrayLength;
+    void* output = floats ? (void*)arena.Allocate<float>(Max(count, 1)) : (void*)arena.Allocate<int>(Max(count, 1));
+    void* scratch = nullptr;
+    const u32 elementSize = GetFBXArrayElementSize(property->type);
+    if (property->type != (floats ? 'f' : 'i') &&
+        (property->encoding != 0 || (uintptr_t)property->data % elementSize != 0))
+        scratch = arena.Allocate((u64)Max(count, 1) * elementSize, elementSize);
+    tasks.Push({ property, floats, output, scratch, false });
+    return output;
+}
+
+static u64 GetArrayTaskSize(const FBXProperty* property)
+{
+    if (!property)
+        return 0;
+    // Результат и, в худшем случае, копия исходных данных
+    return (u64)property->arrayLength * (4 + GetFBXArrayElementSize(property->type)) + 16;
+}
+
+static bool DecodeArrays(Context* context, Vector<NativeArrayTask>& tasks)
+{
+    // Фоновый импорт (горячая перезагрузка) не может ждать очередь основного потока
+    auto* queue = context->GetSubsystem<WorkQueue>();
+    u64 totalSize = 0;
+    for (const NativeArrayTask& task : tasks)
+        totalSize += task.property->size;
+    if (!queue || tasks.Size() < 2 || totalSize < NATIVE_PARALLEL_MIN_BYTES || !Thread::IsMainThread())
+    {
+        for (NativeArrayTask& task : tasks)
+            DecodeArrayTask(task);
+    }
+    else
+    {
+        for (NativeArrayTask& task : tasks)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = DecodeArrayWork;
+            item->aux_ = &task;
+            queue->AddWorkItem(item);
+        }
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+
+    for (const NativeArrayTask& task : tasks)
+    {
+        if (!task.success)
+            return false;
+    }
+    return true;
+}
+
+// Индекс в прямом массиве слоя для каждой вершины полигона, -1 если значения нет
+static bool ResolveLayerIndices(const NativeLayer& layer, i32 components, const FBXMeshStreams& streams,
+    const int* polygonOfVertex, int* result)
+{
+    if (!layer.directValues || !layer.mapping)
+        return false;
+    const int count = streams.polygonVertexCount;
+
+    if (layer.mapping->Equals("ByVertice") || layer.mapping->Equals("ByVertex") || layer.mapping->Equals("ByControlPoint"))
+    {
+        for (int i = 0; i < count; ++i)
+            result[i] = streams.polygonVertices[i];
+    }
+    else if (layer.mapping->Equals("ByPolygonVertex"))
+    {
+        for (int i = 0; i < count; ++i)
+            result[i] = i;
+    }
+    else if (layer.mapping->Equals("ByPolygon"))
+    {
+        for (int i = 0; i < count; ++i)
+            result[i] = polygonOfVertex[i];
+    }
+    else if (layer.mapping->Equals("AllSame"))
+    {
+        for (int i = 0; i < count; ++i)
+            result[i] = 0;
+    }
+    else
+        return false;
+
+    if (layer.reference && (layer.reference->Equals("IndexToDirect") || layer.reference->Equals("Index")))
+    {
+        if (!layer.indexValues)
+            return false;
+        const int indexCount = (int)layer.index->arrayLength;
+        for (int i = 0; i < count; ++i)
+            result[i] = result[i] >= 0 && result[i] < indexCount ? layer.indexValues[result[i]] : -1;
+    }
+
+    const int directCount = (int)layer.direct->arrayLength / components;
+    for (int i = 0; i < count; ++i)
+    {
+        if (result[i] >= directCount)
+            result[i] = -1;
+    }
+    return true;
+}
+
+static bool NeedsPolygons(const NativeLayer& layer)
+{
+    return layer.directValues && layer.mapping && layer.mapping->Equals("ByPolygon");
+}
+
+// Данные меша модели без узла и буферов, nullptr если геометрию не удалось прочитать
+static SharedPtr<MorphMeshData> LoadNativeMeshData(Context* context, const NativeScene& scene, i32 model,
+    const FBXImportOptions& options)
+{
+    auto* log = context->GetSubsystem<Log>();
+    const FBXBinaryDocument& document = scene.document;
+    const i32 mesh = scene.FindChild(model, NATIVE_MESH);
+    const NativeObject& meshObject = scene.objects[mesh];
+    const i32 geometry = meshObject.record;
+
+    const FBXProperty* positions = FindArray(document, geometry, "Vertices");
+    const FBXProperty* polygonIndex = FindArray(document, geometry, "PolygonVertexIndex");
+    if (!positions || !polygonIndex)
+    {
+        log->Write(LOG_ERROR, "Mesh " + meshObject.name + " has no vertices");
+        return SharedPtr<MorphMeshData>();
+    }
+    NativeLayer normals = FindLayer(document, geometry, "LayerElementNormal", "Normals", "NormalsIndex");
+    NativeLayer uvs = FindLayer(document, geometry, "LayerElementUV", "UV", "UVIndex");
+    NativeLayer tangents = FindLayer(document, geometry, "LayerElementTangent", "Tangents", "TangentsIndex");
+
+    // Каналы с целевой формой, только они попадают в морферы
+    Vector<NativeChannel> channels;
+    if (options.profile != FBX_PROFILE_GEOMETRY)
+    {
+        for (i32 blendShape : meshObject.children)
+        {
+            if (scene.objects[blendShape].kind != NATIVE_BLEND_SHAPE)
+                continue;
+            for (i32 channel : scene.objects[blendShape].children)
+            {
+                if (scene.objects[channel].kind != NATIVE_CHANNEL)
+                    continue;
+                const i32 shape = scene.FindChild(channel, NATIVE_SHAPE);
+                if (shape < 0)
+                    continue;
+                NativeChannel nativeChannel;
+                nativeChannel.name = scene.objects[channel].name;
+                nativeChannel.indexes = FindArray(document, scene.objects[shape].record, "Indexes");
+                nativeChannel.vertices = FindArray(document, scene.objects[shape].record, "Vertices");
+                if (nativeChannel.indexes && nativeChannel.vertices)
+                    channels.Push(nativeChannel);
+            }
+        }
+    }
+
+    // Временные данные предыдущего меша больше не нужны
+    ImportArena localArena;
+    ImportArena& arena = options.arena ? *options.arena : localArena;
+    arena.Reset();
+    u64 decodeSize = GetArrayTaskSize(positions) + GetArrayTaskSize(polygonIndex);
+    for (const NativeLayer* layer : { &normals, &uvs, &tangents })
+        decodeSize += GetArrayTaskSize(layer->direct) + GetArrayTaskSize(layer->index);
+    for (const NativeChannel& channel : channels)
+        decodeSize += GetArrayTaskSize(channel.indexes) + GetArrayTaskSize(channel.vertices);
+    arena.Reserve(decodeSize);
+
+    // Все массивы меша распаковываются одновременно, каждый в свой участок арены
+    Vector<NativeArrayTask> tasks;
+    tasks.Reserve(5 + 6 + channels.Size() * 2);
+    float* positionValues = static_cast<float*>(AddArrayTask(tasks, arena, positions, true));
+    int* polygonVertices = static_cast<int*>(AddArrayTask(tasks, arena, polygonIndex, false));
+    for (NativeLayer* layer : { &normals, &uvs, &tangents })
+    {
+        layer->directValues = static_cast<const float*>(AddArrayTask(tasks, arena, layer->direct, true));
+        layer->indexValues = static_cast<const int*>(AddArrayTask(tasks, arena, layer->index, false));
+    }
+    for (NativeChannel& channel : channels)
+    {
+        channel.indexValues = static_cast<const int*>(AddArrayTask(tasks, arena, channel.indexes, false));
+        channel.vertexValues = static_cast<const float*>(AddArrayTask(tasks, arena, channel.vertices, true));
+    }
+    if (!DecodeArrays(context, tasks))
+    {
+        log->Write(LOG_ERROR, "Can't decode arrays of mesh " + meshObject.name);
+        return SharedPtr<MorphMeshData>();
+    }
+
+    FBXMeshStreams streams;
+    static_assert(sizeof(Vector3) == 3 * sizeof(float), "Vector3 must be tightly packed");
+    streams.controlPoints = reinterpret_cast<Vector3*>(positionValues);
+    streams.controlPointCount = (int)positions->arrayLength / 3;
+    streams.polygonVertexCount = (int)polygonIndex->arrayLength;
+
+    // Отрицательный индекс (~index) закрывает полигон
+    int polygonCount = 0;
+    for (int i = 0; i < streams.polygonVertexCount; ++i)
+    {
+        if (polygonVertices[i] < 0)
+            ++polygonCount;
+    }
+    arena.Reserve((u64)polygonCount * 3 * sizeof(int) + (u64)streams.polygonVertexCount * (2 * sizeof(int) +
+        sizeof(Vector3) + sizeof(Vector2) + sizeof(Vector4)) + (u64)channels.Size() * streams.controlPointCount * sizeof(Vector3));
+    int* polygonStarts = arena.Allocate<int>(polygonCount);
+    int* polygonSizes = arena.Allocate<int>(polygonCount);
+    int polygon = 0;
+    int start = 0;
+    for (int i = 0; i < streams.polygonVertexCount; ++i)
+    {
+        if (polygonVertices[i] < 0)
+        {
+            polygonVertices[i] = ~polygonVertices[i];
+            polygonStarts[polygon] = start;
+            polygonSizes[polygon] = i + 1 - start;
+            ++polygon;
+            start = i + 1;
+        }
+        if (polygonVertices[i] >= streams.controlPointCount)
+        {
+            log->Write(LOG_ERROR, "Mesh " + meshObject.name + " has wrong polygon vertex index");
+            return SharedPtr<MorphMeshData>();
+        }
+    }
+    // Вершины после последнего закрытого полигона не входят ни в один полигон
+    streams.polygonVertices = polygonVertices;
+    streams.polygonVertexCount = start;
+    streams.polygonStarts = polygonStarts;
+    streams.polygonSizes = polygonSizes;
+    streams.polygonCount = polygonCount;
+
+    // Номер полигона для каждой вершины нужен только слоям с ByPolygon
+    int* polygonOfVertex = nullptr;
+    if (NeedsPolygons(normals) || NeedsPolygons(uvs) || NeedsPolygons(tangents))
+    {
+        polygonOfVertex = arena.Allocate<int>(streams.polygonVertexCount);
+        for (polygon = 0; polygon < polygonCount; ++polygon)
+        {
+            for (int j = 0; j < polygonSizes[polygon]; ++j)
+                polygonOfVertex[polygonStarts[polygon] + j] = polygon;
+        }
+    }
+
+    int* indices = arena.Allocate<int>(streams.polygonVertexCount);
+    if (ResolveLayerIndices(normals, 3, streams, polygonOfVertex, indices))
+    {
+        const float* layer = normals.directValues;
+        streams.normals = arena.Allocate<Vector3>(streams.polygonVertexCount);
+        for (int i = 0; i < streams.polygonVertexCount; ++i)
+        {
+            const int index = indices[i];
+            streams.normals[i] = index >= 0 ?
+                Vector3(layer[index * 3], layer[index * 3 + 1], layer[index * 3 + 2]) : Vector3::UP;
+        }
+    }
+    if (ResolveLayerIndices(uvs, 2, streams, polygonOfVertex, indices))
+    {
+        const float* layer = uvs.directValues;
+        streams.uvs = arena.Allocate<Vector2>(streams.polygonVertexCount);
+        for (int i = 0; i < streams.polygonVertexCount; ++i)
+        {
+            const int index = indices[i];
+            streams.uvs[i] = index >= 0 ? Vector2(layer[index * 2], 1.0f - layer[index * 2 + 1]) : Vector2::ZERO;
+        }
+    }
+    // В файле касательные трёхкомпонентные, направление бинормали не хранится
+    if (ResolveLayerIndices(tangents, 3, streams, polygonOfVertex, indices))
+    {
+        const float* layer = tangents.directValues;
+        streams.tangents = arena.Allocate<Vector4>(streams.polygonVertexCount);
+        for (int i = 0; i < streams.polygonVertexCount; ++i)
+        {
+            const int index = indices[i];
+            streams.tangents[i] = index >= 0 ?
+                Vector4(layer[index * 3], layer[index * 3 + 1], layer[index * 3 + 2], 1.0f) : Vector4(1.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    // В Shape хранятся смещения выбранных контрольных точек
+    Vector<FBXMorphChannel> morphChannels;
+    morphChannels.Reserve(channels.Size());
+    for (const NativeChannel& channel : channels)
+    {
+        FBXMorphChannel morph{ arena.AllocateZeroed<Vector3>(streams.controlPointCount), channel.name };
+        const int count = Min((int)channel.indexes->arrayLength, (int)channel.vertices->arrayLength / 3);
+        for (int i = 0; i < count; ++i)
+        {
+            const int index = channel.indexValues[i];
+            if (index >= 0 && index < streams.controlPointCount)
+                morph.diff[index] = Vector3(channel.vertexValues[i * 3], channel.vertexValues[i * 3 + 1], channel.vertexValues[i * 3 + 2]);
+        }
+        morphChannels.Push(morph);
+    }
+
+    SharedPtr<MorphMeshData> meshData(new MorphMeshData(context));
+    meshData->SetResidency(options.residency);
+    meshData->SetOccluderSettings(options.occluders);
+    BuildFBXMorphMesh(context, streams, morphChannels, meshData, options, meshObject.name, arena);
+    meshData->SetSource(options.sourceFile, scene.objects[model].name);
+    return meshData;
+}
+
+// Локальное преобразование модели как есть из Properties70. Равные значения дают равные матрицы
+static Vector<double> GetTransformKey(const FBXBinaryDocument& document, i32 model)
+{
+    static const char* names[] = { "Lcl Translation", "Lcl Rotation", "Lcl Scaling", "PreRotation", "PostRotation",
+        "RotationOffset", "RotationPivot", "ScalingOffset", "ScalingPivot" };
+    const i32 count = sizeof(names) / sizeof(names[0]);
+    Vector<double> key(count * 3 + 1, 0.0);
+    // Масштаб по умолчанию единичный
+    key[2 * 3] = key[2 * 3 + 1] = key[2 * 3 + 2] = 1.0;
+
+    const i32 properties = document.FindChild(model, "Properties70");
+    for (i32 child = properties >= 0 ? document.GetRecord(properties).firstChild : -1; child >= 0;
+        child = document.GetRecord(child).nextSibling)
+    {
+        const FBXRecord& record = document.GetRecord(child);
+        if (!record.Is("P") || record.numProperties < 5)
+            continue;
+        const FBXProperty& name = document.GetProperty(record, 0);
+        if (name.Equals("RotationOrder"))
+        {
+            key[count * 3] = document.GetProperty(record, 4).GetDouble();
+            continue;
+        }
+        if (record.numProperties < 7)
+            continue;
+        for (i32 i = 0; i < count; ++i)
+        {
+            if (!name.Equals(names[i]))
+                continue;
+            for (i32 j = 0; j < 3; ++j)
+                key[i * 3 + j] = document.GetProperty(record, 4 + j).GetDouble();
+            break;
+        }
+    }
+    return key;
+}
+
+// Дочерние меши модели, которые можно слить, как GroupSiblingMeshes в загрузке через SDK
+static Vector<Vector<i32>> GroupSiblingMeshes(const NativeScene& scene, i32 object)
+{
+    Vector<Vector<i32>> groups;
+    Vector<Vector<double>> transforms;
+    for (i32 child : scene.GetChildModels(object))
+    {
+        if (scene.FindChild(child, NATIVE_MESH) < 0)
+            continue;
+        Vector<double> transform = GetTransformKey(scene.document, scene.objects[child].record);
+        i32 group = 0;
+        while (group < transforms.Size() && transforms[group] != transform)
+            ++group;
+        if (group == transforms.Size())
+        {
+            transforms.Push(transform);
+            groups.Resize(groups.Size() + 1);
+        }
+        groups[group].Push(child);
+    }
+    return groups;
+}
+
+static SharedPtr<MorphMeshData> LoadNativeMergedMeshData(Context* context, const NativeScene& scene, const Vector<i32>& group,
+    const FBXImportOptions& options)
+{
+    // Сжатие применяется к общему набору морферов, а не к частям
+    FBXImportOptions partOptions = options;
+    partOptions.compressMorphs = false;
+    // Каналы частей нужны в памяти до слияния
+    partOptions.residency = MORPH_RESIDENCY_KEEP_ALL;
+
+    Vector<SharedPtr<MorphMeshData>> parts;
+    Vector<String> partNames;
+    for (i32 model : group)
+    {
+        SharedPtr<MorphMeshData> part = LoadNativeMeshData(context, scene, model, partOptions);
+        if (!part)
+            continue;
+        parts.Push(part);
+        partNames.Push(scene.objects[model].name);
+    }
+    return parts.Empty() ? SharedPtr<MorphMeshData>() : MergeFBXMeshData(context, parts, partNames, options);
+}
+
+// Сливаемые группы дочерних мешей, части групп запоминаются в merged
+static Vector<SharedPtr<MorphMeshData>> LoadNativeMergedGroups(Context* context, const NativeScene& scene, i32 object,
+    const FBXImportOptions& options, Vector<i32>& merged)
+{
+    Vector<SharedPtr<MorphMeshData>> result;
+    if (!options.mergeStaticMeshes)
+        return result;
+    for (const Vector<i32>& group : GroupSiblingMeshes(scene, object))
+    {
+        if (group.Size() < 2)
+            continue;
+        SharedPtr<MorphMeshData> meshData = LoadNativeMergedMeshData(context, scene, group, options);
+        if (meshData)
+            result.Push(meshData);
+        merged.Push(group);
+    }
+    return result;
+}
+
+static void LoadNativeNodeRecursive(Context* context, const NativeScene& scene, Node* parentNode, i32 object,
+    const FBXImportOptions& options, bool meshMerged = false)
+{
+    // Корень сцены в SDK называется RootNode
+    Node* node = parentNode->CreateChild(object < 0 ? String("RootNode") : scene.objects[object].name);
+
+    if (object >= 0 && !meshMerged)
+    {
+        const i32 mesh = scene.FindChild(object, NATIVE_MESH);
+        SharedPtr<MorphMeshData> meshData = mesh >= 0 ? LoadNativeMeshData(context, scene, object, options) : SharedPtr<MorphMeshData>();
+        if (meshData)
+            node->AddChild(BuildMorphNode(context, meshData, scene.objects[mesh].name));
+    }
+
+    Vector<i32> merged;
+    for (const SharedPtr<MorphMeshData>& meshData : LoadNativeMergedGroups(context, scene, object, options, merged))
+        node->AddChild(BuildMorphNode(context, meshData, meshData->GetSourceMesh()));
+
+    for (i32 child : scene.GetChildModels(object))
+        LoadNativeNodeRecursive(context, scene, node, child, options, merged.Contains(child));
+}
+
+static void LoadNativeMeshDataRecursive(Context* context, const NativeScene& scene, i32 object,
+    const FBXImportOptions& options, Vector<SharedPtr<MorphMeshData>>& meshes, bool meshMerged = false)
+{
+    if (object >= 0 && !meshMerged && scene.FindChild(object, NATIVE_MESH) >= 0)
+    {
+        SharedPtr<MorphMeshData> meshData = LoadNativeMeshData(context, scene, object, options);
+        if (meshData)
+        {
+            meshData->CalculateHash();
+            meshes.Push(meshData);
+        }
+    }
+
+    // Слияние как в LoadNativeNodeRecursive, чтобы имена совпали при горячей перезагрузке
+    Vector<i32> merged;
+    for (const SharedPtr<MorphMeshData>& meshData : LoadNativeMergedGroups(context, scene, object, options, merged))
+    {
+        meshData->CalculateHash();
+        meshes.Push(meshData);
+    }
+
+    for (i32 child : scene.GetChildModels(object))
+        LoadNativeMeshDataRecursive(context, scene, child, options, meshes, merged.Contains(child));
+}
+
+static bool OpenNativeScene(Context* context, const String& fbxPath, NativeScene& scene)
+{
+    auto* log = context->GetSubsystem<Log>();
+    // Относительные пути задаются от каталога программы, как в ImportFBXScene
+    String path = IsAbsolutePath(fbxPath) ? fbxPath : context->GetSubsystem<FileSystem>()->GetProgramDir() + fbxPath;
+    String error;
+    if (!LoadNativeScene(path, scene, error))
+    {
+        log->Write(LOG_DEBUG, "Native FBX parser can't load " + fbxPath + ": " + error);
+        return false;
+    }
+    log->Write(LOG_INFO, String("Parse fbx file version ") + String(scene.document.GetVersion()) + " with " +
+        String(scene.objects.Size()) + " objects");
+    return true;
+}
+
+bool LoadFBXMeshesNative(Context* context, const String& fbxPath, const FBXImportOptions& options,
+    Vector<SharedPtr<MorphMeshData>>& meshes, const String& onlyNode)
+{
+    NativeScene scene;
+    if (!OpenNativeScene(context, fbxPath, scene))
+        return false;
+
+    ImportArena arena;
+    FBXImportOptions sourceOptions = options;
+    sourceOptions.sourceFile = fbxPath;
+    sourceOptions.arena = &arena;
+    if (onlyNode.Empty())
+    {
+        LoadNativeMeshDataRecursive(context, scene, -1, sourceOptions, meshes);
+        return true;
+    }
+
+    for (i32 object = 0; object < scene.objects.Size(); ++object)
+    {
+        if (scene.objects[object].kind != NATIVE_MODEL || scene.objects[object].name != onlyNode ||
+            scene.FindChild(object, NATIVE_MESH) < 0)
+            continue;
+        SharedPtr<MorphMeshData> meshData = LoadNativeMeshData(context, scene, object, sourceOptions);
+        if (meshData)
+            meshes.Push(meshData);
+    }
+    return true;
+}
+
+SharedPtr<Node> LoadFBXToNodeNative(Context* context, const String& fbxPath, const FBXImportOptions& options)
+{
+    NativeScene scene;
+    if (!OpenNativeScene(context, fbxPath, scene))
+        return SharedPtr<Node>();
+
+    SharedPtr<Node> node(new Node(context));
+    node->SetName("FBXImpoted");
+
+    // Одна арена на весь импорт, сбрасывается перед каждым мешем
+    ImportArena arena;
+    FBXImportOptions sourceOptions = options;
+    sourceOptions.sourceFile = fbxPath;
+    sourceOptions.arena = &arena;
+
+    SharedPtr<Node> resultMorhp = SharedPtr<Node>(node->CreateChild("Morph"));
+    LoadNativeNodeRecursive(context, scene, resultMorhp, -1, sourceOptions);
+    resultMorhp->SetPosition(Vector3(0, 0, 0));
+    context->GetSubsystem<Log>()->Write(LOG_INFO, String("Import arena: ") + String(arena.GetNumAllocations()) +
+        " allocations, " + String(arena.GetNumHeapAllocations()) + " heap allocations, peak " + String(arena.GetPeakBytes()) + " bytes");
+    return node;
+}
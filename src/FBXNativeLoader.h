@@ -0,0 +1,20 @@
+#pragma once
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Scene/Node.h>
+#include "FBXLoader.h"
+
+// Загрузка геометрии и blend shape из бинарного FBX 7.x без FBX SDK. Результат совпадает
+// с загрузкой через SDK: те же имена узлов, вершина на каждую вершину полигона и те же морферы
+
+/// Import the meshes of a binary FBX file like LoadFBXMeshes. When onlyNode isn't empty only meshes
+/// of the nodes with that name are loaded, without merging. Returns false if the file can't be parsed,
+/// for example an ASCII FBX.
+bool LoadFBXMeshesNative(Urho3D::Context* context, const Urho3D::String& path, const FBXImportOptions& options,
+    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::MorphMeshData>>& meshes, const Urho3D::String& onlyNode = Urho3D::String::EMPTY);
+
+/// Import a binary FBX file into the same node structure as LoadFBXToNode. Returns null if the file can't be parsed.
+Urho3D::SharedPtr<Urho3D::Node> LoadFBXToNodeNative(Urho3D::Context* context, const Urho3D::String& path,
+    const FBXImportOptions& options);
@@ -1,14 +1,21 @@
+#ifdef _WIN32
 #define INITGUID
 
 #include <dxgi.h>
 #include <d3d11.h>
 #include <d3d11shader.h>
 #include <d3dcompiler.h>
+#endif
 
 #include "FBXViewerApp.h"
 #include "FBXLoader.h"
 #include "SceneUtils.h"
 #include "MorphGeometry.h"
+#include "ShaderWarmup.h"
+#include "MorphWeightReceiver.h"
+#include "FBXHotReload.h"
+#include "FBXBenchmark.h"
+#include "AllocationCounter.h"
 #include <Urho3D/UI/UI.h>
 #include <Urho3D/UI/Font.h>
 #include <Urho3D/UI/Text.h>
@@ -20,6 +27,7 @@
 #include <Urho3D/Engine/Engine.h>
 #include <Urho3D/Engine/Application.h>
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/Graphics/Graphics.h>
 #include <Urho3D/Graphics/CustomGeometry.h>
 #include <Urho3D/Graphics/StaticModel.h>
@@ -48,14 +56,53 @@ void FBXViewerApp::Setup() {
     engineParameters_["LogName"] = "run.log";
     engineParameters_["LogLe.vel"] = LOG_DEBUG;
     engineParameters_["WindowResizable"] = true;
+    // Настройки импорта по умолчанию выключены: -merge сливает статичные меши, -lazy оставляет на CPU
+    // только используемые каналы, -occluders строит окклюдеры. -materialweights передаёт веса через
+    // копии материалов, как на графике без буфера весов
+    bool headless = false;
+    bool materialWeights = false;
+    for (const String& argument : GetArguments()) {
+        String flag = argument.ToLower();
+        if (flag == "-merge")
+            importOptions_.mergeStaticMeshes = true;
+        else if (flag == "-lazy")
+            importOptions_.residency = MORPH_RESIDENCY_LAZY;
+        else if (flag == "-occluders")
+            importOptions_.occluders.enabled = true;
+        else if (flag == "-headless")
+            headless = true;
+        else if (flag == "-materialweights")
+            materialWeights = true;
+    }
+    // Замер рисует в обычное окно, VSync отключён, чтобы время кадра не ждало обновления экрана.
+    // С -headless окна и рендера нет, замеряется только работа CPU (для Linux без GPU)
+    benchmark_ = ParseBenchmarkArguments(GetArguments(), benchmarkSettings_);
+    if (benchmark_) {
+        modelPath_ = benchmarkSettings_.modelPath;
+        benchmarkSettings_.importOptions = importOptions_;
+        engineParameters_["Headless"] = headless;
+        engineParameters_["VSync"] = false;
+        engineParameters_["WindowResizable"] = false;
+        engineParameters_["LogName"] = "benchmark.log";
+    } else if (headless) {
+        // Интерактивному вьюеру нужно окно
+        engineParameters_["Headless"] = false;
+    }
     RegisterAllComponents();
+    context_->GetSubsystem<MorphWeightBuffer>()->SetMaterialWeights(materialWeights);
     context_->GetSubsystem<ResourceCache>()->AddResourceDir("Resources/CustomData");
 }
 
 void FBXViewerApp::Start() 
 {
+    // Вьюер рисует только морф-меши и UI, поэтому включает общий для всех объектов режим инстансинга буфера весов
+    GetSubsystem<MorphWeightBuffer>()->SetInstancing(true);
     CreateScene();
     SetupLighting();
+    if (benchmark_) {
+        RunBenchmark();
+        return;
+    }
 
     auto* ui = GetSubsystem<UI>();
     auto* cache = GetSubsystem<ResourceCache>();
@@ -66,6 +113,7 @@ void FBXViewerApp::Start()
     }
 
     CreateCameraUI();
+    CreateMemoryUI();
 
     LogSceneContents(GetSubsystem<Log>(), scene_);
 
@@ -74,14 +122,36 @@ void FBXViewerApp::Start()
     Renderer* renderer = GetSubsystem<Renderer>();
     renderer->SetViewport(0, new Viewport(context_, scene_, cameraNode_->GetComponent<Camera>()));
     renderer->SetDrawShadows(true);
+    WarmUpMorphShaders(context_, scene_);
+    StartWeightReceiver();
+    hotReloader_ = new FBXHotReloader(context_);
+    hotReloader_->Start(scene_, modelPath_, importOptions_);
 
     SetInteractMode(0);
     
 
     SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(FBXViewerApp, HandleUpdate));
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(FBXViewerApp, HandleBeginFrame));
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(FBXViewerApp, HandleEndFrame));
     SubscribeToEvent(E_KEYDOWN, URHO3D_HANDLER(FBXViewerApp, HandleKeyDown));
 }
 
+void FBXViewerApp::Stop()
+{
+#ifdef FBX_SDK_ENABLED
+    // Фоновые загрузки к этому моменту завершены, менеджеры FBX SDK больше не нужны
+    ShutdownFBXManagerPool();
+#endif
+}
+
+void FBXViewerApp::RunBenchmark() {
+    SharedPtr<FBXBenchmark> benchmark(new FBXBenchmark(context_));
+    if (!benchmark->Run(scene_, cameraNode_, benchmarkSettings_))
+        ErrorExit("Benchmark failed, see benchmark.log");
+    else
+        engine_->Exit();
+}
+
 float DegToRad(float deg) {
     return deg * 3.1415f / 180.0f;
 }
@@ -173,18 +243,117 @@ void FBXViewerApp::HandleUpdate(StringHash h, VariantMap& eventData) {
     }
     if (cameraNode_ && cameraPositionText_)
     {
+        // Текст пересобирается только при движении камеры, неподвижный кадр не выделяет память
         Vector3 pos = cameraNode_->GetWorldPosition();
-        float yaw = cameraNode_->GetRotation().YawAngle();
-        float pitch = cameraNode_->GetRotation().PitchAngle();
-        String text = "Camera: (" +
-            ToStringWithPrecision((float) pos.x_, 2) + ", " +
-            ToStringWithPrecision((float) pos.y_, 2) + ", " +
-            ToStringWithPrecision((float) pos.z_, 2) + ", " +
-            ToStringWithPrecision((float) yaw, 2) + ", " +
-            ToStringWithPrecision((float) pitch, 2) + 
-            ")";
-        cameraPositionText_->SetText(text);
+        Quaternion rotation = cameraNode_->GetRotation();
+        if (!cameraTextValid_ || pos != cameraTextPosition_ || rotation != cameraTextRotation_)
+        {
+            cameraTextValid_ = true;
+            cameraTextPosition_ = pos;
+            cameraTextRotation_ = rotation;
+            String text = "Camera: (" +
+                ToStringWithPrecision((float) pos.x_, 2) + ", " +
+                ToStringWithPrecision((float) pos.y_, 2) + ", " +
+                ToStringWithPrecision((float) pos.z_, 2) + ", " +
+                ToStringWithPrecision((float) rotation.YawAngle(), 2) + ", " +
+                ToStringWithPrecision((float) rotation.PitchAngle(), 2) + 
+                ")";
+            cameraPositionText_->SetText(text);
+        }
+    }
+
+    memoryUpdateTimer_ -= eventData[P_TIMESTEP].GetFloat();
+    if (memoryText_ && memoryUpdateTimer_ <= 0.0f)
+    {
+        memoryUpdateTimer_ = MEMORY_UPDATE_INTERVAL;
+        UpdateMemoryText();
+    }
+}
+
+void FBXViewerApp::HandleBeginFrame(StringHash eventType, VariantMap& eventData) {
+    frameAllocationStart_ = GetAllocationCount();
+}
+
+void FBXViewerApp::HandleEndFrame(StringHash eventType, VariantMap& eventData) {
+    frameAllocations_ = GetAllocationCount() - frameAllocationStart_;
+    maxFrameAllocations_ = Max(maxFrameAllocations_, frameAllocations_);
+}
+
+void FBXViewerApp::StartWeightReceiver() {
+    auto* log = GetSubsystem<Log>();
+    weightReceiver_ = new MorphWeightReceiver(context_);
+    // Номер меша в протоколе - порядковый номер компонента в сцене
+    u16 mesh = 0;
+    for (auto* mg : findAllComponents<MorphGeometry>(scene_)) {
+        weightReceiver_->SetTarget(mesh, mg);
+        Vector<String> names = mg->GetMorpherNames();
+        String channels;
+        for (i32 i = 0; i < names.Size(); ++i)
+            channels += (i ? ", " : "") + String(i) + "=" + names[i];
+        log->Write(LOG_INFO, String("Weight stream mesh ") + String((i32)mesh) + " " + mg->GetNode()->GetName() + ": " + channels);
+        ++mesh;
+    }
+    weightReceiver_->Start();
+}
+
+void FBXViewerApp::CreateMemoryUI() {
+    auto* root = GetSubsystem<UI>()->GetRoot();
+    memoryText_ = root->CreateChild<Text>();
+    memoryText_->SetStyleAuto();
+    memoryText_->SetAlignment(HA_LEFT, VA_BOTTOM);
+    memoryText_->SetPosition(10, -10);
+    UpdateMemoryText();
+}
+
+void FBXViewerApp::UpdateMemoryText() {
+    auto* registry = GetSubsystem<MorphMeshRegistry>();
+    if (!registry)
+        return;
+    // Текст собирается в буфере на стеке и копируется в ту же строку: обновление оверлея не выделяет память
+    const float MB = 1024.0f * 1024.0f;
+    MorphMemoryStats stats = registry->GetMemoryStats();
+    char text[1024];
+    int length = snprintf(text, sizeof(text),
+        "Morph memory CPU: %.2f MB (vertices %.2f MB, indices %.2f MB, morphs %.2f MB, clusters %.2f MB, bvh %.2f MB, "
+        "occluders %.2f MB, shadow %.2f MB)\n"
+        "Morph memory GPU: %.2f MB (vertices %.2f MB, indices %.2f MB, deltas %.2f MB)\n"
+        "Meshes: %d, shared: %d\n"
+        "Channels resident: %d, %.2f MB of %.2f MB, loads %d, evictions %d",
+        stats.GetCpuTotal() / MB, stats.cpuVertices / MB, stats.cpuIndices / MB, stats.cpuMorphs / MB,
+        stats.cpuClusters / MB, stats.cpuBVH / MB, stats.cpuOccluder / MB, stats.cpuShadow / MB,
+        stats.GetGpuTotal() / MB, stats.gpuVertices / MB, stats.gpuIndices / MB, stats.gpuDeltas / MB,
+        registry->GetNumMeshes(), registry->GetNumHits(),
+        registry->GetNumResidentChannels(), registry->GetChannelMemory() / MB, registry->GetChannelBudget() / MB,
+        registry->GetNumChannelLoads(), registry->GetNumChannelEvictions());
+    if (auto* weightBuffer = GetSubsystem<MorphWeightBuffer>()) {
+        length += snprintf(text + length, sizeof(text) - length, "\nWeight slots: %d of %d%s, uploaded %d texels",
+            weightBuffer->GetNumSlots(), weightBuffer->GetCapacity(), weightBuffer->IsEnabled() ? "" : " (material parameters)",
+            weightBuffer->GetNumUploaded());
+    }
+    if (IsAllocationTrackingEnabled()) {
+        length += snprintf(text + length, sizeof(text) - length, "\nAllocations per frame: %llu, max %llu",
+            (unsigned long long)frameAllocations_, (unsigned long long)maxFrameAllocations_);
+        maxFrameAllocations_ = 0;
+    }
+
+    // Попадания кэша поз нужны для подбора его размера под диалоги
+    u32 poseHits = 0;
+    u32 poseMisses = 0;
+    u32 poseEvictions = 0;
+    i32 poses = 0;
+    morphGeometries_.Clear();
+    collectAll(morphGeometries_, scene_);
+    for (auto* mg : morphGeometries_) {
+        const MorphPoseCache& cache = mg->GetPoseCache();
+        poseHits += cache.GetNumHits();
+        poseMisses += cache.GetNumMisses();
+        poseEvictions += cache.GetNumEvictions();
+        poses += cache.GetNumPoses();
     }
+    snprintf(text + length, sizeof(text) - length, "\nPose cache: %d poses, hits %u, misses %u, evictions %u",
+        poses, poseHits, poseMisses, poseEvictions);
+    memoryString_ = text;
+    memoryText_->SetText(memoryString_);
 }
 
 void FBXViewerApp::SetInteractMode(int num) {
@@ -228,7 +397,8 @@ void FBXViewerApp::CreateScene()
     scene_ = SharedPtr<Scene>(new Scene(context_));
     scene_->CreateComponent<Octree>();
 
-    SharedPtr<Node> fbxNode = LoadFBXToNode(context_, "CustomData/repo.fbx");
+    // Слияние, хранение каналов и окклюдеры задаются флагами командной строки в Setup()
+    SharedPtr<Node> fbxNode = LoadFBXToNode(context_, modelPath_, importOptions_);
     if (fbxNode) {
         scene_->CreateChild("ImportedFBX")->AddChild(fbxNode);
         GetSubsystem<Log>()->Write(LOG_INFO, "Add fbx importet nodes");    
@@ -368,9 +538,8 @@ void FBXViewerApp::HandleSliderChanged(StringHash eventType, VariantMap& eventDa
 {
     auto* slider = static_cast<Slider*>(eventData[SliderChanged::P_ELEMENT].GetPtr());
 
-    GetSubsystem<Log>()->Write(LOG_DEBUG, "Update slider");
+    // Ползунок меняется каждый кадр при перетаскивании, поэтому без строк в лог
     float value = slider->GetValue();
-    URHO3D_LOGINFO("Slider changed to value: " + String(value));
 
     Node* node = static_cast<Node*>(slider->GetVar("node").GetPtr());
     if (node)
@@ -378,7 +547,6 @@ void FBXViewerApp::HandleSliderChanged(StringHash eventType, VariantMap& eventDa
         MorphGeometry* geometry = node->GetComponent<MorphGeometry>();
         if (geometry)
         {
-            GetSubsystem<Log>()->Write(LOG_DEBUG, String("Set value for morph weight ") + String(value) + String(" With active morph") + geometry->GetActiveMorpher() + String(" For ") + String((unsigned long long) geometry) + String(" ") + geometry->GetNode()->GetName());
             geometry->SetMorphWeight(value);
         }
     } else {
@@ -444,7 +612,10 @@ void FBXViewerApp::SetupLighting()
 
 void FBXViewerApp::RegisterAllComponents()
 {
-    context_->RegisterFactory<MorphGeometry>();
+    MorphModel::RegisterObject(context_);
+    MorphGeometry::RegisterObject(context_);
+    context_->RegisterSubsystem(new MorphMeshRegistry(context_));
+    context_->RegisterSubsystem(new MorphWeightBuffer(context_));
 }
 
 URHO3D_DEFINE_APPLICATION_MAIN(FBXViewerApp)
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 #include "MorphGeometry.h"
+#include "MorphWeightReceiver.h"
+#include "FBXHotReload.h"
+#include "FBXBenchmark.h"
 #include <Urho3D/Engine/Application.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Scene/Node.h>
@@ -38,10 +41,13 @@ public:
     explicit FBXViewerApp(Urho3D::Context* context);
     void Setup() override;
     void Start() override;
+    void Stop() override;
 
 private:
     void MoveCamera(float timeStep);
     void HandleUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleBeginFrame(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleEndFrame(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
     void HandleKeyDown(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
     void HandleSliderChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
     void HandleDropDownListChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
@@ -51,6 +57,10 @@ private:
     void RegisterAllComponents();
     void CreateUI(Urho3D::MorphGeometry* geometry);
     void CreateCameraUI();
+    void CreateMemoryUI();
+    void UpdateMemoryText();
+    void StartWeightReceiver();
+    void RunBenchmark();
     void SetupCamera();
     void SetInteractMode(int num);
     int GetInteractModeNum();
@@ -65,6 +75,30 @@ private:
     Urho3D::SharedPtr<Urho3D::LineEdit> cameraPosPitch_;
     Urho3D::SharedPtr<Urho3D::Button> applyCameraButton_;
     Urho3D::SharedPtr<Urho3D::Text> cameraPositionText_;
+    // Расход памяти морф-мешей, обновляется раз в MEMORY_UPDATE_INTERVAL секунд
+    Urho3D::SharedPtr<Urho3D::Text> memoryText_;
+    float memoryUpdateTimer_ = 0.0f;
+    // Положение камеры, по которому построен текст cameraPositionText_
+    bool cameraTextValid_ = false;
+    Urho3D::Vector3 cameraTextPosition_;
+    Urho3D::Quaternion cameraTextRotation_;
+    // Выделения памяти за кадр, считаются только со сборкой TRACK_ALLOCATIONS
+    u64 frameAllocationStart_ = 0;
+    u64 frameAllocations_ = 0;
+    u64 maxFrameAllocations_ = 0;
+    // Строка оверлея памяти и список компонентов переиспользуются между обновлениями
+    Urho3D::String memoryString_;
+    Urho3D::Vector<Urho3D::MorphGeometry*> morphGeometries_;
+    // Веса от внешнего процесса захвата лица
+    Urho3D::SharedPtr<Urho3D::MorphWeightReceiver> weightReceiver_;
+    // Повторный импорт изменившихся мешей без перезапуска
+    Urho3D::SharedPtr<FBXHotReloader> hotReloader_;
+    Urho3D::String modelPath_ = "CustomData/repo.fbx";
+    FBXImportOptions importOptions_;
+    // Режим замера из командной строки, см. FBXBenchmarkSettings
+    bool benchmark_ = false;
+    FBXBenchmarkSettings benchmarkSettings_;
+    static constexpr float MEMORY_UPDATE_INTERVAL = 0.5f;
     float yaw_{};
     float pitch_{};
     float moveSpeed_ = 1.0f;
@@ -0,0 +1,77 @@
+#include "ImportArena.h"
+
+namespace Urho3D
+{
+
+ImportArena::ImportArena(i32 blockSize) :
+    blockSize_((u64)blockSize)
+{
+}
+
+ImportArena::~ImportArena()
+{
+    for (const Block& block : blocks_)
+        delete[] block.data;
+}
+
+void ImportArena::AddBlock(u64 minSize)
+{
+    Block block;
+    block.size = Max(minSize, blockSize_);
+    block.data = new unsigned char[block.size];
+    blocks_.Push(block);
+    current_ = block.data;
+    end_ = block.data + block.size;
+    ++numHeapAllocations_;
+}
+
+void ImportArena::Reserve(u64 size)
+{
+    // Запас на выравнивание каждого массива
+    if ((u64)(end_ - current_) < size)
+        AddBlock(size + 256);
+}
+
+void* ImportArena::Allocate(u64 size, u64 alignment)
+{
+    uintptr_t address = ((uintptr_t)current_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (!current_ || address + size > (uintptr_t)end_)
+    {
+        AddBlock(size + alignment);
+        address = ((uintptr_t)current_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    unsigned char* result = reinterpret_cast<unsigned char*>(address);
+    current_ = result + size;
+    ++numAllocations_;
+    usedBytes_ += size;
+    peakBytes_ = Max(peakBytes_, usedBytes_);
+    return result;
+}
+
+void ImportArena::Reset()
+{
+    if (blocks_.Empty())
+        return;
+
+    // Самый большой блок покрывает следующий импорт такого же размера
+    i32 largest = 0;
+    for (i32 i = 1; i < blocks_.Size(); ++i)
+    {
+        if (blocks_[i].size > blocks_[largest].size)
+            largest = i;
+    }
+    for (i32 i = 0; i < blocks_.Size(); ++i)
+    {
+        if (i != largest)
+            delete[] blocks_[i].data;
+    }
+    Block block = blocks_[largest];
+    blocks_.Clear();
+    blocks_.Push(block);
+    current_ = block.data;
+    end_ = block.data + block.size;
+    usedBytes_ = 0;
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace Urho3D
+{
+
+// Монотонный аллокатор для временных данных импорта. Память освобождается только целиком в Reset()
+// или деструкторе, поэтому в нём размещаются только тривиально разрушаемые типы
+class ImportArena
+{
+public:
+    explicit ImportArena(i32 blockSize = 1024 * 1024);
+    ~ImportArena();
+    ImportArena(const ImportArena&) = delete;
+    ImportArena& operator =(const ImportArena&) = delete;
+
+    /// Make sure the next size bytes are served without a new heap allocation.
+    void Reserve(u64 size);
+    void* Allocate(u64 size, u64 alignment);
+    /// Allocate uninitialized storage for count values.
+    template <class T> T* Allocate(i32 count)
+    {
+        return count > 0 ? static_cast<T*>(Allocate((u64)count * sizeof(T), alignof(T))) : nullptr;
+    }
+    /// Allocate count values filled with zero bytes.
+    template <class T> T* AllocateZeroed(i32 count)
+    {
+        T* values = Allocate<T>(count);
+        if (values)
+            memset(values, 0, (u64)count * sizeof(T));
+        return values;
+    }
+    /// Forget all allocations, keeping the largest block for reuse.
+    void Reset();
+
+    i32 GetNumAllocations() const { return numAllocations_; }
+    /// Return the number of heap allocations made by the arena.
+    i32 GetNumHeapAllocations() const { return numHeapAllocations_; }
+    u64 GetUsedBytes() const { return usedBytes_; }
+    u64 GetPeakBytes() const { return peakBytes_; }
+
+private:
+    struct Block
+    {
+        unsigned char* data;
+        u64 size;
+    };
+
+    void AddBlock(u64 minSize);
+
+    Vector<Block> blocks_;
+    u64 blockSize_;
+    // Свободное место в последнем блоке
+    unsigned char* current_ = nullptr;
+    unsigned char* end_ = nullptr;
+    i32 numAllocations_ = 0;
+    i32 numHeapAllocations_ = 0;
+    u64 usedBytes_ = 0;
+    u64 peakBytes_ = 0;
+};
+
+}
@@ -0,0 +1,263 @@
+#include "MorphBVH.h"
+#include "MorphMeshData.h"
+
+#include <algorithm>
+
+namespace Urho3D
+{
+
+// Глубина стека обхода: дерево строится разбиением по медиане, поэтому глубина ~log2(треугольников)
+static const i32 MAX_TRAVERSAL_DEPTH = 64;
+
+void MorphBVH::Build(const Vector<MorphVertex>& vertices, const Vector<i32>& indices, bool texCoords)
+{
+    positions_.Resize(vertices.Size());
+    for (i32 i = 0; i < vertices.Size(); ++i)
+        positions_[i] = vertices[i].position_;
+    // UV нужны только лучам RAY_TRIANGLE_UV, вершины меша к тому времени могут быть выгружены
+    texCoords_.Clear();
+    if (texCoords)
+    {
+        texCoords_.Resize(vertices.Size());
+        for (i32 i = 0; i < vertices.Size(); ++i)
+            texCoords_[i] = vertices[i].texCoord_;
+    }
+
+    const i32 triangleCount = indices.Size() / 3;
+    Vector<Vector3> centers(triangleCount);
+    Vector<i32> order(triangleCount);
+    for (i32 t = 0; t < triangleCount; ++t)
+    {
+        centers[t] = (positions_[indices[t * 3]] + positions_[indices[t * 3 + 1]] + positions_[indices[t * 3 + 2]]) / 3.0f;
+        order[t] = t;
+    }
+
+    nodes_.Clear();
+    nodes_.Reserve(Max(triangleCount / MORPH_BVH_LEAF_TRIANGLES * 2, 1));
+    if (triangleCount)
+        BuildNode(order, centers, 0, triangleCount, -1);
+
+    // Треугольники в порядке листьев
+    triangles_.Resize(triangleCount * 3);
+    for (i32 t = 0; t < triangleCount; ++t)
+    {
+        for (i32 k = 0; k < 3; ++k)
+            triangles_[t * 3 + k] = indices[order[t] * 3 + k];
+    }
+
+    // Листья каждой вершины в сжатом виде: сначала подсчёт, затем заполнение
+    vertexLeafStarts_ = Vector<i32>(positions_.Size() + 1, 0);
+    for (i32 node = 0; node < nodes_.Size(); ++node)
+    {
+        const MorphBVHNode& n = nodes_[node];
+        for (i32 i = n.start * 3; i < (n.start + n.count) * 3; ++i)
+            ++vertexLeafStarts_[triangles_[i] + 1];
+    }
+    for (i32 v = 0; v < positions_.Size(); ++v)
+        vertexLeafStarts_[v + 1] += vertexLeafStarts_[v];
+    vertexLeaves_.Resize(vertexLeafStarts_.Back());
+    Vector<i32> fill(vertexLeafStarts_.Begin(), positions_.Size());
+    for (i32 node = 0; node < nodes_.Size(); ++node)
+    {
+        const MorphBVHNode& n = nodes_[node];
+        for (i32 i = n.start * 3; i < (n.start + n.count) * 3; ++i)
+            vertexLeaves_[fill[triangles_[i]]++] = node;
+    }
+}
+
+i32 MorphBVH::BuildNode(Vector<i32>& order, const Vector<Vector3>& centers, i32 start, i32 count, i32 parent)
+{
+    const i32 index = nodes_.Size();
+    nodes_.Push({ start, 0, -1, parent });
+    if (count <= MORPH_BVH_LEAF_TRIANGLES)
+    {
+        nodes_[index].count = count;
+        return index;
+    }
+
+    BoundingBox centerBox;
+    for (i32 t = start; t < start + count; ++t)
+        centerBox.Merge(centers[order[t]]);
+
+    // Разбиение по медиане центров вдоль самой длинной оси
+    Vector3 size = centerBox.Size();
+    i32 axis = size.x_ >= size.y_ && size.x_ >= size.z_ ? 0 : (size.y_ >= size.z_ ? 1 : 2);
+    const i32 half = count / 2;
+    i32* first = order.Buffer() + start;
+    std::nth_element(first, first + half, first + count, [&](i32 a, i32 b) { return centers[a].Data()[axis] < centers[b].Data()[axis]; });
+
+    BuildNode(order, centers, start, half, index);
+    nodes_[index].right = BuildNode(order, centers, start + half, count - half, index);
+    return index;
+}
+
+u64 MorphBVH::GetMemoryUse() const
+{
+    return nodes_.Capacity() * sizeof(MorphBVHNode) + positions_.Capacity() * sizeof(Vector3) + texCoords_.Capacity() * sizeof(Vector2) + (triangles_.Capacity() + vertexLeafStarts_.Capacity() +
+        vertexLeaves_.Capacity()) * sizeof(i32);
+}
+
+void MorphBVHInstance::Reset(const MorphBVH* bvh)
+{
+    if (bvh_ == bvh)
+        return;
+    bvh_ = bvh;
+    positions_.Clear();
+    boxes_.Clear();
+    stamps_.Clear();
+    dirtyLeaves_.Clear();
+    if (!bvh_)
+        return;
+    positions_ = bvh_->GetPositions();
+    stamps_ = Vector<u32>(bvh_->GetNodes().Size(), 0);
+    // Границы листьев строятся из позиций, внутренние узлы - снизу вверх
+    MoveAll(Vector<Vector3>());
+    Refit();
+}
+
+void MorphBVHInstance::MarkLeaf(i32 leaf)
+{
+    if (stamps_[leaf] == stamp_)
+        return;
+    stamps_[leaf] = stamp_;
+    dirtyLeaves_.Push(leaf);
+}
+
+void MorphBVHInstance::MoveVertices(const i32* vertices, i32 count, const Vector3* deltas, float weight)
+{
+    const Vector<Vector3>& base = bvh_->GetPositions();
+    const Vector<i32>& starts = bvh_->GetVertexLeafStarts();
+    const Vector<i32>& leaves = bvh_->GetVertexLeaves();
+    for (i32 i = 0; i < count; ++i)
+    {
+        const i32 vertex = vertices[i];
+        if (vertex < 0 || vertex >= positions_.Size())
+            continue;
+        positions_[vertex] = deltas ? base[vertex] + deltas[i] * weight : base[vertex];
+        for (i32 j = starts[vertex]; j < starts[vertex + 1]; ++j)
+            MarkLeaf(leaves[j]);
+    }
+}
+
+void MorphBVHInstance::MoveAll(const Vector<Vector3>& deltas)
+{
+    const Vector<Vector3>& base = bvh_->GetPositions();
+    for (i32 v = 0; v < positions_.Size(); ++v)
+        positions_[v] = v < deltas.Size() ? base[v] + deltas[v] : base[v];
+    const Vector<MorphBVHNode>& nodes = bvh_->GetNodes();
+    for (i32 node = 0; node < nodes.Size(); ++node)
+    {
+        if (nodes[node].count)
+            MarkLeaf(node);
+    }
+}
+
+void MorphBVHInstance::Refit()
+{
+    if (dirtyLeaves_.Empty())
+        return;
+    const Vector<MorphBVHNode>& nodes = bvh_->GetNodes();
+    const Vector<i32>& triangles = bvh_->GetTriangles();
+    boxes_.Resize(nodes.Size());
+
+    dirtyNodes_.Clear();
+    for (i32 leaf : dirtyLeaves_)
+    {
+        const MorphBVHNode& n = nodes[leaf];
+        BoundingBox box;
+        for (i32 i = n.start * 3; i < (n.start + n.count) * 3; ++i)
+            box.Merge(positions_[triangles[i]]);
+        boxes_[leaf] = box;
+        // Предки отмечаются до первого уже отмеченного
+        for (i32 parent = n.parent; parent >= 0 && stamps_[parent] != stamp_; parent = nodes[parent].parent)
+        {
+            stamps_[parent] = stamp_;
+            dirtyNodes_.Push(parent);
+        }
+    }
+
+    // Потомки лежат после родителя, поэтому обход по убыванию номера идёт снизу вверх
+    std::sort(dirtyNodes_.Begin(), dirtyNodes_.End(), [](i32 a, i32 b) { return a > b; });
+    for (i32 node : dirtyNodes_)
+    {
+        boxes_[node] = boxes_[node + 1];
+        boxes_[node].Merge(boxes_[nodes[node].right]);
+    }
+
+    dirtyLeaves_.Clear();
+    // При переполнении счётчика отметки сбрасываются
+    if (++stamp_ == 0)
+    {
+        stamps_ = Vector<u32>(nodes.Size(), 0);
+        stamp_ = 1;
+    }
+}
+
+float MorphBVHInstance::Raycast(const Ray& ray, float maxDistance, Vector3* outNormal, i32* outTriangle, Vector3* outBary) const
+{
+    if (!bvh_ || boxes_.Empty())
+        return M_INFINITY;
+    const Vector<MorphBVHNode>& nodes = bvh_->GetNodes();
+    const Vector<i32>& triangles = bvh_->GetTriangles();
+
+    float closest = maxDistance;
+    i32 hitTriangle = -1;
+    Vector3 hitNormal;
+    Vector3 hitBary;
+
+    i32 stack[MAX_TRAVERSAL_DEPTH];
+    i32 depth = 0;
+    stack[depth++] = 0;
+    while (depth)
+    {
+        const i32 node = stack[--depth];
+        if (ray.HitDistance(boxes_[node]) >= closest)
+            continue;
+        const MorphBVHNode& n = nodes[node];
+        if (n.count)
+        {
+            for (i32 t = n.start; t < n.start + n.count; ++t)
+            {
+                Vector3 normal;
+                Vector3 bary;
+                float distance = ray.HitDistance(positions_[triangles[t * 3]], positions_[triangles[t * 3 + 1]],
+                    positions_[triangles[t * 3 + 2]], &normal, &bary);
+                if (distance < closest)
+                {
+                    closest = distance;
+                    hitTriangle = t;
+                    hitNormal = normal;
+                    hitBary = bary;
+                }
+            }
+            continue;
+        }
+        if (depth + 2 > MAX_TRAVERSAL_DEPTH)
+            continue;
+        // Ближний потомок проверяется первым, чтобы раньше сократить closest
+        const i32 left = node + 1;
+        const i32 right = n.right;
+        if (ray.HitDistance(boxes_[left]) <= ray.HitDistance(boxes_[right]))
+        {
+            stack[depth++] = right;
+            stack[depth++] = left;
+        }
+        else
+        {
+            stack[depth++] = left;
+            stack[depth++] = right;
+        }
+    }
+
+    if (hitTriangle < 0)
+        return M_INFINITY;
+    if (outNormal)
+        *outNormal = hitNormal;
+    if (outTriangle)
+        *outTriangle = hitTriangle;
+    if (outBary)
+        *outBary = hitBary;
+    return closest;
+}
+
+}
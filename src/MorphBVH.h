@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Math/Vector2.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D
+{
+
+struct MorphVertex;
+
+// Максимальное количество треугольников в листе
+static const i32 MORPH_BVH_LEAF_TRIANGLES = 4;
+
+struct MorphBVHNode
+{
+    // Лист: диапазон треугольников. Внутренний узел: count == 0, левый потомок идёт следом, правый - right
+    i32 start;
+    i32 count;
+    i32 right;
+    i32 parent;
+};
+
+// Иерархия ограничивающих объёмов по треугольникам меша без морфов. Общая для всех компонентов
+// с одним MorphMeshData, деформированные границы хранит MorphBVHInstance
+class MorphBVH : public RefCounted
+{
+public:
+    /// Build over the triangles. Texture coordinates are kept for RAY_TRIANGLE_UV queries if texCoords is set.
+    void Build(const Vector<MorphVertex>& vertices, const Vector<i32>& indices, bool texCoords);
+
+    const Vector<MorphBVHNode>& GetNodes() const { return nodes_; }
+    const Vector<Vector3>& GetPositions() const { return positions_; }
+    /// Return texture coordinates per vertex, empty if the mesh has none.
+    const Vector<Vector2>& GetTexCoords() const { return texCoords_; }
+    /// Return triangle vertex indices in leaf order.
+    const Vector<i32>& GetTriangles() const { return triangles_; }
+    /// Return the first entry of the vertex in GetVertexLeaves(), the next vertex starts where this one ends.
+    const Vector<i32>& GetVertexLeafStarts() const { return vertexLeafStarts_; }
+    const Vector<i32>& GetVertexLeaves() const { return vertexLeaves_; }
+    u64 GetMemoryUse() const;
+
+private:
+    i32 BuildNode(Vector<i32>& order, const Vector<Vector3>& centers, i32 start, i32 count, i32 parent);
+
+    Vector<MorphBVHNode> nodes_;
+    Vector<Vector3> positions_;
+    Vector<Vector2> texCoords_;
+    Vector<i32> triangles_;
+    Vector<i32> vertexLeafStarts_;
+    Vector<i32> vertexLeaves_;
+};
+
+// Деформированная копия позиций и границ одного компонента. Смещение вершин отмечает затронутые
+// листья, Refit() пересчитывает только их и их предков
+class MorphBVHInstance
+{
+public:
+    /// Start from the undeformed mesh. Does nothing if the instance already uses this BVH.
+    void Reset(const MorphBVH* bvh);
+    const MorphBVH* GetBVH() const { return bvh_; }
+
+    /// Move the vertices to base + deltas[i] * weight (base if deltas is null) and mark their leaves.
+    void MoveVertices(const i32* vertices, i32 count, const Vector3* deltas, float weight);
+    /// Move every vertex to base + deltas[vertex] and mark all leaves.
+    void MoveAll(const Vector<Vector3>& deltas);
+    /// Recompute the boxes of marked leaves and their ancestors.
+    void Refit();
+
+    /// Return the hit distance along the ray, M_INFINITY if there is no hit. outTriangle receives the triangle
+    /// number in GetTriangles() order, outBary the barycentric coordinates of the hit in that triangle.
+    float Raycast(const Ray& ray, float maxDistance, Vector3* outNormal = nullptr, i32* outTriangle = nullptr,
+        Vector3* outBary = nullptr) const;
+
+private:
+    void MarkLeaf(i32 leaf);
+
+    const MorphBVH* bvh_ = nullptr;
+    Vector<Vector3> positions_;
+    Vector<BoundingBox> boxes_;
+    // Отметки листьев и узлов текущего обновления
+    Vector<u32> stamps_;
+    u32 stamp_ = 1;
+    Vector<i32> dirtyLeaves_;
+    Vector<i32> dirtyNodes_;
+};
+
+}
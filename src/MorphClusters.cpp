@@ -0,0 +1,154 @@
+#include "MorphClusters.h"
+#include "MorphGeometry.h"
+#include <Urho3D/Container/Sort.h>
+
+#include <cmath>
+
+namespace Urho3D
+{
+
+struct TriangleKey
+{
+    u32 code;
+    i32 triangle;
+
+    bool operator <(const TriangleKey& rhs) const { return code < rhs.code; }
+};
+
+// Разносит 10 младших бит через два для кода Мортона
+static u32 ExpandBits(u32 v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+static u32 MortonCode(const Vector3& p, const BoundingBox& box)
+{
+    Vector3 size = box.Size();
+    Vector3 n(
+        size.x_ > 0.0f ? (p.x_ - box.min_.x_) / size.x_ : 0.0f,
+        size.y_ > 0.0f ? (p.y_ - box.min_.y_) / size.y_ : 0.0f,
+        size.z_ > 0.0f ? (p.z_ - box.min_.z_) / size.z_ : 0.0f
+    );
+    u32 x = (u32)Clamp(n.x_ * 1023.0f, 0.0f, 1023.0f);
+    u32 y = (u32)Clamp(n.y_ * 1023.0f, 0.0f, 1023.0f);
+    u32 z = (u32)Clamp(n.z_ * 1023.0f, 0.0f, 1023.0f);
+    return (ExpandBits(x) << 2) | (ExpandBits(y) << 1) | ExpandBits(z);
+}
+
+Vector<MorphCluster> BuildMorphClusters(const Vector<MorphVertex>& vertices, Vector<i32>& indices,
+    const Vector<Vector3>& minDelta, const Vector<Vector3>& maxDelta)
+{
+    Vector<MorphCluster> clusters;
+    i32 triangleCount = indices.Size() / 3;
+    if (triangleCount == 0)
+        return clusters;
+
+    // Сортировка треугольников по коду Мортона центроида
+    Vector<Vector3> centroids(triangleCount);
+    BoundingBox centroidBox;
+    for (i32 t = 0; t < triangleCount; ++t)
+    {
+        centroids[t] = (vertices[indices[t * 3]].position_ +
+            vertices[indices[t * 3 + 1]].position_ +
+            vertices[indices[t * 3 + 2]].position_) / 3.0f;
+        centroidBox.Merge(centroids[t]);
+    }
+
+    Vector<TriangleKey> keys(triangleCount);
+    for (i32 t = 0; t < triangleCount; ++t)
+        keys[t] = { MortonCode(centroids[t], centroidBox), t };
+    Sort(keys.Begin(), keys.End());
+
+    Vector<i32> sorted(triangleCount * 3);
+    for (i32 t = 0; t < triangleCount; ++t)
+    {
+        sorted[t * 3] = indices[keys[t].triangle * 3];
+        sorted[t * 3 + 1] = indices[keys[t].triangle * 3 + 1];
+        sorted[t * 3 + 2] = indices[keys[t].triangle * 3 + 2];
+    }
+    // Треугольники, не попавшие в полный набор из трёх индексов, остаются в конце
+    for (i32 i = triangleCount * 3; i < indices.Size(); ++i)
+        sorted.Push(indices[i]);
+    indices = sorted;
+
+    for (i32 first = 0; first < triangleCount; first += MORPH_CLUSTER_TRIANGLES)
+    {
+        i32 last = Min(first + MORPH_CLUSTER_TRIANGLES, triangleCount);
+        MorphCluster cluster;
+        cluster.indexStart = first * 3;
+        cluster.indexCount = (last - first) * 3;
+        cluster.boundingBox.Clear();
+
+        bool hasMorph = false;
+        Vector3 normalSum = Vector3::ZERO;
+        for (i32 i = cluster.indexStart; i < cluster.indexStart + cluster.indexCount; ++i)
+        {
+            i32 index = indices[i];
+            const Vector3& position = vertices[index].position_;
+            cluster.boundingBox.Merge(position + minDelta[index]);
+            cluster.boundingBox.Merge(position + maxDelta[index]);
+            hasMorph |= minDelta[index] != Vector3::ZERO || maxDelta[index] != Vector3::ZERO;
+        }
+
+        cluster.center = cluster.boundingBox.Center();
+        cluster.radius = cluster.boundingBox.HalfSize().Length();
+
+        // Морфируемые треугольники меняют нормали, для них конус не строим
+        cluster.coneAxis = Vector3::ZERO;
+        cluster.coneCutoff = 1.0f;
+        if (hasMorph)
+        {
+            clusters.Push(cluster);
+            continue;
+        }
+
+        Vector<Vector3> normals;
+        for (i32 t = first; t < last; ++t)
+        {
+            const Vector3& a = vertices[indices[t * 3]].position_;
+            const Vector3& b = vertices[indices[t * 3 + 1]].position_;
+            const Vector3& c = vertices[indices[t * 3 + 2]].position_;
+            Vector3 normal = (b - a).CrossProduct(c - a);
+            float length = normal.Length();
+            if (length <= M_EPSILON)
+                continue;
+            normal /= length;
+            normals.Push(normal);
+            normalSum += normal;
+        }
+
+        float sumLength = normalSum.Length();
+        if (normals.Empty() || sumLength <= M_EPSILON)
+        {
+            clusters.Push(cluster);
+            continue;
+        }
+
+        cluster.coneAxis = normalSum / sumLength;
+        float minDot = 1.0f;
+        for (const Vector3& normal : normals)
+            minDot = Min(minDot, normal.DotProduct(cluster.coneAxis));
+        // Разброс нормалей 90 градусов и больше делает конус бесполезным
+        if (minDot > 0.0f)
+            cluster.coneCutoff = sqrtf(1.0f - minDot * minDot);
+
+        clusters.Push(cluster);
+    }
+
+    return clusters;
+}
+
+bool IsClusterBackfacing(const MorphCluster& cluster, const Vector3& cameraPos, float coneSign)
+{
+    if (cluster.coneCutoff >= 1.0f)
+        return false;
+    Vector3 view = cluster.center - cameraPos;
+    return view.DotProduct(cluster.coneAxis * coneSign) >= cluster.coneCutoff * view.Length() + cluster.radius;
+}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D
+{
+
+struct MorphVertex;
+
+// Желаемое количество треугольников в одном кластере
+static const i32 MORPH_CLUSTER_TRIANGLES = 128;
+
+struct MorphCluster
+{
+    // Диапазон в переупорядоченном индексном буфере
+    i32 indexStart;
+    i32 indexCount;
+    // Локальные границы с учётом всех морф-таргетов
+    BoundingBox boundingBox;
+    // Ограничивающая сфера для проверки конуса нормалей
+    Vector3 center;
+    float radius;
+    // Конус нормалей. coneCutoff >= 1 отключает отсечение задних граней
+    Vector3 coneAxis;
+    float coneCutoff;
+};
+
+/// Reorder triangles of indices into spatially coherent clusters and compute their culling data.
+/// minDelta and maxDelta bound the per-vertex offset of any combination of morphs with weights in [0, 1]
+/// (zero for static vertices).
+Vector<MorphCluster> BuildMorphClusters(const Vector<MorphVertex>& vertices, Vector<i32>& indices,
+    const Vector<Vector3>& minDelta, const Vector<Vector3>& maxDelta);
+
+/// Return true if every triangle of the cluster faces away from the local-space camera position.
+/// coneSign flips the cone axis for materials that cull clockwise faces.
+bool IsClusterBackfacing(const MorphCluster& cluster, const Vector3& cameraPos, float coneSign);
+
+}
@@ -0,0 +1,234 @@
+#include "MorphCompression.h"
+#include "MorphGeometry.h"
+#include <Urho3D/Container/Sort.h>
+
+#include <cmath>
+
+namespace Urho3D
+{
+
+// Собственные значения и векторы симметричной матрицы n x n методом Якоби.
+// vectors хранит собственные векторы по столбцам.
+static void JacobiEigen(Vector<double>& a, i32 n, Vector<double>& vectors, Vector<double>& values)
+{
+    vectors = Vector<double>(n * n, 0.0);
+    for (i32 i = 0; i < n; ++i)
+        vectors[i * n + i] = 1.0;
+
+    static const i32 MAX_SWEEPS = 64;
+    for (i32 sweep = 0; sweep < MAX_SWEEPS; ++sweep)
+    {
+        double off = 0.0;
+        double diagonal = 0.0;
+        for (i32 p = 0; p < n; ++p)
+        {
+            diagonal += a[p * n + p] * a[p * n + p];
+            for (i32 q = p + 1; q < n; ++q)
+                off += a[p * n + q] * a[p * n + q];
+        }
+        if (off <= 1e-24 * diagonal)
+            break;
+
+        for (i32 p = 0; p < n; ++p)
+        {
+            for (i32 q = p + 1; q < n; ++q)
+            {
+                double apq = a[p * n + q];
+                if (fabs(apq) <= 1e-300)
+                    continue;
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+
+                for (i32 k = 0; k < n; ++k)
+                {
+                    double akp = a[k * n + p];
+                    double akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (i32 k = 0; k < n; ++k)
+                {
+                    double apk = a[p * n + k];
+                    double aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (i32 k = 0; k < n; ++k)
+                {
+                    double vkp = vectors[k * n + p];
+                    double vkq = vectors[k * n + q];
+                    vectors[k * n + p] = c * vkp - s * vkq;
+                    vectors[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    values.Resize(n);
+    for (i32 i = 0; i < n; ++i)
+        values[i] = a[i * n + i];
+}
+
+struct EigenOrder
+{
+    double value;
+    i32 index;
+
+    bool operator <(const EigenOrder& rhs) const { return value > rhs.value; }
+};
+
+bool CompressMorphers(const Vector<Morpher>& morphers, const MorphCompressionSettings& settings, MorphBasis& basis, float& error)
+{
+    basis = MorphBasis();
+    error = 0.0f;
+    i32 channels = morphers.Size();
+    if (channels == 0)
+        return false;
+
+    // Объединение затронутых вершин
+    i32 sourceSize = 0;
+    i32 maxIndex = -1;
+    for (const Morpher& morpher : morphers)
+    {
+        sourceSize += morpher.indexes.Size() * (i32)(sizeof(i32) + sizeof(Vector3));
+        for (i32 index : morpher.indexes)
+            maxIndex = Max(maxIndex, index);
+    }
+    if (maxIndex < 0)
+        return false;
+
+    Vector<i32> column(maxIndex + 1, -1);
+    for (const Morpher& morpher : morphers)
+    {
+        for (i32 index : morpher.indexes)
+            column[index] = 0;
+    }
+    for (i32 i = 0; i <= maxIndex; ++i)
+    {
+        if (column[i] == 0)
+        {
+            column[i] = basis.indexes.Size();
+            basis.indexes.Push(i);
+        }
+    }
+    i32 columns = basis.indexes.Size();
+
+    // Матрица Грама по разреженным каналам: канал a раскладывается в одну строку по объединённым
+    // вершинам, остальные каналы проходят только свои смещения. Плотная матрица каналов x вершин
+    // (сотни МБ для сотен каналов) не строится
+    Vector<Vector3> row(columns, Vector3::ZERO);
+    Vector<double> gram(channels * channels, 0.0);
+    for (i32 a = 0; a < channels; ++a)
+    {
+        const Morpher& ma = morphers[a];
+        for (i32 i = 0; i < ma.indexes.Size(); ++i)
+            row[column[ma.indexes[i]]] = ma.morphDeltas[i];
+        for (i32 b = a; b < channels; ++b)
+        {
+            const Morpher& mb = morphers[b];
+            double sum = 0.0;
+            for (i32 i = 0; i < mb.indexes.Size(); ++i)
+                sum += row[column[mb.indexes[i]]].DotProduct(mb.morphDeltas[i]);
+            gram[a * channels + b] = sum;
+            gram[b * channels + a] = sum;
+        }
+        for (i32 index : ma.indexes)
+            row[column[index]] = Vector3::ZERO;
+    }
+
+    double total = 0.0;
+    for (i32 c = 0; c < channels; ++c)
+        total += gram[c * channels + c];
+    if (total <= 0.0)
+        return false;
+
+    Vector<double> vectors;
+    Vector<double> values;
+    JacobiEigen(gram, channels, vectors, values);
+
+    Vector<EigenOrder> order(channels);
+    for (i32 i = 0; i < channels; ++i)
+        order[i] = { values[i], i };
+    Sort(order.Begin(), order.End());
+
+    // Минимальное K, при котором отброшенная энергия укладывается в допуск
+    double allowed = (double)settings.tolerance * settings.tolerance * total;
+    double kept = 0.0;
+    i32 count = 0;
+    i32 limit = settings.maxBasis > 0 ? Min(settings.maxBasis, channels) : channels;
+    while (count < limit && order[count].value > 0.0 && total - kept > allowed)
+        kept += order[count++].value;
+    error = (float)sqrt(Max(total - kept, 0.0) / total);
+
+    i32 basisSize = count * columns * (i32)sizeof(Vector3) + columns * (i32)sizeof(i32) + channels * count * (i32)sizeof(float);
+    if (count == 0 || basisSize >= sourceSize)
+    {
+        basis = MorphBasis();
+        return false;
+    }
+
+    // Базисные формы: s_k = (1 / sigma_k) * sum_c U[c][k] * D_c, коэффициенты: U[c][k] * sigma_k
+    basis.shapes.Resize(count);
+    for (i32 k = 0; k < count; ++k)
+    {
+        i32 eigen = order[k].index;
+        double sigma = sqrt(order[k].value);
+        Vector<Vector3>& shape = basis.shapes[k];
+        shape = Vector<Vector3>(columns, Vector3::ZERO);
+        for (i32 c = 0; c < channels; ++c)
+        {
+            float factor = (float)(vectors[c * channels + eigen] / sigma);
+            if (factor == 0.0f)
+                continue;
+            const Morpher& morpher = morphers[c];
+            for (i32 i = 0; i < morpher.indexes.Size(); ++i)
+                shape[column[morpher.indexes[i]]] += morpher.morphDeltas[i] * factor;
+        }
+    }
+
+    for (i32 c = 0; c < channels; ++c)
+    {
+        Vector<float> coefficients(count);
+        for (i32 k = 0; k < count; ++k)
+            coefficients[k] = (float)(vectors[c * channels + order[k].index] * sqrt(order[k].value));
+        basis.coefficients[morphers[c].name] = coefficients;
+    }
+
+    return true;
+}
+
+void EvaluateMorphBasis(const MorphBasis& basis, const String& channel, float weight, Vector<Vector3>& deltas)
+{
+    // Память результата переиспользуется между вызовами
+    deltas.Resize(basis.indexes.Size());
+    for (Vector3& delta : deltas)
+        delta = Vector3::ZERO;
+    auto it = basis.coefficients.Find(channel);
+    if (it == basis.coefficients.End())
+        return;
+
+    const Vector<float>& coefficients = it->second_;
+    for (i32 k = 0; k < basis.shapes.Size(); ++k)
+    {
+        float basisWeight = coefficients[k] * weight;
+        if (basisWeight == 0.0f)
+            continue;
+        const Vector<Vector3>& shape = basis.shapes[k];
+        for (i32 j = 0; j < shape.Size(); ++j)
+            deltas[j] += shape[j] * basisWeight;
+    }
+}
+
+i32 GetMorphBasisSize(const MorphBasis& basis)
+{
+    i32 size = basis.indexes.Size() * (i32)sizeof(i32);
+    for (const Vector<Vector3>& shape : basis.shapes)
+        size += shape.Size() * (i32)sizeof(Vector3);
+    for (const auto& pair : basis.coefficients)
+        size += pair.second_.Size() * (i32)sizeof(float);
+    return size;
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D
+{
+
+struct Morpher;
+
+struct MorphCompressionSettings
+{
+    // Допустимая относительная ошибка восстановления всех каналов (норма Фробениуса)
+    float tolerance = 0.01f;
+    // Ограничение количества базисных форм, 0 - без ограничения
+    i32 maxBasis = 0;
+};
+
+// Каналы меша, разложенные по K базисным формам: канал = сумма coefficients[k] * shapes[k].
+// Базис хранится только на CPU. Смешивание K базисных потоков в шейдере не реализовано: шейдер
+// смешивает один поток смещений, поэтому канал разворачивается в полный поток при первом показе
+// (MorphMeshData::GetDeltaBuffer), и память GPU и работа на вершину те же, что без сжатия
+struct MorphBasis
+{
+    // Объединение индексов вершин, затронутых хотя бы одним каналом
+    Vector<i32> indexes;
+    // K базисных форм, по одному смещению на каждый элемент indexes
+    Vector<Vector<Vector3>> shapes;
+    // Имя канала -> K коэффициентов
+    HashMap<String, Vector<float>> coefficients;
+};
+
+/// Factorize the channels of a mesh into a shared basis. Returns false if the basis would not
+/// be smaller than the source channels, in which case they should be kept as is.
+bool CompressMorphers(const Vector<Morpher>& morphers, const MorphCompressionSettings& settings, MorphBasis& basis, float& error);
+
+/// Evaluate a channel at the given weight. The weight is premultiplied into the K basis
+/// coefficients, so only K shapes are blended. deltas receives one value per basis index.
+void EvaluateMorphBasis(const MorphBasis& basis, const String& channel, float weight, Vector<Vector3>& deltas);
+
+/// Size of the basis data in bytes.
+i32 GetMorphBasisSize(const MorphBasis& basis);
+
+}
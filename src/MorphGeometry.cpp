@@ -4,11 +4,20 @@
 #include <Urho3D/GraphicsAPI/ShaderVariation.h>
 #include <Urho3D/GraphicsAPI/Texture2D.h>
 #include <Urho3D/Graphics/Renderer.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/OcclusionBuffer.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/Math/Frustum.h>
 #include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
 #include <Urho3D/Container/Vector.h>
 #include <Urho3D/IO/Log.h>
 #include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Thread.h>
 #include <Urho3D/Scene/ValueAnimation.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/ResourceEvents.h>
 
 #include <cmath>
 
@@ -17,151 +26,806 @@ namespace Urho3D
 
 MorphGeometry::MorphGeometry(Context* context) : Drawable(context, DrawableTypes::Geometry)
 {
-    geometry_ = new Geometry(context_);
-    vertexBuffer_ = new VertexBuffer(context_);
-    indexBuffer_ = new IndexBuffer(context_);
+    data_ = new MorphMeshData(context_);
     batches_.Resize(1);
 }
 
+MorphGeometry::~MorphGeometry()
+{
+    if (weightBuffer_ && weightSlot_ >= 0)
+        weightBuffer_->FreeSlot(weightSlot_);
+}
+
+void MorphGeometry::RegisterObject(Context* context)
+{
+    context->RegisterFactory<MorphGeometry>(GEOMETRY_CATEGORY);
+
+    URHO3D_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, true, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Model", GetModelAttr, SetModelAttr, ResourceRef(MorphModel::GetTypeStatic()), AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Mesh", GetMeshName, SetMeshNameAttr, String::EMPTY, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Material", GetMaterialAttr, SetMaterialAttr, ResourceRef(Material::GetTypeStatic()), AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Active Morpher", GetActiveMorpher, SetActiveMorpherAttr, String::EMPTY, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Morph Weight", GetMorphWeight, SetMorphWeight, -1.0f, AM_DEFAULT);
+    URHO3D_COPY_BASE_ATTRIBUTES(Drawable);
+}
+
+void MorphGeometry::ApplyAttributes()
+{
+    // Модель и имя меша задаются разными атрибутами, поэтому меш выбирается после них обоих
+    if (modelDirty_) {
+        modelDirty_ = false;
+        SetModel(model_, meshName_);
+    }
+}
+
+void MorphGeometry::SetModel(MorphModel* model, const String& meshName)
+{
+    if (model_ && model_ != model)
+        UnsubscribeFromEvent(model_, E_RELOADFINISHED);
+    model_ = model;
+    meshName_ = meshName;
+    if (!model_)
+        return;
+    SubscribeToEvent(model_, E_RELOADFINISHED, URHO3D_HANDLER(MorphGeometry, HandleModelReloadFinished));
+
+    MorphMeshData* data = meshName_.Empty() ? model_->GetMesh(0) : model_->GetMesh(meshName_);
+    if (!data) {
+        context_->GetSubsystem<Log>()->Write(LOG_WARNING, "MorphModel " + model_->GetName() + " has no mesh " + meshName_);
+        return;
+    }
+    SetMeshData(data);
+    Commit();
+}
+
+void MorphGeometry::HandleModelReloadFinished(StringHash eventType, VariantMap& eventData)
+{
+    SetModel(model_, meshName_);
+}
+
+void MorphGeometry::SetModelAttr(const ResourceRef& value)
+{
+    auto* cache = context_->GetSubsystem<ResourceCache>();
+    model_ = cache->GetResource<MorphModel>(value.name_);
+    modelDirty_ = true;
+}
+
+ResourceRef MorphGeometry::GetModelAttr() const
+{
+    return GetResourceRef(model_, MorphModel::GetTypeStatic());
+}
+
+void MorphGeometry::SetMeshNameAttr(const String& value)
+{
+    meshName_ = value;
+    modelDirty_ = true;
+}
+
+void MorphGeometry::SetMaterialAttr(const ResourceRef& value)
+{
+    auto* cache = context_->GetSubsystem<ResourceCache>();
+    SetMaterial(cache->GetResource<Material>(value.name_));
+}
+
+ResourceRef MorphGeometry::GetMaterialAttr() const
+{
+    return GetResourceRef(material_, Material::GetTypeStatic());
+}
+
+void MorphGeometry::SetActiveMorpherAttr(const String& value)
+{
+    // До загрузки модели имена каналов неизвестны, SetMeshData() сохранит морф, если он есть в меше
+    if (data_->IsCommitted())
+        SetActiveMorpher(value);
+    else
+        activeMorph_ = value;
+}
+
 UpdateGeometryType MorphGeometry::GetUpdateGeometryType() {
     return UpdateGeometryType::UPDATE_MAIN_THREAD;
 }
 
+MorphMeshData* MorphGeometry::EditMeshData()
+{
+    // Данные после Commit() могут быть общими с другими компонентами, поэтому копируем их
+    if (data_->IsCommitted()) {
+        if (data_->GetVertices().Empty())
+            context_->GetSubsystem<Log>()->Write(LOG_WARNING, "Edit of mesh data without CPU copy, set vertices and indices again");
+        data_ = data_->Clone();
+    }
+    return data_;
+}
+
+void MorphGeometry::SetMeshData(MorphMeshData* data)
+{
+    if (!data)
+        return;
+    data_ = data;
+    sourceFile_ = data->GetSourceFile();
+    sourceMesh_ = data->GetSourceMesh();
+    // Первый канал становится активным, как и при AddMorpher()
+    if (!data_->GetMorphers().Contains(activeMorph_)) {
+        activeMorph_ = String::EMPTY;
+        if (!data_->GetMorphers().Empty())
+            activeMorph_ = data_->GetMorphers().Begin()->first_;
+    }
+    UpdateMorphNames();
+}
+
+void MorphGeometry::UpdateMorphNames()
+{
+    morphNames_ = data_->GetMorphers().Keys();
+}
+
+MorphMemoryStats MorphGeometry::GetMemoryStats() const
+{
+    MorphMemoryStats stats = data_->GetMemoryStats();
+    stats.cpuMorphs += poseCache_.GetCpuMemory() + fadeDeltas_.Capacity() * sizeof(Vector3);
+    stats.gpuDeltas += poseCache_.GetGpuMemory();
+    if (fadeBuffer_)
+        stats.gpuDeltas += (u64)fadeBuffer_->GetVertexCount() * fadeBuffer_->GetVertexSize();
+    return stats;
+}
+
 void MorphGeometry::SetVertices(const Vector<MorphVertex>& vertices)
 {
-    vertices_ = vertices;
+    EditMeshData()->SetVertices(vertices);
 }
 
 void MorphGeometry::SetIndices(const Vector<i32>& indices)
 {
-    indices_ = indices;
+    EditMeshData()->SetIndices(indices);
 }
 
 void MorphGeometry::SetMaterial(Material* material)
 {
     material_ = material;
-    batches_[0].material_ = material_;
-    batches_[0].material_->SetShaderParameter("MorphWeight", morphWeight_);
+    UpdateBatchMaterial();
+}
+
+// Наибольшее количество батчей видимых кластеров и представлений за кадр, для которых заранее
+// созданы геометрии. Следующие представления кадра рисуют весь меш
+static const i32 MAX_CLUSTER_BATCHES = 16;
+static const i32 MAX_CLUSTER_VIEWS = 2;
+
+static bool HasPass(Material* material, i32 passIndex)
+{
+    for (i32 i = 0; i < (i32)material->GetNumTechniques(); ++i) {
+        Technique* technique = material->GetTechnique(i);
+        if (technique && technique->HasPass(passIndex))
+            return true;
+    }
+    return false;
+}
+
+void MorphGeometry::UpdateBatchMaterial()
+{
+    // До Commit() формат вершин ещё может смениться, поэтому копия выбирается по текущим данным
+    auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    Material* layoutMaterial = registry ? registry->GetLayoutMaterial(material_, data_->GetVertexLayout(), data_->HasDeltaStream()) : material_.Get();
+    // Тени могут отбрасывать и невидимые кластеры. Теневой проход отделяется в свой материал и рисует
+    // весь меш, остальные проходы отсекаются по кластерам
+    Material* shadowMaterial = nullptr;
+    if (layoutMaterial && registry && data_->GetClusters().Size() >= 2 && HasPass(layoutMaterial, Technique::shadowPassIndex)) {
+        shadowMaterial = registry->GetShadowSplitMaterial(layoutMaterial, true);
+        layoutMaterial = registry->GetShadowSplitMaterial(layoutMaterial, false);
+    }
+    batchMaterial_ = layoutMaterial;
+    shadowMaterial_ = shadowMaterial;
+    bufferWeight_ = false;
+    instancedWeight_ = false;
+    materialLevel_ = -1;
+    if (layoutMaterial && data_->HasDeltaStream()) {
+        bufferWeight_ = weightBuffer_ && weightSlot_ >= 0 && weightBuffer_->IsEnabled();
+        // Прозрачные проходы сортируются по расстоянию и не собираются в инстансы, батчи больше
+        // Renderer::GetMaxInstanceTriangles() тоже рисуются без них
+        auto* renderer = GetSubsystem<Renderer>();
+        instancedWeight_ = bufferWeight_ && weightBuffer_->IsInstancing() && !HasPass(layoutMaterial, Technique::alphaPassIndex) &&
+            (!renderer || data_->GetIndexCount() / 3 <= renderer->GetMaxInstanceTriangles());
+        if (instancedWeight_) {
+            weightBuffer_->BindTexture(batchMaterial_);
+            weightBuffer_->BindTexture(shadowMaterial_);
+        } else if (bufferWeight_) {
+            batchMaterial_ = CreateWeightMaterial(layoutMaterial);
+            if (shadowMaterial)
+                shadowMaterial_ = CreateWeightMaterial(shadowMaterial);
+        } else {
+            // Без буфера весов вес выбирает одну из заранее созданных копий материала
+            GetWeightMaterials(layoutMaterial, weightMaterials_);
+            if (shadowMaterial)
+                GetWeightMaterials(shadowMaterial, shadowWeightMaterials_);
+            materialLevel_ = GetMorphWeightLevel(morphWeight_);
+            batchMaterial_ = weightMaterials_[materialLevel_];
+            if (shadowMaterial)
+                shadowMaterial_ = shadowWeightMaterials_[materialLevel_];
+        }
+    }
+    if (materialLevel_ < 0) {
+        weightMaterials_.Clear();
+        shadowWeightMaterials_.Clear();
+    }
+    for (SourceBatch& batch : batches_)
+        batch.material_ = batchMaterial_;
+}
+
+SharedPtr<Material> MorphGeometry::CreateWeightMaterial(Material* base)
+{
+    // Общий материал нельзя менять под один компонент: копия задаёт номер ячейки один раз
+    SharedPtr<Material> material = base->Clone(base->GetName());
+    material->SetVertexShaderDefines(material->GetVertexShaderDefines() + " MORPHSLOT");
+    material->SetShaderParameter("MorphSlot", Vector2(weightSlotData_.x_, weightSlotData_.y_));
+    weightBuffer_->BindTexture(material);
+    return material;
+}
+
+void MorphGeometry::GetWeightMaterials(Material* base, Vector<SharedPtr<Material>>& materials)
+{
+    // Копии общие для всех компонентов с тем же материалом, без реестра - свои
+    auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    if (registry)
+        materials = registry->GetWeightMaterials(base);
+    else
+        CreateMorphWeightMaterials(base, materials);
 }
 
 Material* MorphGeometry::GetMaterial() {
-    return batches_[0].material_;
+    return material_;
 }
 
 void MorphGeometry::SetMorphWeight(float weight)
 {
-    morphWeight__ = weight;
+    // Границы кластеров и окклюдер посчитаны для весов в [0, 1]
+    if (IsNaN(weight))
+        return;
+    weightState_.SetWeight(weight == -1.0f ? weight : Clamp(weight, 0.0f, 1.0f));
 }
 
 void MorphGeometry::AddMorpher(Morpher morpher) {
-    morphDeltasMap_[morpher.name] = morpher;
+    EditMeshData()->AddMorpher(morpher);
     if (activeMorph_.Empty()) {
         activeMorph_ = morpher.name;
     }
+    UpdateMorphNames();
+}
+
+void MorphGeometry::SetMorphBasis(const MorphBasis& basis) {
+    EditMeshData()->SetMorphBasis(basis);
+    if (activeMorph_.Empty() && !basis.coefficients.Empty()) {
+        activeMorph_ = basis.coefficients.Begin()->first_;
+    }
+    UpdateMorphNames();
 }
 
 Vector<String> MorphGeometry::GetMorpherNames() {
-    return morphDeltasMap_.Keys();
+    return data_->GetMorphers().Keys();
+}
+
+i32 MorphGeometry::GetMorpherIndex(const String& name) const {
+    auto it = morphNames_.Find(name);
+    return it != morphNames_.End() ? (i32)(it - morphNames_.Begin()) : -1;
+}
+
+void MorphGeometry::SetActiveMorpher(const String& name) {
+    // Список имён меняется на основном потоке без синхронизации
+    if (!Thread::IsMainThread()) {
+        context_->GetSubsystem<Log>()->Write(LOG_ERROR, "SetActiveMorpher by name is main thread only, use the morpher number");
+        return;
+    }
+    if (name.Empty()) {
+        SetActiveMorpher(MORPH_NONE);
+        return;
+    }
+    i32 index = GetMorpherIndex(name);
+    if (index >= 0) {
+        SetActiveMorpher(index);
+    }
+}
+
+void MorphGeometry::SetActiveMorpher(i32 index) {
+    weightState_.SetMorph(index);
+    // На основном потоке морф меняется сразу, чтобы GetActiveMorpher() и атрибут видели новое значение
+    if (Thread::IsMainThread())
+        ApplyActiveMorpher();
+}
+
+bool MorphGeometry::ApplyWeightState()
+{
+    MorphWeightSnapshot snapshot = weightState_.Consume();
+    weightOverride_ = snapshot.weight;
+    if (snapshot.morph == MORPH_UNCHANGED)
+        return false;
+
+    String morph;
+    if (snapshot.morph >= 0) {
+        // Номер мог устареть, если список морферов сменился после запроса
+        if (snapshot.morph >= morphNames_.Size())
+            return false;
+        morph = morphNames_[snapshot.morph];
+    }
+    if (morph == activeMorph_)
+        return false;
+    activeMorph_ = morph;
+    return true;
+}
+
+void MorphGeometry::OnSceneSet(Scene* scene)
+{
+    Drawable::OnSceneSet(scene);
+    if (scene) {
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(MorphGeometry, HandleScenePostUpdate));
+        weightBuffer_ = context_->GetSubsystem<MorphWeightBuffer>();
+        if (weightBuffer_ && weightSlot_ < 0) {
+            weightSlot_ = weightBuffer_->AllocateSlot();
+            weightSlotData_ = MorphWeightBuffer::GetSlotData(weightSlot_);
+        }
+    } else {
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+        if (weightBuffer_ && weightSlot_ >= 0)
+            weightBuffer_->FreeSlot(weightSlot_);
+        weightSlot_ = -1;
+    }
+    UpdateBatchMaterial();
+}
+
+void MorphGeometry::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    ApplyActiveMorpher();
+}
+
+void MorphGeometry::ApplyActiveMorpher()
+{
+    // Смена морфа требует создания буферов, поэтому выполняется только на основном потоке
+    const bool changed = ApplyWeightState();
+    if (!data_->IsCommitted())
+        return;
+    // Отложенный канал подгружается, когда его вес впервые становится ненулевым
+    if (!changed && !(morphDeferred_ && !pose_ && weightOverride_ != 0.0f))
+        return;
+    // Выбор морфа возвращает режим одного морфа
+    pose_.Reset();
+    fadeFrom_.Reset();
+    SetBatchGeometry(GetMorphGeometry());
+}
+
+Geometry* MorphGeometry::GetMorphGeometry()
+{
+    // С нулевым весом канал не виден: вместо чтения из файла каналов рисуются нулевые смещения
+    morphDeferred_ = weightOverride_ == 0.0f && !activeMorph_.Empty() && !data_->IsChannelResident(activeMorph_);
+    return data_->GetGeometry(morphDeferred_ ? String::EMPTY : activeMorph_);
+}
+
+void MorphGeometry::SetBatchGeometry(Geometry* geometry)
+{
+    geometry_ = geometry;
+    SetFullBatches();
+}
+
+bool MorphGeometry::SetPose(const Vector<float>& weights, float fadeTime)
+{
+    if (!data_->IsCommitted()) {
+        context_->GetSubsystem<Log>()->Write(LOG_WARNING, "Pose can't be set before Commit()");
+        return false;
+    }
+    SharedPtr<MorphPose> pose(poseCache_.Get(data_, morphNames_, weights));
+    if (!pose)
+        return false;
+    if (pose == pose_)
+        return true;
+
+    // Переход начинается от текущего состояния, в том числе от середины другого перехода
+    SharedPtr<MorphPose> from = pose_;
+    pose_ = pose;
+    if (fadeTime <= 0.0f || !from) {
+        fadeFrom_.Reset();
+        SetBatchGeometry(pose_->geometry);
+        return true;
+    }
+    if (fadeFrom_ && fadeElapsed_ < fadeTime_) {
+        from = new MorphPose();
+        from->deltas = fadeDeltas_;
+    }
+    fadeFrom_ = from;
+    fadeTime_ = fadeTime;
+    fadeElapsed_ = 0.0f;
+    if (!fadeBuffer_ || fadeBuffer_->GetVertexCount() != fadeFrom_->deltas.Size()) {
+        fadeBuffer_ = data_->CreateDeltaBuffer(fadeFrom_->deltas, true);
+        fadeGeometry_ = data_->CreateGeometry(fadeBuffer_);
+    }
+    fadeDeltas_ = fadeFrom_->deltas;
+    fadeBuffer_->SetData(fadeDeltas_.Buffer());
+    SetBatchGeometry(fadeGeometry_);
+    return true;
 }
 
-void MorphGeometry::SetActiveMorpher(String name) {
-    if (morphDeltasMap_.Contains(name) || name.Empty()) {
-        activeMorph_ = name;
+bool MorphGeometry::SetStreamedPose(const Vector<float>& weights)
+{
+    if (!data_->IsCommitted()) {
+        context_->GetSubsystem<Log>()->Write(LOG_WARNING, "Pose can't be set before Commit()");
+        return false;
+    }
+    if (!streamPose_)
+        streamPose_ = new MorphPose();
+    if (!data_->EvaluatePose(morphNames_, weights, streamPose_->deltas))
+        return false;
+    if (!streamPose_->deltaBuffer || streamPose_->deltaBuffer->GetVertexCount() != streamPose_->deltas.Size()) {
+        streamPose_->deltaBuffer = data_->CreateDeltaBuffer(streamPose_->deltas, true);
+        streamPose_->geometry = data_->CreateGeometry(streamPose_->deltaBuffer);
+    } else {
+        streamPose_->deltaBuffer->SetData(streamPose_->deltas.Buffer());
     }
+
+    // Объект позы тот же, поэтому лучи пересчитываются по сбросу отметки
+    rayPose_.Reset();
+    fadeFrom_.Reset();
+    pose_ = streamPose_;
+    if (geometry_ != streamPose_->geometry)
+        SetBatchGeometry(streamPose_->geometry);
+    return true;
 }
 
-String MorphGeometry::GetActiveMorpher() {
+void MorphGeometry::ClearPose()
+{
+    pose_.Reset();
+    fadeFrom_.Reset();
+    if (data_->IsCommitted())
+        SetBatchGeometry(GetMorphGeometry());
+}
+
+void MorphGeometry::UpdatePoseFade(float timeStep)
+{
+    if (!fadeFrom_)
+        return;
+    fadeElapsed_ += timeStep;
+    if (fadeElapsed_ >= fadeTime_) {
+        // Дальше рисуется закэшированный поток позы
+        fadeFrom_.Reset();
+        SetBatchGeometry(pose_->geometry);
+        return;
+    }
+    const float t = fadeElapsed_ / fadeTime_;
+    const Vector<Vector3>& from = fadeFrom_->deltas;
+    const Vector<Vector3>& to = pose_->deltas;
+    for (i32 i = 0; i < fadeDeltas_.Size(); ++i)
+        fadeDeltas_[i] = from[i].Lerp(to[i], t);
+    fadeBuffer_->SetData(fadeDeltas_.Buffer());
+}
+
+String MorphGeometry::GetActiveMorpher() const {
+    // Запрос из другого потока ещё не применён, возвращаем запрошенный морф
+    i32 morph = weightState_.Get().morph;
+    if (morph == MORPH_NONE)
+        return String::EMPTY;
+    if (morph >= 0 && morph < morphNames_.Size())
+        return morphNames_[morph];
     return activeMorph_;
 }
 
 void MorphGeometry::Commit()
 {
-    assert(!vertices_.Empty());
-    assert(!indices_.Empty());
-
     Log* log = context_->GetSubsystem<Log>();
     log->Write(LOG_INFO, "MorphGeometry::Commit");
-    log->Write(LOG_INFO, String("vertices_ size: ") + String(vertices_.Size()));
-    log->Write(LOG_INFO, String("indices_ size: ") + String(vertices_.Size()));
-    // Определение формата вершин
-    Vector<VertexElement> elements;
-    elements.Push(VertexElement(TYPE_VECTOR3, SEM_POSITION));
-    elements.Push(VertexElement(TYPE_VECTOR3, SEM_NORMAL));
-    elements.Push(VertexElement(TYPE_VECTOR2, SEM_TEXCOORD));
-    elements.Push(VertexElement(TYPE_VECTOR4, SEM_TANGENT));
-    elements.Push(VertexElement(TYPE_VECTOR3, SEM_TEXCOORD, 1)); // Используем второй набор текстурных координат для morphDelta
-    
-    for (i32 i = 0; i < vertices_.Size(); ++i) {
-        vertices_[i].morphDelta_ = Vector3::ZERO;
-    }
-    if (!activeMorph_.Empty()) {
-        Morpher morpher = morphDeltasMap_[activeMorph_];
-
-        log->Write(LOG_DEBUG, 
-            String("Load morpher for gemoetry ") + morpher.name + 
-            String(" with ") + String(morpher.indexes.Size()) + 
-            String("Nodes")
-        );
-
-        for (i32 i = 0; i < morpher.indexes.Size(); ++i)
-        {
-            auto index = morpher.indexes[i];
-            if (index < vertices_.Size()) {
-                vertices_[index].morphDelta_ = morpher.morphDeltas[i];
-            }
-        }
+
+    if (!data_->IsCommitted() && (data_->GetVertices().Empty() || data_->GetIndices().Empty())) {
+        // Копия выгруженных данных без новых вершин: компонент рисует прежнюю геометрию
+        log->Write(LOG_ERROR, "Can't commit mesh data without vertices and indices");
+        return;
     }
+    UpdateMorphNames();
+    ApplyWeightState();
+    if (!data_->IsCommitted()) {
+        log->Write(LOG_INFO, String("vertices_ size: ") + String(data_->GetVertices().Size()));
+        log->Write(LOG_INFO, String("indices_ size: ") + String(data_->GetIndices().Size()));
 
-    // Создание и настройка VertexBuffer
-    vertexBuffer_ = new VertexBuffer(context_);
-    vertexBuffer_->SetShadowed(true);
-    vertexBuffer_->SetSize(vertices_.Size(), elements);
-    vertexBuffer_->SetData(vertices_.Buffer());
-
-    // Создание и настройка IndexBuffer
-    indexBuffer_ = new IndexBuffer(context_);
-    indexBuffer_->SetShadowed(true);
-    bool use32bit = sizeof(indices_[0]) == 4;
-    indexBuffer_->SetSize(indices_.Size(), use32bit);
-    indexBuffer_->SetData(indices_.Buffer());
-
-    // Создание и настройка Geometry
-    geometry_ = new Geometry(context_);
-    geometry_->SetVertexBuffer(0, vertexBuffer_);
-    geometry_->SetIndexBuffer(indexBuffer_);
-    geometry_->SetDrawRange(TRIANGLE_LIST, 0, indices_.Size(), 0, vertices_.Size());
-    batches_[0].geometry_ = geometry_;
+        // Одинаковые меши разделяют данные и буферы, повторно их не строим
+        data_->CalculateHash();
+        auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+        MorphMeshData* registered = registry ? registry->Register(data_) : data_.Get();
+        if (registered != data_) {
+            log->Write(LOG_INFO, String("Reuse mesh data with hash ") + String(data_->GetContentHash()));
+            data_ = registered;
+            UpdateMorphNames();
+        } else {
+            data_->Commit();
+            log->Write(LOG_INFO, String("clusters_ size: ") + String(data_->GetClusters().Size()));
+        }
+    }
 
-    log->Write(LOG_INFO, String("vertexBuffer_ size: ") + String(vertexBuffer_->GetVertexSize()));
-    log->Write(LOG_INFO, String("indexBuffer_ size: ") + String(indexBuffer_->GetIndexSize()));
-    log->Write(LOG_INFO, String("indexBuffer_ size: ") + String(indexBuffer_->GetIndexSize()));
+    // Позы и поток перехода ссылаются на буферы прежних данных
+    poseCache_.Clear();
+    pose_.Reset();
+    streamPose_.Reset();
+    fadeFrom_.Reset();
+    fadeBuffer_.Reset();
+    fadeGeometry_.Reset();
+    fadeDeltas_.Clear();
+    UpdateBatchMaterial();
+    SetBatchGeometry(GetMorphGeometry());
 
-    PrimitiveTypes::i32 vertexCount = vertexBuffer_->GetVertexSize();
+    // UpdateBatches() вызывается из рабочих потоков, поэтому геометрии диапазонов и массивы батчей
+    // создаются здесь. Буферы геометрии берут из активного морфа каждый кадр
+    clusterGeometries_.Clear();
+    clusterGeometriesUsed_ = 0;
+    clusterFrame_ = -1;
+    const Vector<MorphCluster>& clusters = data_->GetClusters();
+    if (clusters.Size() >= 2) {
+        const i32 streams = geometry_ ? geometry_->GetNumVertexBuffers() : 0;
+        clusterGeometries_.Resize(MAX_CLUSTER_BATCHES * MAX_CLUSTER_VIEWS);
+        for (SharedPtr<Geometry>& geometry : clusterGeometries_) {
+            geometry = new Geometry(context_);
+            geometry->SetNumVertexBuffers(streams);
+        }
+        visibleRanges_.Reserve(clusters.Size());
+        batches_.Reserve(MAX_CLUSTER_BATCHES + 1);
+    }
 
-    // Обновление границ объекта для корректного отображения
-    boundingBox_.Clear();
-    for (const auto& vertex : vertices_)
-        boundingBox_.Merge(vertex.position_);
+    // Обновление границ объекта для корректного отображения (с учётом смещений морфов)
+    boundingBox_ = data_->GetBoundingBox();
+    OnMarkedDirty(node_);
     log->Write(LOG_INFO,"Bounding box local: min=" + boundingBox_.min_.ToString() + ", max=" + boundingBox_.max_.ToString());
 
 }
 
 void MorphGeometry::UpdateBatches(const FrameInfo& frame)
 {
+    UpdateClusterBatches(frame);
     Drawable::UpdateBatches(frame);
-    Log* log = context_->GetSubsystem<Log>();
-    // log->Write(LOG_DEBUG, String("MorphWeight=") + String(morphWeight_) + String(" ") + String(morphWeight__) + String(" For ") + String((unsigned long long) this) + String(" ") + GetNode()->GetName() + String(" Morpher: ") + GetActiveMorpher()) ;
-    GetMaterial()->SetShaderParameter("MorphWeight", morphWeight_);
+    // Номер ячейки веса доходит до шейдера через буфер инстансинга, материалы здесь не меняются:
+    // UpdateBatches() вызывается из рабочих потоков представлений
+    for (SourceBatch& batch : batches_)
+        batch.instancingData_ = instancedWeight_ ? &weightSlotData_ : nullptr;
 }
 
 void MorphGeometry::UpdateGeometry(const FrameInfo& frame)
 {
+    // Остальные представления кадра используют уже посчитанные вес, поток перехода и ячейку буфера весов
+    if (geometryFrame_ == frame.frameNumber_)
+        return;
+    geometryFrame_ = frame.frameNumber_;
     time_ += frame.timeStep_;
-    if (morphWeight__ != -1.0f) {
-        morphWeight_ = morphWeight__;
+    if (pose_) {
+        // Веса уже учтены в смещениях позы
+        UpdatePoseFade(frame.timeStep_);
+        morphWeight_ = 1.0f;
+    } else if (weightOverride_ != -1.0f) {
+        morphWeight_ = weightOverride_;
     } else {
         morphWeight_ = (1 + sin(time_)) / 2;
     }
+    if (weightSlot_ >= 0 && weightBuffer_)
+        weightBuffer_->SetWeight(weightSlot_, morphWeight_);
+    // Только графика без буфера весов: Material::SetShaderParameter выделяет память, поэтому вес
+    // выбирает готовую копию материала. Представления уже собрали батчи кадра, копия рисуется со следующего
+    if (materialLevel_ >= 0) {
+        const i32 level = GetMorphWeightLevel(morphWeight_);
+        if (level != materialLevel_) {
+            materialLevel_ = level;
+            batchMaterial_ = weightMaterials_[level];
+            if (!shadowWeightMaterials_.Empty())
+                shadowMaterial_ = shadowWeightMaterials_[level];
+        }
+    }
+}
+
+void MorphGeometry::SetFullBatches()
+{
+    // Весь меш в одном батче, при отделённом теневом проходе - ещё один батч для теней
+    const i32 count = shadowMaterial_ && castShadows_ ? 2 : 1;
+    batches_.Resize(count);
+    batches_[0].geometry_ = geometry_;
+    batches_[0].material_ = batchMaterial_;
+    if (count == 2) {
+        batches_[1].geometry_ = geometry_;
+        batches_[1].material_ = shadowMaterial_;
+    }
+}
+
+void MorphGeometry::UpdateClusterBatches(const FrameInfo& frame)
+{
+    // Отбрасывание кластеров выполняется по камере представления. Тени могут отбрасывать и невидимые
+    // кластеры, поэтому без отдельного теневого материала теневые объекты рисуются целиком
+    const Vector<MorphCluster>& clusters = data_->GetClusters();
+    if (clusters.Size() < 2 || (castShadows_ && !shadowMaterial_) || !frame.camera_ || !geometry_) {
+        SetFullBatches();
+        return;
+    }
+
+    // Представления одного кадра не должны затирать диапазоны друг друга до отрисовки
+    if (clusterFrame_ != frame.frameNumber_) {
+        clusterFrame_ = frame.frameNumber_;
+        clusterGeometriesUsed_ = 0;
+    }
+    if (clusterGeometriesUsed_ + MAX_CLUSTER_BATCHES > clusterGeometries_.Size()) {
+        SetFullBatches();
+        return;
+    }
+
+    Matrix3x4 inverseTransform = node_->GetWorldTransform().Inverse();
+    Frustum frustum = frame.camera_->GetFrustum().Transformed(inverseTransform);
+    Vector3 cameraPos = inverseTransform * frame.camera_->GetNode()->GetWorldPosition();
+    float coneSign = GetClusterConeSign(frame);
+
+    visibleRanges_.Clear();
+    for (const MorphCluster& cluster : clusters) {
+        if (frustum.IsInsideFast(cluster.boundingBox) == OUTSIDE)
+            continue;
+        if (coneSign != 0.0f && IsClusterBackfacing(cluster, cameraPos, coneSign))
+            continue;
+        // Соседние видимые кластеры объединяются в один диапазон
+        if (!visibleRanges_.Empty() && visibleRanges_.Back().x_ + visibleRanges_.Back().y_ == cluster.indexStart)
+            visibleRanges_.Back().y_ += cluster.indexCount;
+        else
+            visibleRanges_.Push(IntVector2(cluster.indexStart, cluster.indexCount));
+    }
+
+    // Ограничение количества вызовов отрисовки: попарно сливаем диапазоны вместе с промежутками
+    while (visibleRanges_.Size() > MAX_CLUSTER_BATCHES) {
+        i32 merged = 0;
+        for (i32 i = 0; i < visibleRanges_.Size(); i += 2) {
+            IntVector2 range = visibleRanges_[i];
+            if (i + 1 < visibleRanges_.Size())
+                range.y_ = visibleRanges_[i + 1].x_ + visibleRanges_[i + 1].y_ - range.x_;
+            visibleRanges_[merged++] = range;
+        }
+        visibleRanges_.Resize(merged);
+    }
+
+    const bool shadowBatch = shadowMaterial_ && castShadows_;
+    batches_.Resize(visibleRanges_.Size() + (shadowBatch ? 1 : 0));
+    for (i32 i = 0; i < visibleRanges_.Size(); ++i) {
+        batches_[i].geometry_ = GetClusterGeometry(visibleRanges_[i].x_, visibleRanges_[i].y_);
+        batches_[i].material_ = batchMaterial_;
+    }
+    if (shadowBatch) {
+        batches_.Back().geometry_ = geometry_;
+        batches_.Back().material_ = shadowMaterial_;
+    }
+}
+
+float MorphGeometry::GetClusterConeSign(const FrameInfo& frame)
+{
+    if (!material_ || frame.camera_->IsOrthographic() || frame.camera_->GetFlipVertical())
+        return 0.0f;
+    // Зеркальное преобразование меняет порядок обхода треугольников
+    Vector3 scale = node_->GetWorldScale();
+    if (scale.x_ * scale.y_ * scale.z_ < 0.0f)
+        return 0.0f;
+    switch (material_->GetCullMode()) {
+    case CULL_CCW:
+        return 1.0f;
+    case CULL_CW:
+        return -1.0f;
+    default:
+        return 0.0f;
+    }
+}
+
+Geometry* MorphGeometry::GetClusterGeometry(i32 indexStart, i32 indexCount)
+{
+    // Буферы берутся из геометрии активного морфа, она могла смениться с прошлого кадра.
+    // У меша без каналов потока смещений нет
+    Geometry* geometry = clusterGeometries_[clusterGeometriesUsed_++];
+    const i32 streams = geometry_->GetNumVertexBuffers();
+    if (geometry->GetNumVertexBuffers() != streams)
+        geometry->SetNumVertexBuffers(streams);
+    for (i32 i = 0; i < streams; ++i)
+        geometry->SetVertexBuffer(i, geometry_->GetVertexBuffer(i));
+    geometry->SetIndexBuffer(geometry_->GetIndexBuffer());
+    geometry->SetDrawRange(TRIANGLE_LIST, indexStart, indexCount, 0, geometry_->GetVertexCount(), false);
+    return geometry;
+}
+
+void MorphGeometry::ProcessRayQuery(const RayOctreeQuery& query, Vector<RayQueryResult>& results)
+{
+    RayQueryLevel level = query.level_;
+    if (level == RAY_AABB || !node_) {
+        Drawable::ProcessRayQuery(query, results);
+        return;
+    }
+
+    // Направление не нормируется, поэтому расстояние в локальном пространстве совпадает с мировым
+    Ray localRay = query.ray_.Transformed(node_->GetWorldTransform().Inverse());
+    float distance = localRay.HitDistance(boundingBox_);
+    Vector3 normal = -query.ray_.direction_;
+    Vector2 uv = Vector2::ZERO;
+    // Без иерархии (CPU-копии выгружены) остаётся попадание в границы
+    if (level != RAY_OBB && distance < query.maxDistance_ && data_->GetBVH()) {
+        UpdateRayBVH();
+        Vector3 localNormal;
+        i32 triangle;
+        Vector3 bary;
+        distance = rayBVH_.Raycast(localRay, query.maxDistance_, &localNormal, &triangle, &bary);
+        if (distance < query.maxDistance_) {
+            normal = (node_->GetWorldTransform() * Vector4(localNormal, 0.0f)).Normalized();
+            // UV из вершин треугольника попадания, у меша без UV остаётся ноль
+            const Vector<Vector2>& texCoords = data_->GetBVH()->GetTexCoords();
+            if (level == RAY_TRIANGLE_UV && !texCoords.Empty()) {
+                const i32* vertices = &data_->GetBVH()->GetTriangles()[triangle * 3];
+                uv = texCoords[vertices[0]] * bary.x_ + texCoords[vertices[1]] * bary.y_ + texCoords[vertices[2]] * bary.z_;
+            }
+        }
+    }
+    if (distance >= query.maxDistance_)
+        return;
+
+    RayQueryResult result;
+    result.position_ = query.ray_.origin_ + distance * query.ray_.direction_;
+    result.normal_ = normal;
+    result.textureUV_ = uv;
+    result.distance_ = distance;
+    result.drawable_ = this;
+    result.node_ = node_;
+    result.subObject_ = 0;
+    results.Push(result);
+}
+
+bool MorphGeometry::DrawOcclusion(OcclusionBuffer* buffer)
+{
+    // Окклюдер сжат с запасом на любые смещения морфов, поэтому от позы не зависит
+    const MorphOccluder& occluder = data_->GetOccluder();
+    if (occluder.indices.Empty())
+        return true;
+    if (batchMaterial_) {
+        if (!batchMaterial_->GetOcclusion())
+            return true;
+        buffer->SetCullMode(batchMaterial_->GetCullMode());
+    } else {
+        buffer->SetCullMode(CULL_CCW);
+    }
+    return buffer->AddTriangles(node_->GetWorldTransform(), occluder.positions.Buffer(), sizeof(Vector3),
+        occluder.indices.Buffer(), sizeof(i32), 0, occluder.indices.Size());
+}
+
+void MorphGeometry::UpdateRayBVH()
+{
+    MorphBVH* bvh = data_->GetBVH();
+    if (rayBVH_.GetBVH() != bvh) {
+        // Новые данные меша: экземпляр начинается с меша без смещений
+        rayBVH_.Reset(bvh);
+        rayMorph_ = String::EMPTY;
+        rayWeight_ = 0.0f;
+        rayIndexes_.Clear();
+        rayDeltas_.Clear();
+        rayDense_ = false;
+        rayPose_.Reset();
+    }
+    if (!bvh)
+        return;
+
+    if (pose_) {
+        // Переход меняет все вершины каждый кадр, готовая поза - только при смене позы
+        if (fadeFrom_)
+            rayBVH_.MoveAll(fadeDeltas_);
+        else if (rayPose_ != pose_ || !rayDense_)
+            rayBVH_.MoveAll(pose_->deltas);
+        rayPose_ = fadeFrom_ ? nullptr : pose_;
+        rayDense_ = true;
+        rayMorph_ = String::EMPTY;
+        rayIndexes_.Clear();
+        rayDeltas_.Clear();
+        rayBVH_.Refit();
+        return;
+    }
+
+    if (rayDense_) {
+        rayBVH_.MoveAll(Vector<Vector3>());
+        rayDense_ = false;
+        rayPose_.Reset();
+    }
+    if (rayMorph_ != activeMorph_) {
+        // Возвращаются на место только вершины прежнего канала
+        rayBVH_.MoveVertices(rayIndexes_.Buffer(), rayIndexes_.Size(), nullptr, 0.0f);
+        if (!data_->GetChannelDeltas(activeMorph_, rayIndexes_, rayDeltas_)) {
+            // При MORPH_RESIDENCY_RELOAD каналы не перечитываются ради лучей, проверка идёт по мешу без морфов
+            rayIndexes_.Clear();
+            rayDeltas_.Clear();
+        }
+        rayMorph_ = activeMorph_;
+        rayWeight_ = 0.0f;
+    }
+    if (rayWeight_ != morphWeight_) {
+        rayBVH_.MoveVertices(rayIndexes_.Buffer(), rayIndexes_.Size(), rayDeltas_.Buffer(), morphWeight_);
+        rayWeight_ = morphWeight_;
+    }
+    rayBVH_.Refit();
 }
 
 void MorphGeometry::OnWorldBoundingBoxUpdate()
@@ -9,67 +9,197 @@
 #include <Urho3D/Math/Vector3.h>
 #include <Urho3D/Math/Vector2.h>
 #include <Urho3D/Math/Vector4.h>
+#include "MorphMeshData.h"
+#include "MorphWeightState.h"
+#include "MorphWeightBuffer.h"
+#include "MorphPoseCache.h"
+#include "MorphModel.h"
 
 namespace Urho3D
 {
 
-struct MorphVertex
-{
-    Vector3 position_;
-    Vector3 normal_;
-    Vector2 texCoord_;
-    Vector4 tangent_;
-    Vector3 morphDelta_;
-};
-
-struct Morpher 
-{
-    String name;
-    Vector<i32> indexes;
-    Vector<Vector3> morphDeltas;
-};
-
 class MorphGeometry : public Drawable
 {
     URHO3D_OBJECT(MorphGeometry, Drawable);
 
 public:
     explicit MorphGeometry(Context* context);
-    ~MorphGeometry() override = default;
+    ~MorphGeometry() override;
+    static void RegisterObject(Context* context);
+    void ApplyAttributes() override;
 
     void SetVertices(const Vector<MorphVertex>& vertices);
     void SetIndices(const Vector<i32>& indices);
     void SetMaterial(Material* material);
     Material* GetMaterial();
+    /// Return the material the batches draw with: the material, its copy with shader defines for the vertex layout
+    /// shared by components drawn as instances, or the component's own copy that holds its weight slot or weight.
+    Material* GetBatchMaterial() const { return batchMaterial_; }
+    /// Return the material of the full-mesh shadow batch, null if the shadow pass isn't split off for cluster culling.
+    Material* GetShadowMaterial() const { return shadowMaterial_; }
+    /// Set the weight override, clamped to [0, 1] (-1 restores the default animation). Safe to call from any thread.
     void SetMorphWeight(float weight);
+    /// Return the slot of the scene-wide weight buffer, -1 outside a scene.
+    i32 GetWeightSlot() const { return weightSlot_; }
+    /// Return the weight override, -1 if the default animation is used.
+    float GetMorphWeight() const { return weightState_.Get().weight; }
     void AddMorpher(Morpher morpher);
+    void SetMorphBasis(const MorphBasis& basis);
+    const MorphBasis& GetMorphBasis() const { return data_->GetMorphBasis(); }
+    MorphMeshData* GetMeshData() const { return data_; }
+    /// Use prepared mesh data. Commit() is still required.
+    void SetMeshData(MorphMeshData* data);
+    /// Return the source file and mesh of the data given to SetMeshData(). Data shared through the registry
+    /// after Commit() keeps the source of the mesh that registered it first, these stay with the component.
+    const String& GetSourceFile() const { return sourceFile_; }
+    const String& GetSourceMesh() const { return sourceMesh_; }
+    /// Show a mesh of the model (the first one for an empty name) and commit it.
+    void SetModel(MorphModel* model, const String& meshName = String::EMPTY);
+    MorphModel* GetModel() const { return model_; }
+    const String& GetMeshName() const { return meshName_; }
+    /// Return memory of the mesh data, which may be shared with other components.
+    MorphMemoryStats GetMemoryStats() const;
     Vector<String> GetMorpherNames();
-    void SetActiveMorpher(String name);
-    String GetActiveMorpher();
+    /// Return the number of morphers, the size of the weights for SetPose().
+    i32 GetNumMorphers() const { return morphNames_.Size(); }
+    /// Return the morpher number for SetActiveMorpher(i32), -1 if not found.
+    i32 GetMorpherIndex(const String& name) const;
+    /// Set the active morpher by name (empty for none). Main thread only, other threads resolve the number
+    /// with GetMorpherIndex() on the main thread beforehand and use SetActiveMorpher(i32).
+    void SetActiveMorpher(const String& name);
+    /// Request the active morpher by number (MORPH_NONE for none). The only overload safe to call from any
+    /// thread: applied at once on the main thread, otherwise on the next scene post-update or Commit().
+    void SetActiveMorpher(i32 index);
+    /// Return the active morpher, or the requested one if the request isn't applied yet.
+    String GetActiveMorpher() const;
+    /// Show the sum of all channels with the given weights (indexed like GetMorpherIndex()), cross-fading
+    /// from the current pose over fadeTime seconds. Poses come from the pose cache. Main thread only.
+    bool SetPose(const Vector<float>& weights, float fadeTime = 0.0f);
+    /// Show the sum of all channels with weights that change every frame, e.g. streamed from another process.
+    /// Bypasses the pose cache: the deltas are written in place into one dynamic stream of the component,
+    /// without a cross-fade. Main thread only.
+    bool SetStreamedPose(const Vector<float>& weights);
+    /// Return to the single active morpher.
+    void ClearPose();
+    bool IsPoseActive() const { return pose_.NotNull(); }
+    MorphPoseCache& GetPoseCache() { return poseCache_; }
 
+    /// Build or reuse the mesh data and the batches. Edited data without vertices or indices is refused with
+    /// a logged error and the previous geometry stays.
     void Commit();
+    /// Hit test against the morphed triangles for RAY_TRIANGLE and finer levels. RAY_TRIANGLE_UV also returns
+    /// the texture coordinates interpolated in the hit triangle (zero for meshes without UV). Meshes whose
+    /// residency drops CPU copies have no triangle hierarchy and are hit tested against their bounds.
+    void ProcessRayQuery(const RayOctreeQuery& query, Vector<RayQueryResult>& results) override;
+    /// Draw the simplified occluder of the mesh data, if it has one, into the software occlusion buffer.
+    bool DrawOcclusion(OcclusionBuffer* buffer) override;
+
+    void SetModelAttr(const ResourceRef& value);
+    ResourceRef GetModelAttr() const;
+    void SetMeshNameAttr(const String& value);
+    void SetMaterialAttr(const ResourceRef& value);
+    ResourceRef GetMaterialAttr() const;
+    void SetActiveMorpherAttr(const String& value);
 
 protected:
+    void OnSceneSet(Scene* scene) override;
     void UpdateBatches(const FrameInfo& frame) override;
     void UpdateGeometry(const FrameInfo& frame) override;
     UpdateGeometryType GetUpdateGeometryType() override;
     // void SetGeometryData();
     void OnWorldBoundingBoxUpdate() override;
+    MorphMeshData* EditMeshData();
+    void UpdateMorphNames();
+    /// Take the weight state written by other threads. Returns true if the active morpher changed.
+    bool ApplyWeightState();
+    void ApplyActiveMorpher();
+    /// Return the geometry of the active morph, or zero deltas while its weight is zero and its data isn't loaded.
+    Geometry* GetMorphGeometry();
+    void HandleScenePostUpdate(StringHash eventType, VariantMap& eventData);
+    void UpdateClusterBatches(const FrameInfo& frame);
+    void UpdatePoseFade(float timeStep);
+    void SetBatchGeometry(Geometry* geometry);
+    void UpdateBatchMaterial();
+    SharedPtr<Material> CreateWeightMaterial(Material* base);
+    void GetWeightMaterials(Material* base, Vector<SharedPtr<Material>>& materials);
+    void SetFullBatches();
+    void HandleModelReloadFinished(StringHash eventType, VariantMap& eventData);
+    float GetClusterConeSign(const FrameInfo& frame);
+    Geometry* GetClusterGeometry(i32 indexStart, i32 indexCount);
+    void UpdateRayBVH();
 
 protected:
-    SharedPtr<VertexBuffer> vertexBuffer_;
-    SharedPtr<IndexBuffer> indexBuffer_;
+    // Общие с другими компонентами данные меша и буферы
+    SharedPtr<MorphMeshData> data_;
+    // Ресурс, из которого взяты data_, если компонент создан из сцены или через SetModel()
+    SharedPtr<MorphModel> model_;
+    String meshName_;
+    bool modelDirty_ = false;
+    // Источник данных, заданных SetMeshData(), до замены общими данными из реестра
+    String sourceFile_;
+    String sourceMesh_;
     SharedPtr<Material> material_;
+    SharedPtr<Material> batchMaterial_;
+    // Материал с одним теневым проходом для батча всего меша, когда видимые батчи отсекаются по кластерам
+    SharedPtr<Material> shadowMaterial_;
+    // Геометрия активного морфа, принадлежит data_
     SharedPtr<Geometry> geometry_;
-    Urho3D::HashMap<String, Morpher> morphDeltasMap_;
     String activeMorph_;
     SharedPtr<Texture2D> morphTexture_;
 private:
-    Vector<MorphVertex> vertices_;
-    Vector<i32> indices_;
-    float time_;
+    // Геометрии с диапазонами видимых кластеров, создаются в Commit() и переиспользуются внутри кадра
+    Vector<SharedPtr<Geometry>> clusterGeometries_;
+    Vector<IntVector2> visibleRanges_;
+    i32 clusterGeometriesUsed_ = 0;
+    i32 clusterFrame_ = -1;
+    // Кадр, для которого уже посчитаны вес и переход позы. UpdateGeometry() вызывается каждым
+    // представлением, где виден объект, а анимация должна продвигаться один раз за кадр
+    i32 geometryFrame_ = -1;
+    float time_ = 0.0f;
     float morphWeight_ = 1;
-    float morphWeight__ = -1.0f;
+    // Снимок веса, взятый на основном потоке один раз за кадр
+    float weightOverride_ = -1.0f;
+    // Активный морф ещё не загружен из-за нулевого веса, рисуются нулевые смещения
+    bool morphDeferred_ = false;
+    // Пишется из любых потоков
+    MorphWeightState weightState_;
+    // Ячейка веса в общем буфере и её данные инстанса для батчей
+    WeakPtr<MorphWeightBuffer> weightBuffer_;
+    i32 weightSlot_ = -1;
+    Vector4 weightSlotData_;
+    // Шейдер берёт вес из буфера: номер ячейки приходит с данными инстанса (общий материал)
+    // или из параметра собственной копии материала
+    bool bufferWeight_ = false;
+    bool instancedWeight_ = false;
+    // Если буфера весов нет: уровень веса и копии материала с весом в параметре для каждого уровня.
+    // -1, если вес приходит не из материала
+    i32 materialLevel_ = -1;
+    Vector<SharedPtr<Material>> weightMaterials_;
+    Vector<SharedPtr<Material>> shadowWeightMaterials_;
+    // Имена морферов по номерам для SetActiveMorpher(i32)
+    Vector<String> morphNames_;
+    // Показываемая поза из кэша, null в режиме одного активного морфа
+    MorphPoseCache poseCache_;
+    SharedPtr<MorphPose> pose_;
+    // Переход от fadeFrom_ к pose_ через динамический поток смещений
+    SharedPtr<MorphPose> fadeFrom_;
+    SharedPtr<VertexBuffer> fadeBuffer_;
+    SharedPtr<Geometry> fadeGeometry_;
+    Vector<Vector3> fadeDeltas_;
+    float fadeTime_ = 0.0f;
+    float fadeElapsed_ = 0.0f;
+    // Потоковая поза вне кэша: смещения и динамический поток обновляются на месте
+    SharedPtr<MorphPose> streamPose_;
+    // Границы для лучей подгоняются под показанную деформацию при запросе, а не каждый кадр
+    MorphBVHInstance rayBVH_;
+    String rayMorph_;
+    float rayWeight_ = 0.0f;
+    // Разреженные смещения rayMorph_ при полном весе
+    Vector<i32> rayIndexes_;
+    Vector<Vector3> rayDeltas_;
+    // Все вершины сдвинуты позой или переходом
+    bool rayDense_ = false;
+    SharedPtr<MorphPose> rayPose_;
 };
 
 }
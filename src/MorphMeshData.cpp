@@ -0,0 +1,1181 @@
+#include "MorphMeshData.h"
+#include "MorphStreamCodec.h"
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Technique.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+
+#include <cstring>
+
+namespace Urho3D
+{
+
+static const u64 FNV_OFFSET = 14695981039346656037ULL;
+static const u64 FNV_PRIME = 1099511628211ULL;
+static const u64 MIX_SEED = 0x9E3779B97F4A7C15ULL;
+static const u64 MIX_PRIME1 = 0x87C37B91114253D5ULL;
+static const u64 MIX_PRIME2 = 0x4CF5AD432745937FULL;
+
+typedef u64 (*HashFunction)(u64 hash, const void* data, i32 size);
+
+static u64 HashBytes(u64 hash, const void* data, i32 size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (i32 i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static u64 RotateLeft(u64 value, i32 bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Второй хэш, независимый от FNV: перемешивание по 8 байт
+static u64 MixBytes(u64 hash, const void* data, i32 size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    i32 i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        u64 block;
+        memcpy(&block, bytes + i, sizeof(block));
+        hash ^= RotateLeft(block * MIX_PRIME1, 31) * MIX_PRIME2;
+        hash = RotateLeft(hash, 27) * 5 + 0x52DCE729;
+    }
+    u64 tail = (u64)size;
+    for (; i < size; ++i)
+        tail = (tail << 8) | bytes[i];
+    hash ^= RotateLeft(tail * MIX_PRIME1, 31) * MIX_PRIME2;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+template <class T>
+static u64 HashVector(u64 hash, const Vector<T>& values, HashFunction function = HashBytes)
+{
+    i32 size = values.Size();
+    hash = function(hash, &size, sizeof(size));
+    if (size)
+        hash = function(hash, values.Buffer(), size * (i32)sizeof(T));
+    return hash;
+}
+
+// Хэш одного канала. Каналы, записанные в файл каналов, входят в хэш меша без чтения
+static u64 HashChannel(u64 seed, const Morpher& morpher, HashFunction function)
+{
+    return HashVector(HashVector(seed, morpher.indexes, function), morpher.morphDeltas, function);
+}
+
+template <class T>
+static bool IsSameVector(const Vector<T>& lhs, const Vector<T>& rhs)
+{
+    return lhs.Size() == rhs.Size() && (lhs.Empty() || memcmp(lhs.Buffer(), rhs.Buffer(), lhs.Size() * sizeof(T)) == 0);
+}
+
+// Заголовок файла каналов: идентификатор и хэш содержимого меша.
+// Каналы записаны через EncodeMorphChannel, файлы "MCHN" без сжатия перезаписываются
+static const char* CHANNEL_FILE_ID = "MCH2";
+static const u32 CHANNEL_FILE_HEADER_SIZE = 4 + sizeof(u64);
+
+static MorphChannelInfo MakeChannelInfo(const Morpher& morpher)
+{
+    MorphChannelInfo info;
+    info.count = morpher.indexes.Size();
+    for (const Vector3& delta : morpher.morphDeltas)
+        info.bounds.Merge(delta);
+    info.hash = HashChannel(FNV_OFFSET, morpher, HashBytes);
+    info.check = HashChannel(MIX_SEED, morpher, MixBytes);
+    return info;
+}
+
+// Упаковка CPU-вершин в формат буфера
+template <class V>
+static void SetPackedVertices(VertexBuffer* buffer, const Vector<MorphVertex>& vertices)
+{
+    Vector<V> packed(vertices.Size());
+    for (i32 i = 0; i < vertices.Size(); ++i)
+        packed[i].Assign(vertices[i]);
+    buffer->SetSize(packed.Size(), V::GetElements());
+    buffer->SetData(packed.Buffer());
+}
+
+MorphMeshData::MorphMeshData(Context* context) : Object(context)
+{
+}
+
+MorphMeshData::~MorphMeshData()
+{
+    // Файл каналов импорта, который не дошёл до Commit()
+    if (channelWriter_)
+    {
+        channelWriter_->Close();
+        context_->GetSubsystem<FileSystem>()->Delete(channelFile_);
+    }
+}
+
+MorphMemoryStats& MorphMemoryStats::operator +=(const MorphMemoryStats& rhs)
+{
+    cpuVertices += rhs.cpuVertices;
+    cpuIndices += rhs.cpuIndices;
+    cpuMorphs += rhs.cpuMorphs;
+    cpuClusters += rhs.cpuClusters;
+    cpuBVH += rhs.cpuBVH;
+    cpuOccluder += rhs.cpuOccluder;
+    cpuShadow += rhs.cpuShadow;
+    gpuVertices += rhs.gpuVertices;
+    gpuIndices += rhs.gpuIndices;
+    gpuDeltas += rhs.gpuDeltas;
+    return *this;
+}
+
+void MorphMeshData::SetVertices(const Vector<MorphVertex>& vertices)
+{
+    vertices_ = vertices;
+    vertexCount_ = vertices_.Size();
+}
+
+void MorphMeshData::SetIndices(const Vector<i32>& indices)
+{
+    indices_ = indices;
+    indexCount_ = indices_.Size();
+}
+
+void MorphMeshData::AddMorpher(const Morpher& morpher)
+{
+    // После BeginChannelFile() в памяти остаётся только имя канала
+    if (channelWriter_ && !basis_.coefficients.Contains(morpher.name) && WriteChannel(morpher))
+    {
+        morphers_[morpher.name] = Morpher{ morpher.name, Vector<i32>(), Vector<Vector3>() };
+        return;
+    }
+    morphers_[morpher.name] = morpher;
+}
+
+bool MorphMeshData::BeginChannelFile()
+{
+    if (channelWriter_)
+        return true;
+    auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    String dir = registry ? registry->GetChannelCacheDir() : String::EMPTY;
+    if (residency_ != MORPH_RESIDENCY_LAZY || committed_ || dir.Empty())
+        return false;
+
+    // Хэш содержимого ещё неизвестен: файл пишется под временным именем и получает своё в Commit()
+    String fileName = AddTrailingSlash(dir) + "import_" + String((u64)(size_t)this) + "_" + String(Time::GetSystemTime()) + ".tmp";
+    context_->GetSubsystem<FileSystem>()->CreateDir(dir);
+    SharedPtr<File> file(new File(context_, fileName, FILE_WRITE));
+    if (!file->IsOpen())
+    {
+        context_->GetSubsystem<Log>()->Write(LOG_WARNING, "Can't write morph channel file " + fileName + ", keep channels in memory until Commit()");
+        return false;
+    }
+    const u64 hash = 0;
+    file->WriteFileID(CHANNEL_FILE_ID);
+    file->Write(&hash, sizeof(hash));
+    channelWriter_ = file;
+    channelFile_ = fileName;
+    return true;
+}
+
+bool MorphMeshData::WriteChannel(const Morpher& morpher)
+{
+    MorphChannelInfo info = MakeChannelInfo(morpher);
+    Vector<unsigned char> encoded;
+    EncodeMorphChannel(morpher.indexes, morpher.morphDeltas, encoded);
+    info.offset = channelWriter_->GetPosition();
+    info.size = encoded.Size();
+    if (channelWriter_->Write(encoded.Buffer(), info.size) != info.size)
+        return false;
+    info.resident = false;
+    channels_[morpher.name] = info;
+    return true;
+}
+
+void MorphMeshData::FinishChannelFile()
+{
+    auto* fileSystem = context_->GetSubsystem<FileSystem>();
+    const String tempName = channelFile_;
+    const u32 size = channelWriter_->GetSize();
+    channelWriter_->Seek(4);
+    channelWriter_->Write(&contentHash_, sizeof(contentHash_));
+    channelWriter_->Close();
+    channelWriter_.Reset();
+    if (channels_.Empty())
+    {
+        fileSystem->Delete(tempName);
+        channelFile_.Clear();
+        return;
+    }
+
+    // Файл с тем же содержимым и порядком каналов мог остаться от прошлой загрузки
+    String fileName = GetChannelFileName(GetPath(tempName));
+    if (IsChannelFile(fileName, size))
+        fileSystem->Delete(tempName);
+    else
+    {
+        if (fileSystem->FileExists(fileName))
+            fileSystem->Delete(fileName);
+        if (!fileSystem->Rename(tempName, fileName))
+            fileName = tempName;
+    }
+    channelFile_ = fileName;
+    context_->GetSubsystem<Log>()->Write(LOG_INFO, String(channels_.Size()) + " channels of " + sourceMesh_ +
+        " written to " + fileName + " at import (" + String(size / 1024) + " KB)");
+}
+
+String MorphMeshData::GetChannelFileName(const String& dir) const
+{
+    // Порядок каналов в файле зависит от того, как они были записаны, поэтому входит в имя вместе с хэшем
+    Vector<String> names = channels_.Keys();
+    Sort(names.Begin(), names.End(), [this](const String& lhs, const String& rhs) {
+        return channels_.Find(lhs)->second_.offset < channels_.Find(rhs)->second_.offset;
+    });
+    u64 order = FNV_OFFSET;
+    for (const String& name : names)
+        order = HashBytes(order, name.CString(), name.Length() + 1);
+    return AddTrailingSlash(dir) + String(contentHash_) + "_" + String(order) + ".morphchannels";
+}
+
+bool MorphMeshData::IsChannelFile(const String& fileName, u32 size) const
+{
+    if (!context_->GetSubsystem<FileSystem>()->FileExists(fileName))
+        return false;
+    File existing(context_, fileName);
+    u64 hash = 0;
+    return existing.IsOpen() && existing.GetSize() == size && existing.ReadFileID() == CHANNEL_FILE_ID &&
+        existing.Read(&hash, sizeof(hash)) == sizeof(hash) && hash == contentHash_;
+}
+
+void MorphMeshData::SetMorphBasis(const MorphBasis& basis)
+{
+    basis_ = basis;
+    for (const auto& pair : basis_.coefficients)
+        AddMorpher({ pair.first_, Vector<i32>(), Vector<Vector3>() });
+}
+
+void MorphMeshData::RestoreMorphers(const HashMap<String, Morpher>& morphers, const MorphBasis& basis)
+{
+    morphers_ = morphers;
+    basis_ = basis;
+    morphersResident_ = true;
+}
+
+void MorphMeshData::SetSource(const String& fileName, const String& meshName)
+{
+    sourceFile_ = fileName;
+    sourceMesh_ = meshName;
+}
+
+SharedPtr<MorphMeshData> MorphMeshData::Clone() const
+{
+    SharedPtr<MorphMeshData> clone(new MorphMeshData(context_));
+    clone->vertices_ = vertices_;
+    clone->indices_ = indices_;
+    clone->morphers_ = morphers_;
+    clone->basis_ = basis_;
+    clone->vertexCount_ = vertexCount_;
+    clone->indexCount_ = indexCount_;
+    clone->layout_ = layout_;
+    clone->occluderSettings_ = occluderSettings_;
+    clone->residency_ = residency_;
+    clone->morphersResident_ = morphersResident_;
+    clone->sourceFile_ = sourceFile_;
+    clone->sourceMesh_ = sourceMesh_;
+    // Невыгруженные каналы копия читает из того же файла
+    clone->channels_ = channels_;
+    clone->channelFile_ = channelFile_;
+    return clone;
+}
+
+u64 MorphMeshData::HashContent(u64 hash, u64 (*function)(u64, const void*, i32)) const
+{
+    hash = function(hash, &layout_, sizeof(layout_));
+    hash = HashVector(hash, vertices_, function);
+    hash = HashVector(hash, indices_, function);
+
+    // Порядок добавления морфов не должен влиять на хэш. Каналы из файла каналов учитываются
+    // хэшами, посчитанными при записи
+    const bool primary = function == HashBytes;
+    Vector<String> names = morphers_.Keys();
+    Sort(names.Begin(), names.End());
+    for (const String& name : names)
+    {
+        hash = function(hash, name.CString(), name.Length());
+        auto it = channels_.Find(name);
+        u64 channel;
+        if (it != channels_.End() && !it->second_.resident)
+            channel = primary ? it->second_.hash : it->second_.check;
+        else
+            channel = HashChannel(primary ? FNV_OFFSET : MIX_SEED, morphers_[name], function);
+        hash = function(hash, &channel, sizeof(channel));
+    }
+
+    hash = HashVector(hash, basis_.indexes, function);
+    for (const Vector<Vector3>& shape : basis_.shapes)
+        hash = HashVector(hash, shape, function);
+    for (const String& name : names)
+    {
+        auto it = basis_.coefficients.Find(name);
+        if (it != basis_.coefficients.End())
+            hash = HashVector(hash, it->second_, function);
+    }
+    return hash;
+}
+
+void MorphMeshData::CalculateHash()
+{
+    contentHash_ = HashContent(FNV_OFFSET, HashBytes);
+    // Без CPU-копий сравнивать нечего, поэтому совпасть должны оба независимых хэша
+    contentCheck_ = HashContent(MIX_SEED, MixBytes);
+}
+
+bool MorphMeshData::IsChannelResident(const String& morph) const
+{
+    if (!morphersResident_)
+        return false;
+    auto it = channels_.Find(morph);
+    return it == channels_.End() || it->second_.resident;
+}
+
+bool MorphMeshData::IsSameContent(const MorphMeshData& other) const
+{
+    if (contentHash_ != other.contentHash_ || contentCheck_ != other.contentCheck_ || layout_ != other.layout_ ||
+        vertexCount_ != other.vertexCount_ || indexCount_ != other.indexCount_ || morphers_.Size() != other.morphers_.Size())
+        return false;
+
+    // Данные сравниваются, пока они есть на CPU у обоих мешей
+    if (!vertices_.Empty() && !other.vertices_.Empty() && !IsSameVector(vertices_, other.vertices_))
+        return false;
+    // Commit() переупорядочивает индексы кластерами, сравнимы только меши в одном состоянии.
+    // Иначе индексы покрывают оба хэша, посчитанные до Commit()
+    if (committed_ == other.committed_ && !indices_.Empty() && !other.indices_.Empty() && !IsSameVector(indices_, other.indices_))
+        return false;
+
+    for (const auto& pair : morphers_)
+    {
+        auto it = other.morphers_.Find(pair.first_);
+        if (it == other.morphers_.End())
+            return false;
+        if (morphersResident_ && other.morphersResident_ &&
+            other.GetMorpherCount(it->first_, it->second_) != GetMorpherCount(pair.first_, pair.second_))
+            return false;
+        if (IsChannelResident(pair.first_) && other.IsChannelResident(it->first_) &&
+            (!IsSameVector(pair.second_.indexes, it->second_.indexes) || !IsSameVector(pair.second_.morphDeltas, it->second_.morphDeltas)))
+            return false;
+    }
+
+    if (morphersResident_ && other.morphersResident_)
+    {
+        if (!IsSameVector(basis_.indexes, other.basis_.indexes) || basis_.shapes.Size() != other.basis_.shapes.Size() ||
+            basis_.coefficients.Size() != other.basis_.coefficients.Size())
+            return false;
+        for (i32 i = 0; i < basis_.shapes.Size(); ++i)
+        {
+            if (!IsSameVector(basis_.shapes[i], other.basis_.shapes[i]))
+                return false;
+        }
+        for (const auto& pair : basis_.coefficients)
+        {
+            auto it = other.basis_.coefficients.Find(pair.first_);
+            if (it == other.basis_.coefficients.End() || !IsSameVector(pair.second_, it->second_))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool MorphMeshData::Commit()
+{
+    // Копия данных, у которых ApplyResidency() уже выгрузил вершины, без новых вершин не собирается
+    if (vertices_.Empty() || indices_.Empty())
+    {
+        context_->GetSubsystem<Log>()->Write(LOG_ERROR, "Can't commit mesh data " + sourceMesh_ +
+            " without vertices and indices, set them again or reload the source");
+        return false;
+    }
+
+    // Каналы, записанные в файл при импорте, там и остаются. Копия ленивого меша сначала
+    // возвращает данные всех каналов, файл для неё пишется заново
+    const bool channelFileWritten = channelWriter_.NotNull();
+    if (channelFileWritten)
+        FinishChannelFile();
+    else
+    {
+        for (const auto& pair : channels_)
+        {
+            if (!pair.second_.resident)
+                EnsureChannelResident(pair.first_);
+        }
+    }
+
+    // Кластеры переупорядочивают индексы, поэтому строятся до заполнения буфера
+    Vector<Vector3> minDelta;
+    Vector<Vector3> maxDelta;
+    CollectMorphExtents(minDelta, maxDelta);
+    clusters_ = BuildMorphClusters(vertices_, indices_, minDelta, maxDelta);
+    bvh_ = new MorphBVH();
+    bvh_->Build(vertices_, indices_, layout_ != MORPH_LAYOUT_NO_TEXCOORD);
+    if (occluderSettings_.enabled)
+        BuildMorphOccluder(vertices_, indices_, minDelta, maxDelta, occluderSettings_, occluder_);
+
+    // Границы с учётом смещений морфов
+    boundingBox_.Clear();
+    for (const auto& cluster : clusters_)
+        boundingBox_.Merge(cluster.boundingBox);
+
+    if (residency_ == MORPH_RESIDENCY_LAZY && !channelFileWritten)
+        WriteChannelFile();
+    committed_ = true;
+    return true;
+}
+
+void MorphMeshData::WriteChannelFile()
+{
+    Log* log = context_->GetSubsystem<Log>();
+    auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    String dir = registry ? registry->GetChannelCacheDir() : String::EMPTY;
+    channels_.Clear();
+    channelFile_.Clear();
+    if (dir.Empty())
+    {
+        log->Write(LOG_WARNING, "No directory for morph channel files, keep channels of " + sourceMesh_ + " in memory");
+        return;
+    }
+
+    // Каналы идут по именам, поэтому смещения одинаковы при каждой загрузке того же меша.
+    // Каналы из сжатого базиса остаются в памяти вместе с базисом
+    Vector<String> names = morphers_.Keys();
+    Sort(names.Begin(), names.End());
+    Vector<unsigned char> encoded;
+    u64 rawSize = 0;
+    for (const String& name : names)
+    {
+        if (basis_.coefficients.Contains(name))
+            continue;
+        const Morpher& morpher = morphers_[name];
+        MorphChannelInfo info = MakeChannelInfo(morpher);
+        info.offset = CHANNEL_FILE_HEADER_SIZE + encoded.Size();
+        EncodeMorphChannel(morpher.indexes, morpher.morphDeltas, encoded);
+        info.size = CHANNEL_FILE_HEADER_SIZE + encoded.Size() - info.offset;
+        rawSize += sizeof(i32) + info.count * (sizeof(i32) + sizeof(Vector3));
+        channels_[name] = info;
+    }
+    if (channels_.Empty())
+        return;
+    const u32 offset = CHANNEL_FILE_HEADER_SIZE + encoded.Size();
+
+    // Файл с тем же содержимым мог остаться от прошлой загрузки
+    String fileName = GetChannelFileName(dir);
+    auto* fileSystem = context_->GetSubsystem<FileSystem>();
+    if (IsChannelFile(fileName, offset))
+        channelFile_ = fileName;
+    if (channelFile_.Empty())
+    {
+        fileSystem->CreateDir(dir);
+        File file(context_, fileName, FILE_WRITE);
+        if (!file.IsOpen())
+        {
+            log->Write(LOG_WARNING, "Can't write morph channel file " + fileName + ", keep channels in memory");
+            channels_.Clear();
+            return;
+        }
+        file.WriteFileID(CHANNEL_FILE_ID);
+        file.Write(&contentHash_, sizeof(contentHash_));
+        file.Write(encoded.Buffer(), encoded.Size());
+        channelFile_ = fileName;
+    }
+
+    // В памяти остаются только сведения о каналах
+    for (auto& pair : channels_)
+    {
+        Morpher& morpher = morphers_[pair.first_];
+        morpher.indexes.Clear();
+        morpher.indexes.Compact();
+        morpher.morphDeltas.Clear();
+        morpher.morphDeltas.Compact();
+        pair.second_.resident = false;
+    }
+    log->Write(LOG_INFO, String(channels_.Size()) + " channels of " + sourceMesh_ + " moved to " + fileName + " (" +
+        String(offset / 1024) + " KB, " + String((u32)(rawSize / 1024)) + " KB uncompressed)");
+}
+
+bool MorphMeshData::EnsureChannelResident(const String& morph)
+{
+    auto it = channels_.Find(morph);
+    if (it == channels_.End())
+        return true;
+    MorphChannelInfo& info = it->second_;
+    auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    if (registry)
+        info.lastUse = registry->TouchChannel();
+    if (info.resident)
+        return true;
+
+    Morpher& morpher = morphers_[morph];
+    if (!ReadChannel(morph, info, morpher.indexes, morpher.morphDeltas))
+        return false;
+    info.resident = true;
+    if (registry)
+        registry->OnChannelLoaded();
+    return true;
+}
+
+bool MorphMeshData::ReadChannel(const String& morph, const MorphChannelInfo& info, Vector<i32>& indexes,
+    Vector<Vector3>& deltas) const
+{
+    File file(context_, channelFile_);
+    Vector<unsigned char> encoded(info.size);
+    if (!file.IsOpen() || file.Seek(info.offset) != info.offset || file.Read(encoded.Buffer(), info.size) != info.size)
+    {
+        context_->GetSubsystem<Log>()->Write(LOG_ERROR, "Can't read morph channel " + morph + " from " + channelFile_);
+        return false;
+    }
+    if (!DecodeMorphChannel(encoded.Buffer(), info.size, indexes, deltas) || indexes.Size() != info.count)
+    {
+        context_->GetSubsystem<Log>()->Write(LOG_ERROR, "Morph channel " + morph + " in " + channelFile_ + " is corrupt");
+        indexes.Clear();
+        deltas.Clear();
+        return false;
+    }
+    return true;
+}
+
+bool MorphMeshData::IsChannelInUse(const String& morph) const
+{
+    // Одну ссылку держит кэш геометрий, остальные - компоненты, которые рисуют канал
+    auto it = geometries_.Find(morph);
+    return it != geometries_.End() && it->second_->Refs() > 1;
+}
+
+bool MorphMeshData::EvictChannel(const String& morph)
+{
+    auto it = channels_.Find(morph);
+    if (it == channels_.End() || IsChannelInUse(morph))
+        return false;
+    Morpher& morpher = morphers_[morph];
+    morpher.indexes.Clear();
+    morpher.indexes.Compact();
+    morpher.morphDeltas.Clear();
+    morpher.morphDeltas.Compact();
+    it->second_.resident = false;
+    deltaBuffers_.Erase(morph);
+    geometries_.Erase(morph);
+    return true;
+}
+
+u64 MorphMeshData::GetChannelMemory(const String& morph) const
+{
+    u64 size = 0;
+    auto morpher = morphers_.Find(morph);
+    if (morpher != morphers_.End())
+        size += morpher->second_.indexes.Capacity() * sizeof(i32) + morpher->second_.morphDeltas.Capacity() * sizeof(Vector3);
+    auto buffer = deltaBuffers_.Find(morph);
+    if (buffer != deltaBuffers_.End())
+        size += (u64)buffer->second_->GetVertexCount() * buffer->second_->GetVertexSize();
+    return size;
+}
+
+i32 MorphMeshData::GetMorpherCount(const String& morph, const Morpher& morpher) const
+{
+    auto it = channels_.Find(morph);
+    return it != channels_.End() ? it->second_.count : morpher.indexes.Size();
+}
+
+void MorphMeshData::UploadBuffers()
+{
+    Log* log = context_->GetSubsystem<Log>();
+
+    // Теневые копии нужны только если CPU-данные остаются в памяти
+    bool shadowed = residency_ == MORPH_RESIDENCY_KEEP_ALL;
+
+    // Создание и настройка VertexBuffer в формате, выбранном при импорте
+    vertexBuffer_ = new VertexBuffer(context_);
+    vertexBuffer_->SetShadowed(shadowed);
+    switch (layout_)
+    {
+    case MORPH_LAYOUT_NO_TEXCOORD:
+        SetPackedVertices<MorphVertexNoTexCoord>(vertexBuffer_, vertices_);
+        break;
+    default:
+        SetPackedVertices<MorphVertexFull>(vertexBuffer_, vertices_);
+        break;
+    }
+
+    // Создание и настройка IndexBuffer
+    indexBuffer_ = new IndexBuffer(context_);
+    indexBuffer_->SetShadowed(shadowed);
+    bool use32bit = sizeof(indices_[0]) == 4;
+    indexBuffer_->SetSize(indices_.Size(), use32bit);
+    indexBuffer_->SetData(indices_.Buffer());
+
+    log->Write(LOG_INFO, String("vertexBuffer_ size: ") + String(vertexBuffer_->GetVertexSize()));
+    log->Write(LOG_INFO, String("indexBuffer_ size: ") + String(indexBuffer_->GetIndexSize()));
+}
+
+VertexBuffer* MorphMeshData::GetDeltaBuffer(const String& morph)
+{
+    auto it = deltaBuffers_.Find(morph);
+    if (it != deltaBuffers_.End())
+        return it->second_;
+
+    if (!morph.Empty() && (!EnsureMorphersResident() || !EnsureChannelResident(morph)))
+    {
+        context_->GetSubsystem<Log>()->Write(LOG_ERROR, String("Can't reload morph ") + morph + " from " + sourceFile_);
+        return nullptr;
+    }
+
+    Vector<Vector3> deltas;
+    EvaluateDeltas(morph, deltas);
+    SharedPtr<VertexBuffer> buffer = CreateDeltaBuffer(deltas);
+    deltaBuffers_[morph] = buffer;
+    auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    if (registry && channels_.Contains(morph))
+        registry->EnforceChannelBudget();
+    return buffer;
+}
+
+SharedPtr<VertexBuffer> MorphMeshData::CreateDeltaBuffer(const Vector<Vector3>& deltas, bool dynamic)
+{
+    // Используем второй набор текстурных координат для morphDelta
+    Vector<VertexElement> elements;
+    elements.Push(VertexElement(TYPE_VECTOR3, SEM_TEXCOORD, 1));
+    SharedPtr<VertexBuffer> buffer(new VertexBuffer(context_));
+    buffer->SetShadowed(residency_ == MORPH_RESIDENCY_KEEP_ALL);
+    buffer->SetSize(deltas.Size(), elements, dynamic);
+    buffer->SetData(deltas.Buffer());
+    return buffer;
+}
+
+bool MorphMeshData::EvaluatePose(const Vector<String>& morphs, const Vector<float>& weights, Vector<Vector3>& deltas)
+{
+    // Память результата переиспользуется, потоковая поза вычисляется каждый кадр
+    deltas.Resize(vertexCount_);
+    for (Vector3& delta : deltas)
+        delta = Vector3::ZERO;
+    if (!EnsureMorphersResident())
+        return false;
+    // Подгружаются только каналы с ненулевым весом
+    bool loaded = false;
+    for (i32 k = 0; k < morphs.Size() && k < weights.Size(); ++k)
+    {
+        if (weights[k] == 0.0f)
+            continue;
+        loaded = loaded || !IsChannelResident(morphs[k]);
+        if (!EnsureChannelResident(morphs[k]))
+            return false;
+    }
+
+    Vector<Vector3>& basisDeltas = basisDeltas_;
+    for (i32 k = 0; k < morphs.Size() && k < weights.Size(); ++k)
+    {
+        const float weight = weights[k];
+        if (weight == 0.0f)
+            continue;
+        if (basis_.coefficients.Contains(morphs[k]))
+        {
+            EvaluateMorphBasis(basis_, morphs[k], weight, basisDeltas);
+            for (i32 i = 0; i < basis_.indexes.Size(); ++i)
+            {
+                if (basis_.indexes[i] < deltas.Size())
+                    deltas[basis_.indexes[i]] += basisDeltas[i];
+            }
+            continue;
+        }
+        auto it = morphers_.Find(morphs[k]);
+        if (it == morphers_.End())
+            continue;
+        const Morpher& morpher = it->second_;
+        for (i32 i = 0; i < morpher.indexes.Size(); ++i)
+        {
+            if (morpher.indexes[i] < deltas.Size())
+                deltas[morpher.indexes[i]] += morpher.morphDeltas[i] * weight;
+        }
+    }
+    // CPU-копии вершин выгружаются по режиму хранения
+    if (vertexBuffer_)
+        ApplyResidency();
+    auto* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    if (registry && loaded)
+        registry->EnforceChannelBudget();
+    return true;
+}
+
+bool MorphMeshData::EnsureMorphersResident()
+{
+    if (morphersResident_)
+        return true;
+    MorphMeshRegistry* registry = context_->GetSubsystem<MorphMeshRegistry>();
+    MorphMeshReloader reloader = registry ? registry->GetReloader() : nullptr;
+    if (!reloader || sourceFile_.Empty())
+        return false;
+    if (!reloader(this) || !morphersResident_)
+        return false;
+    // Исходный файл перечитывается один раз: каналы переносятся в файл каналов и дальше
+    // подгружаются и вытесняются по одному, как при MORPH_RESIDENCY_LAZY
+    residency_ = MORPH_RESIDENCY_LAZY;
+    WriteChannelFile();
+    return true;
+}
+
+void MorphMeshData::ApplyResidency()
+{
+    if (residency_ == MORPH_RESIDENCY_KEEP_ALL)
+        return;
+
+    // Вершины и индексы уже на GPU, кластеры и границы построены. Иерархия держит свою копию
+    // позиций, без неё лучи проверяются по границам
+    vertices_.Clear();
+    vertices_.Compact();
+    indices_.Clear();
+    indices_.Compact();
+    bvh_.Reset();
+
+    if (residency_ != MORPH_RESIDENCY_RELOAD || !morphersResident_)
+        return;
+    // Остаются только имена каналов
+    for (auto& pair : morphers_)
+    {
+        pair.second_.indexes.Clear();
+        pair.second_.indexes.Compact();
+        pair.second_.morphDeltas.Clear();
+        pair.second_.morphDeltas.Compact();
+    }
+    basis_ = MorphBasis();
+    morphersResident_ = false;
+}
+
+Geometry* MorphMeshData::GetGeometry(const String& morph)
+{
+    auto it = geometries_.Find(morph);
+    if (it != geometries_.End())
+    {
+        // Отметка использования, чтобы канал не вытеснялся первым
+        EnsureChannelResident(morph);
+        return it->second_;
+    }
+
+    if (!vertexBuffer_)
+        UploadBuffers();
+
+    // Создание и настройка Geometry. Мешу без каналов поток смещений не нужен
+    VertexBuffer* deltaBuffer = nullptr;
+    if (HasDeltaStream())
+    {
+        deltaBuffer = GetDeltaBuffer(morph);
+        if (!deltaBuffer)
+            return nullptr;
+    }
+
+    geometries_[morph] = CreateGeometry(deltaBuffer);
+    ApplyResidency();
+    return geometries_[morph];
+}
+
+SharedPtr<Geometry> MorphMeshData::CreateGeometry(VertexBuffer* deltaBuffer)
+{
+    if (!vertexBuffer_)
+        UploadBuffers();
+    SharedPtr<Geometry> geometry(new Geometry(context_));
+    geometry->SetNumVertexBuffers(deltaBuffer ? 2 : 1);
+    geometry->SetVertexBuffer(0, vertexBuffer_);
+    if (deltaBuffer)
+        geometry->SetVertexBuffer(1, deltaBuffer);
+    geometry->SetIndexBuffer(indexBuffer_);
+    geometry->SetDrawRange(TRIANGLE_LIST, 0, indexCount_, 0, vertexCount_);
+    return geometry;
+}
+
+void MorphMeshData::EvaluateDeltas(const String& morph, Vector<Vector3>& deltas) const
+{
+    deltas = Vector<Vector3>(vertexCount_, Vector3::ZERO);
+    if (morph.Empty())
+        return;
+
+    Log* log = context_->GetSubsystem<Log>();
+    if (basis_.coefficients.Contains(morph)) {
+        // Канал восстанавливается из K базисных форм в обычный поток смещений
+        Vector<Vector3> basisDeltas;
+        EvaluateMorphBasis(basis_, morph, 1.0f, basisDeltas);
+        for (i32 i = 0; i < basis_.indexes.Size(); ++i)
+        {
+            auto index = basis_.indexes[i];
+            if (index < deltas.Size()) {
+                deltas[index] = basisDeltas[i];
+            }
+        }
+        return;
+    }
+
+    auto it = morphers_.Find(morph);
+    if (it == morphers_.End())
+        return;
+    const Morpher& morpher = it->second_;
+
+    log->Write(LOG_DEBUG,
+        String("Load morpher for gemoetry ") + morpher.name +
+        String(" with ") + String(morpher.indexes.Size()) +
+        String("Nodes")
+    );
+
+    for (i32 i = 0; i < morpher.indexes.Size(); ++i)
+    {
+        auto index = morpher.indexes[i];
+        if (index < deltas.Size()) {
+            deltas[index] = morpher.morphDeltas[i];
+        }
+    }
+}
+
+bool MorphMeshData::GetChannelDeltas(const String& morph, Vector<i32>& indexes, Vector<Vector3>& deltas) const
+{
+    indexes.Clear();
+    deltas.Clear();
+    if (morph.Empty())
+        return true;
+    if (!morphersResident_)
+        return false;
+    auto channel = channels_.Find(morph);
+    if (channel != channels_.End() && !channel->second_.resident)
+        return false;
+    if (basis_.coefficients.Contains(morph)) {
+        indexes = basis_.indexes;
+        EvaluateMorphBasis(basis_, morph, 1.0f, deltas);
+        return true;
+    }
+    auto it = morphers_.Find(morph);
+    if (it == morphers_.End())
+        return true;
+    indexes = it->second_.indexes;
+    deltas = it->second_.morphDeltas;
+    return true;
+}
+
+MorphMemoryStats MorphMeshData::GetMemoryStats() const
+{
+    MorphMemoryStats stats;
+    stats.cpuVertices = vertices_.Capacity() * sizeof(MorphVertex);
+    stats.cpuIndices = indices_.Capacity() * sizeof(i32);
+    for (const auto& pair : morphers_)
+    {
+        stats.cpuMorphs += pair.first_.Capacity() + pair.second_.name.Capacity();
+        stats.cpuMorphs += pair.second_.indexes.Capacity() * sizeof(i32);
+        stats.cpuMorphs += pair.second_.morphDeltas.Capacity() * sizeof(Vector3);
+    }
+    stats.cpuMorphs += basis_.indexes.Capacity() * sizeof(i32);
+    for (const Vector<Vector3>& shape : basis_.shapes)
+        stats.cpuMorphs += shape.Capacity() * sizeof(Vector3);
+    for (const auto& pair : basis_.coefficients)
+        stats.cpuMorphs += pair.second_.Capacity() * sizeof(float);
+    stats.cpuClusters = clusters_.Capacity() * sizeof(MorphCluster);
+    if (bvh_)
+        stats.cpuBVH = bvh_->GetMemoryUse();
+    stats.cpuOccluder = occluder_.positions.Capacity() * sizeof(Vector3) + occluder_.indices.Capacity() * sizeof(i32);
+
+    if (vertexBuffer_)
+    {
+        u64 size = (u64)vertexBuffer_->GetVertexCount() * vertexBuffer_->GetVertexSize();
+        stats.gpuVertices = size;
+        if (vertexBuffer_->IsShadowed())
+            stats.cpuShadow += size;
+    }
+    if (indexBuffer_)
+    {
+        u64 size = (u64)indexBuffer_->GetIndexCount() * indexBuffer_->GetIndexSize();
+        stats.gpuIndices = size;
+        if (indexBuffer_->IsShadowed())
+            stats.cpuShadow += size;
+    }
+    for (const auto& pair : deltaBuffers_)
+    {
+        u64 size = (u64)pair.second_->GetVertexCount() * pair.second_->GetVertexSize();
+        stats.gpuDeltas += size;
+        if (pair.second_->IsShadowed())
+            stats.cpuShadow += size;
+    }
+    return stats;
+}
+
+void MorphMeshData::CollectMorphExtents(Vector<Vector3>& minDelta, Vector<Vector3>& maxDelta) const
+{
+    // Крайние смещения каждой вершины для любого сочетания морфов с весами в [0, 1]: позы (SetPose)
+    // складывают каналы, поэтому по каждой оси суммируются отдельно отрицательные и положительные смещения
+    minDelta = Vector<Vector3>(vertices_.Size(), Vector3::ZERO);
+    maxDelta = Vector<Vector3>(vertices_.Size(), Vector3::ZERO);
+    // Каналы из файла каналов читаются по одному и в памяти не остаются
+    Vector<i32> fileIndexes;
+    Vector<Vector3> fileDeltas;
+    for (const auto& pair : morphers_) {
+        const Vector<i32>* indexes = &pair.second_.indexes;
+        const Vector<Vector3>* morphDeltas = &pair.second_.morphDeltas;
+        auto it = channels_.Find(pair.first_);
+        if (it != channels_.End() && !it->second_.resident) {
+            if (!ReadChannel(pair.first_, it->second_, fileIndexes, fileDeltas))
+                continue;
+            indexes = &fileIndexes;
+            morphDeltas = &fileDeltas;
+        }
+        for (i32 i = 0; i < indexes->Size(); ++i) {
+            i32 index = (*indexes)[i];
+            if (index >= vertices_.Size())
+                continue;
+            minDelta[index] += VectorMin((*morphDeltas)[i], Vector3::ZERO);
+            maxDelta[index] += VectorMax((*morphDeltas)[i], Vector3::ZERO);
+        }
+    }
+
+    Vector<Vector3> deltas;
+    for (const auto& pair : basis_.coefficients) {
+        EvaluateMorphBasis(basis_, pair.first_, 1.0f, deltas);
+        for (i32 i = 0; i < basis_.indexes.Size(); ++i) {
+            i32 index = basis_.indexes[i];
+            if (index >= vertices_.Size())
+                continue;
+            minDelta[index] += VectorMin(deltas[i], Vector3::ZERO);
+            maxDelta[index] += VectorMax(deltas[i], Vector3::ZERO);
+        }
+    }
+}
+
+MorphMeshRegistry::MorphMeshRegistry(Context* context) : Object(context)
+{
+}
+
+MorphMeshData* MorphMeshRegistry::Register(MorphMeshData* data)
+{
+    Vector<WeakPtr<MorphMeshData>>& bucket = meshes_[data->GetContentHash()];
+    for (i32 i = bucket.Size() - 1; i >= 0; --i)
+    {
+        // Меши, которые больше никем не используются, удаляются из реестра
+        if (bucket[i].Expired())
+        {
+            bucket.Erase(i);
+            continue;
+        }
+        if (bucket[i].Get() != data && bucket[i]->IsSameContent(*data))
+        {
+            ++hits_;
+            return bucket[i].Get();
+        }
+    }
+    bucket.Push(WeakPtr<MorphMeshData>(data));
+    return data;
+}
+
+MorphMemoryStats MorphMeshRegistry::GetMemoryStats()
+{
+    MorphMemoryStats stats;
+    for (const auto& pair : meshes_)
+    {
+        for (const WeakPtr<MorphMeshData>& mesh : pair.second_)
+        {
+            if (!mesh.Expired())
+                stats += mesh->GetMemoryStats();
+        }
+    }
+    return stats;
+}
+
+Material* MorphMeshRegistry::GetLayoutMaterial(Material* base, MorphVertexLayout layout, bool hasDeltas)
+{
+    if (!base)
+        return nullptr;
+    String defines = GetMorphLayoutDefines(base->GetVertexShaderDefines(), layout, hasDeltas);
+    if (defines == base->GetVertexShaderDefines().Trimmed())
+        return base;
+
+    for (i32 i = layoutMaterials_.Size() - 1; i >= 0; --i)
+    {
+        if (layoutMaterials_[i].base.Expired())
+        {
+            layoutMaterials_.Erase(i);
+            continue;
+        }
+        if (layoutMaterials_[i].base == base && layoutMaterials_[i].defines == defines)
+            return layoutMaterials_[i].material;
+    }
+
+    // Копия получает свои варианты техник, исходный материал не меняется
+    SharedPtr<Material> material = base->Clone(base->GetName());
+    material->SetVertexShaderDefines(defines);
+    layoutMaterials_.Push({ WeakPtr<Material>(base), defines, material });
+    return material;
+}
+
+Material* MorphMeshRegistry::GetShadowSplitMaterial(Material* base, bool shadowOnly)
+{
+    if (!base)
+        return nullptr;
+    for (i32 i = shadowSplitMaterials_.Size() - 1; i >= 0; --i)
+    {
+        if (shadowSplitMaterials_[i].base.Expired())
+        {
+            shadowSplitMaterials_.Erase(i);
+            continue;
+        }
+        if (shadowSplitMaterials_[i].base == base && shadowSplitMaterials_[i].shadowOnly == shadowOnly)
+            return shadowSplitMaterials_[i].material;
+    }
+
+    // Техники копируются без лишних проходов, определения шейдеров копия применяет к ним заново
+    SharedPtr<Material> material = base->Clone(base->GetName());
+    for (i32 i = 0; i < (i32)material->GetNumTechniques(); ++i)
+    {
+        const TechniqueEntry& entry = material->GetTechniqueEntry(i);
+        if (!entry.original_)
+            continue;
+        SharedPtr<Technique> technique = entry.original_->Clone(entry.original_->GetName());
+        for (const String& pass : entry.original_->GetPassNames())
+        {
+            if ((pass == "shadow") != shadowOnly)
+                technique->RemovePass(pass);
+        }
+        material->SetTechnique(i, technique, entry.qualityLevel_, entry.lodDistance_);
+    }
+    shadowSplitMaterials_.Push({ WeakPtr<Material>(base), shadowOnly, material });
+    return material;
+}
+
+void CreateMorphWeightMaterials(Material* base, Vector<SharedPtr<Material>>& materials)
+{
+    materials.Resize(MORPH_WEIGHT_LEVELS);
+    for (i32 level = 0; level < MORPH_WEIGHT_LEVELS; ++level)
+    {
+        materials[level] = base->Clone(base->GetName());
+        materials[level]->SetShaderParameter("MorphWeight", (float)level / (MORPH_WEIGHT_LEVELS - 1));
+    }
+}
+
+const Vector<SharedPtr<Material>>& MorphMeshRegistry::GetWeightMaterials(Material* base)
+{
+    for (i32 i = weightMaterials_.Size() - 1; i >= 0; --i)
+    {
+        if (weightMaterials_[i].base.Expired())
+        {
+            weightMaterials_.Erase(i);
+            continue;
+        }
+        if (weightMaterials_[i].base == base)
+            return weightMaterials_[i].materials;
+    }
+
+    // Material::SetShaderParameter выделяет память, поэтому копии создаются один раз, а не при смене веса
+    weightMaterials_.Push({ WeakPtr<Material>(base), Vector<SharedPtr<Material>>() });
+    CreateMorphWeightMaterials(base, weightMaterials_.Back().materials);
+    return weightMaterials_.Back().materials;
+}
+
+String MorphMeshRegistry::GetChannelCacheDir() const
+{
+    if (!channelCacheDir_.Empty())
+        return channelCacheDir_;
+    return GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "morphchannels");
+}
+
+void MorphMeshRegistry::EnforceChannelBudget()
+{
+    struct Candidate
+    {
+        MorphMeshData* mesh;
+        String channel;
+        u32 lastUse;
+        u64 memory;
+    };
+
+    u64 total = 0;
+    Vector<Candidate> candidates;
+    for (const auto& pair : meshes_)
+    {
+        for (const WeakPtr<MorphMeshData>& mesh : pair.second_)
+        {
+            if (mesh.Expired())
+                continue;
+            for (const auto& channel : mesh->GetChannels())
+            {
+                if (!channel.second_.resident)
+                    continue;
+                u64 memory = mesh->GetChannelMemory(channel.first_);
+                total += memory;
+                // Последний использованный канал ещё нужен вызывающему
+                if (channel.second_.lastUse != channelUse_ && !mesh->IsChannelInUse(channel.first_))
+                    candidates.Push({ mesh.Get(), channel.first_, channel.second_.lastUse, memory });
+            }
+        }
+    }
+    if (total <= channelBudget_)
+        return;
+
+    Sort(candidates.Begin(), candidates.End(), [](const Candidate& lhs, const Candidate& rhs) { return lhs.lastUse < rhs.lastUse; });
+    for (const Candidate& candidate : candidates)
+    {
+        if (total <= channelBudget_)
+            break;
+        if (candidate.mesh->EvictChannel(candidate.channel))
+        {
+            total -= candidate.memory;
+            ++channelEvictions_;
+        }
+    }
+}
+
+u64 MorphMeshRegistry::GetChannelMemory()
+{
+    u64 total = 0;
+    for (const auto& pair : meshes_)
+    {
+        for (const WeakPtr<MorphMeshData>& mesh : pair.second_)
+        {
+            if (mesh.Expired())
+                continue;
+            for (const auto& channel : mesh->GetChannels())
+            {
+                if (channel.second_.resident)
+                    total += mesh->GetChannelMemory(channel.first_);
+            }
+        }
+    }
+    return total;
+}
+
+i32 MorphMeshRegistry::GetNumResidentChannels()
+{
+    i32 count = 0;
+    for (const auto& pair : meshes_)
+    {
+        for (const WeakPtr<MorphMeshData>& mesh : pair.second_)
+        {
+            if (mesh.Expired())
+                continue;
+            for (const auto& channel : mesh->GetChannels())
+            {
+                if (channel.second_.resident)
+                    ++count;
+            }
+        }
+    }
+    return count;
+}
+
+i32 MorphMeshRegistry::GetNumMeshes()
+{
+    i32 count = 0;
+    for (const auto& pair : meshes_)
+    {
+        for (const WeakPtr<MorphMeshData>& mesh : pair.second_)
+        {
+            if (!mesh.Expired())
+                ++count;
+        }
+    }
+    return count;
+}
+
+}
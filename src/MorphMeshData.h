@@ -0,0 +1,323 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/GraphicsAPI/VertexBuffer.h>
+#include <Urho3D/GraphicsAPI/IndexBuffer.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Math/Vector2.h>
+#include <Urho3D/Math/Vector3.h>
+#include <Urho3D/Math/Vector4.h>
+#include "MorphClusters.h"
+#include "MorphCompression.h"
+#include "MorphBVH.h"
+#include "MorphVertexLayout.h"
+#include "MorphOccluder.h"
+
+namespace Urho3D
+{
+
+struct Morpher
+{
+    String name;
+    Vector<i32> indexes;
+    Vector<Vector3> morphDeltas;
+};
+
+// Что остаётся в памяти после загрузки буферов на GPU
+enum MorphResidency
+{
+    // CPU-копии, теневые копии буферов и все данные морфов
+    MORPH_RESIDENCY_KEEP_ALL,
+    // Только данные морфов, нужные для построения потоков смещений. Иерархия для лучей тоже
+    // выгружается, в этом и следующих режимах лучи проверяются по границам меша
+    MORPH_RESIDENCY_GPU_ONLY,
+    // Ничего на CPU. При первой смене морфа каналы перечитываются из исходного файла и переносятся
+    // в файл каналов, после этого меш работает как MORPH_RESIDENCY_LAZY
+    MORPH_RESIDENCY_RELOAD,
+    // Каналы хранятся в файле каналов и подгружаются по одному при первом использовании.
+    // Неиспользуемые каналы вытесняются в пределах бюджета MorphMeshRegistry
+    MORPH_RESIDENCY_LAZY,
+};
+
+// Сведения о канале, которые остаются в памяти и без его данных
+struct MorphChannelInfo
+{
+    // Количество смещённых вершин
+    i32 count = 0;
+    // Границы смещений канала
+    BoundingBox bounds;
+    // Положение и размер сжатых данных канала в файле каналов
+    u32 offset = 0;
+    u32 size = 0;
+    bool resident = true;
+    // Хэши данных канала, чтобы хэш меша считался без чтения файла каналов
+    u64 hash = 0;
+    u64 check = 0;
+    // Отметка последнего использования для вытеснения
+    u32 lastUse = 0;
+};
+
+// Расход памяти в байтах
+struct MorphMemoryStats
+{
+    u64 cpuVertices = 0;
+    u64 cpuIndices = 0;
+    u64 cpuMorphs = 0;
+    u64 cpuClusters = 0;
+    u64 cpuBVH = 0;
+    u64 cpuOccluder = 0;
+    // Теневые копии буферов
+    u64 cpuShadow = 0;
+    u64 gpuVertices = 0;
+    u64 gpuIndices = 0;
+    u64 gpuDeltas = 0;
+
+    u64 GetCpuTotal() const { return cpuVertices + cpuIndices + cpuMorphs + cpuClusters + cpuBVH + cpuOccluder + cpuShadow; }
+    u64 GetGpuTotal() const { return gpuVertices + gpuIndices + gpuDeltas; }
+    MorphMemoryStats& operator +=(const MorphMemoryStats& rhs);
+};
+
+class MorphMeshData;
+
+// Бюджет памяти лениво загружаемых каналов по умолчанию
+static const u64 MORPH_DEFAULT_CHANNEL_BUDGET = 64 * 1024 * 1024;
+
+/// Reload morph channels of a mesh from its source file. Returns false if the source is unavailable.
+typedef bool (*MorphMeshReloader)(MorphMeshData* data);
+
+// Сконвертированный меш с морфами. Один экземпляр разделяется всеми MorphGeometry
+// с одинаковым содержимым, вместе с вершинным и индексным буферами.
+class MorphMeshData : public Object
+{
+    URHO3D_OBJECT(MorphMeshData, Object);
+
+public:
+    explicit MorphMeshData(Context* context);
+    ~MorphMeshData() override;
+
+    void SetVertices(const Vector<MorphVertex>& vertices);
+    void SetIndices(const Vector<i32>& indices);
+    /// Add a morph channel. After BeginChannelFile() channels outside the basis go straight to the channel file.
+    void AddMorpher(const Morpher& morpher);
+    /// Start writing channels to the channel file as they are added, so that an imported LAZY mesh never holds
+    /// all of them in memory. Call after SetResidency() and SetMorphBasis(). Returns false if channels stay in memory.
+    bool BeginChannelFile();
+    void SetMorphBasis(const MorphBasis& basis);
+    /// Replace morph channels after a reload, keeping the residency policy.
+    void RestoreMorphers(const HashMap<String, Morpher>& morphers, const MorphBasis& basis);
+    /// Set how Commit() builds the occluder.
+    void SetOccluderSettings(const MorphOccluderSettings& settings) { occluderSettings_ = settings; }
+    /// Set the GPU vertex format. Must be called before Commit().
+    void SetVertexLayout(MorphVertexLayout layout) { layout_ = layout; }
+    MorphVertexLayout GetVertexLayout() const { return layout_; }
+    /// Return whether the geometry has a delta stream, false for meshes without morph channels.
+    bool HasDeltaStream() const { return !morphers_.Empty(); }
+    void SetResidency(MorphResidency residency) { residency_ = residency; }
+    MorphResidency GetResidency() const { return residency_; }
+    void SetSource(const String& fileName, const String& meshName);
+    const String& GetSourceFile() const { return sourceFile_; }
+    const String& GetSourceMesh() const { return sourceMesh_; }
+    /// Copy the source data into a new, not yet committed instance.
+    SharedPtr<MorphMeshData> Clone() const;
+
+    /// Hash the source data. Must be called before lookup in the registry.
+    void CalculateHash();
+    /// Build clusters, bounds and the raycast BVH. Buffers are uploaded on the first GetGeometry().
+    /// Logs an error and returns false if there are no vertices or indices, e.g. in a clone of data
+    /// whose CPU copies were already dropped.
+    bool Commit();
+    bool IsCommitted() const { return committed_; }
+    bool IsSameContent(const MorphMeshData& other) const;
+
+    /// Return geometry with the delta stream of the given morph (zero deltas for an empty name).
+    Geometry* GetGeometry(const String& morph);
+    VertexBuffer* GetVertexBuffer() const { return vertexBuffer_; }
+    IndexBuffer* GetIndexBuffer() const { return indexBuffer_; }
+    VertexBuffer* GetDeltaBuffer(const String& morph);
+    /// Sum the deltas of the channels with the given weights into deltas, reusing its storage. Returns false
+    /// if the channels can't be made resident. Main thread only.
+    bool EvaluatePose(const Vector<String>& morphs, const Vector<float>& weights, Vector<Vector3>& deltas);
+    /// Create a delta stream that isn't cached by the mesh data.
+    SharedPtr<VertexBuffer> CreateDeltaBuffer(const Vector<Vector3>& deltas, bool dynamic = false);
+    /// Create geometry that draws the shared buffers with the given delta stream (none if null).
+    SharedPtr<Geometry> CreateGeometry(VertexBuffer* deltaBuffer);
+    /// Return the sparse deltas of a channel at full weight. Returns false if the channel isn't resident.
+    bool GetChannelDeltas(const String& morph, Vector<i32>& indexes, Vector<Vector3>& deltas) const;
+    /// Load the data of a lazily resident channel from the channel file. Main thread only.
+    bool EnsureChannelResident(const String& morph);
+    /// Return whether the data of a channel is in memory. Doesn't load it.
+    bool IsChannelResident(const String& morph) const;
+    /// Drop the data and the cached delta stream of a lazily resident channel. Returns false if it's in use.
+    bool EvictChannel(const String& morph);
+    /// Return whether a component draws the channel's cached geometry.
+    bool IsChannelInUse(const String& morph) const;
+    /// Return CPU and GPU bytes held by a lazily resident channel.
+    u64 GetChannelMemory(const String& morph) const;
+    const HashMap<String, MorphChannelInfo>& GetChannels() const { return channels_; }
+    const String& GetChannelFile() const { return channelFile_; }
+
+    const Vector<MorphVertex>& GetVertices() const { return vertices_; }
+    const Vector<i32>& GetIndices() const { return indices_; }
+    const HashMap<String, Morpher>& GetMorphers() const { return morphers_; }
+    const MorphBasis& GetMorphBasis() const { return basis_; }
+    const Vector<MorphCluster>& GetClusters() const { return clusters_; }
+    MorphBVH* GetBVH() const { return bvh_; }
+    /// Return the simplified, shrunk triangles for the occlusion buffer. Empty if the mesh isn't an occluder.
+    const MorphOccluder& GetOccluder() const { return occluder_; }
+    bool HasOccluder() const { return !occluder_.indices.Empty(); }
+    const BoundingBox& GetBoundingBox() const { return boundingBox_; }
+    u64 GetContentHash() const { return contentHash_; }
+    i32 GetVertexCount() const { return vertexCount_; }
+    i32 GetIndexCount() const { return indexCount_; }
+    MorphMemoryStats GetMemoryStats() const;
+
+private:
+    void UploadBuffers();
+    void ApplyResidency();
+    bool EnsureMorphersResident();
+    void CollectMorphExtents(Vector<Vector3>& minDelta, Vector<Vector3>& maxDelta) const;
+    void EvaluateDeltas(const String& morph, Vector<Vector3>& deltas) const;
+    i32 GetMorpherCount(const String& morph, const Morpher& morpher) const;
+    u64 HashContent(u64 hash, u64 (*function)(u64, const void*, i32)) const;
+    void WriteChannelFile();
+    bool WriteChannel(const Morpher& morpher);
+    void FinishChannelFile();
+    String GetChannelFileName(const String& dir) const;
+    bool IsChannelFile(const String& fileName, u32 size) const;
+    bool ReadChannel(const String& morph, const MorphChannelInfo& info, Vector<i32>& indexes, Vector<Vector3>& deltas) const;
+
+    Vector<MorphVertex> vertices_;
+    Vector<i32> indices_;
+    HashMap<String, Morpher> morphers_;
+    // Сжатые каналы. Для них в morphers_ хранится только имя
+    MorphBasis basis_;
+    // Смещения канала из базиса, память переиспользуется в EvaluatePose()
+    Vector<Vector3> basisDeltas_;
+    Vector<MorphCluster> clusters_;
+    // Иерархия треугольников для лучей, выгружается вместе с вершинами
+    SharedPtr<MorphBVH> bvh_;
+    MorphOccluderSettings occluderSettings_;
+    MorphOccluder occluder_;
+    BoundingBox boundingBox_;
+    u64 contentHash_ = 0;
+    // Второй, независимый хэш на случай, когда CPU-копии выгружены
+    u64 contentCheck_ = 0;
+    bool committed_ = false;
+    // Размеры сохраняются отдельно, CPU-копии могут быть выгружены
+    i32 vertexCount_ = 0;
+    i32 indexCount_ = 0;
+    MorphVertexLayout layout_ = MORPH_LAYOUT_FULL;
+    MorphResidency residency_ = MORPH_RESIDENCY_KEEP_ALL;
+    bool morphersResident_ = true;
+    String sourceFile_;
+    String sourceMesh_;
+    // Несжатые каналы при MORPH_RESIDENCY_LAZY и файл с их данными
+    HashMap<String, MorphChannelInfo> channels_;
+    String channelFile_;
+    // Файл каналов, который пишется при импорте до Commit()
+    SharedPtr<File> channelWriter_;
+
+    SharedPtr<VertexBuffer> vertexBuffer_;
+    SharedPtr<IndexBuffer> indexBuffer_;
+    // Поток смещений (второй вершинный буфер) и геометрия для каждого использованного морфа
+    HashMap<String, SharedPtr<VertexBuffer>> deltaBuffers_;
+    HashMap<String, SharedPtr<Geometry>> geometries_;
+};
+
+// Уровней веса в копиях материала для графики без буфера весов
+static const i32 MORPH_WEIGHT_LEVELS = 256;
+
+/// Return the weight level whose material copy draws the weight.
+inline i32 GetMorphWeightLevel(float weight)
+{
+    return RoundToInt(Clamp(weight, 0.0f, 1.0f) * (MORPH_WEIGHT_LEVELS - 1));
+}
+
+/// Fill materials with MORPH_WEIGHT_LEVELS copies of the base material, each with its level in the MorphWeight parameter.
+void CreateMorphWeightMaterials(Material* base, Vector<SharedPtr<Material>>& materials);
+
+// Реестр мешей по хэшу содержимого: одинаковые меши из разных узлов и файлов
+// получают один и тот же MorphMeshData
+class MorphMeshRegistry : public Object
+{
+    URHO3D_OBJECT(MorphMeshRegistry, Object);
+
+public:
+    explicit MorphMeshRegistry(Context* context);
+
+    /// Return an already registered mesh with the same content, or register and return data.
+    MorphMeshData* Register(MorphMeshData* data);
+    i32 GetNumMeshes();
+    i32 GetNumHits() const { return hits_; }
+    /// Return memory of all live meshes, shared meshes are counted once.
+    MorphMemoryStats GetMemoryStats();
+    void SetReloader(MorphMeshReloader reloader) { reloader_ = reloader; }
+    MorphMeshReloader GetReloader() const { return reloader_; }
+    /// Return the material with vertex shader defines for the mesh layout, the base material if they already match.
+    Material* GetLayoutMaterial(Material* base, MorphVertexLayout layout, bool hasDeltas);
+    /// Return the copy of the material whose techniques keep only the shadow pass (shadowOnly) or every pass but it.
+    Material* GetShadowSplitMaterial(Material* base, bool shadowOnly);
+    /// Return the copies of the material for each weight level, see CreateMorphWeightMaterials().
+    const Vector<SharedPtr<Material>>& GetWeightMaterials(Material* base);
+
+    /// Set the bytes lazily resident channels may hold on CPU and GPU together.
+    void SetChannelBudget(u64 budget) { channelBudget_ = budget; }
+    u64 GetChannelBudget() const { return channelBudget_; }
+    /// Set the directory for channel files, the application preferences directory by default.
+    void SetChannelCacheDir(const String& dir) { channelCacheDir_ = dir; }
+    String GetChannelCacheDir() const;
+    /// Return a new use stamp for a lazily resident channel.
+    u32 TouchChannel() { return ++channelUse_; }
+    void OnChannelLoaded() { ++channelLoads_; }
+    /// Evict least recently used channels that no component draws until they fit the budget.
+    void EnforceChannelBudget();
+    /// Return bytes held by lazily resident channels.
+    u64 GetChannelMemory();
+    i32 GetNumResidentChannels();
+    i32 GetNumChannelLoads() const { return channelLoads_; }
+    i32 GetNumChannelEvictions() const { return channelEvictions_; }
+
+private:
+    struct LayoutMaterial
+    {
+        WeakPtr<Material> base;
+        String defines;
+        SharedPtr<Material> material;
+    };
+
+    struct ShadowSplitMaterial
+    {
+        WeakPtr<Material> base;
+        bool shadowOnly;
+        SharedPtr<Material> material;
+    };
+
+    struct WeightMaterials
+    {
+        WeakPtr<Material> base;
+        Vector<SharedPtr<Material>> materials;
+    };
+
+    HashMap<u64, Vector<WeakPtr<MorphMeshData>>> meshes_;
+    // Копии материалов с определениями формата вершин, общие для всех мешей одного формата
+    Vector<LayoutMaterial> layoutMaterials_;
+    // Копии материалов, разделённые на теневой проход и остальные
+    Vector<ShadowSplitMaterial> shadowSplitMaterials_;
+    // Копии материалов по уровням веса, когда буфера весов нет
+    Vector<WeightMaterials> weightMaterials_;
+    u64 channelBudget_ = MORPH_DEFAULT_CHANNEL_BUDGET;
+    String channelCacheDir_;
+    u32 channelUse_ = 0;
+    i32 channelLoads_ = 0;
+    i32 channelEvictions_ = 0;
+    MorphMeshReloader reloader_ = nullptr;
+    i32 hits_ = 0;
+};
+
+}
@@ -0,0 +1,119 @@
+#include "MorphModel.h"
+#include "FBXLoader.h"
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+
+namespace Urho3D
+{
+
+MorphModel::MorphModel(Context* context) : ResourceWithMetadata(context)
+{
+}
+
+void MorphModel::RegisterObject(Context* context)
+{
+    context->RegisterFactory<MorphModel>();
+}
+
+bool MorphModel::BeginLoad(Deserializer& source)
+{
+    Log* log = GetSubsystem<Log>();
+    auto* cache = GetSubsystem<ResourceCache>();
+
+    // FBX SDK читает только файлы на диске, ресурсы из пакетов не поддерживаются
+    String fileName = cache->GetResourceFileName(GetName());
+    if (fileName.Empty())
+    {
+        log->Write(LOG_ERROR, "MorphModel " + GetName() + " must be a file on disk");
+        return false;
+    }
+
+    FBXImportOptions options;
+    String paramsName = ReplaceExtension(GetName(), ".xml");
+    if (cache->Exists(paramsName))
+    {
+        SharedPtr<XMLFile> params = cache->GetTempResource<XMLFile>(paramsName, false);
+        XMLElement root = params ? params->GetRoot("morphmodel") : XMLElement();
+        if (root)
+        {
+            if (root.HasAttribute("compress"))
+                options.compressMorphs = root.GetBool("compress");
+            if (root.HasAttribute("merge"))
+                options.mergeStaticMeshes = root.GetBool("merge");
+            if (root.HasAttribute("occluders"))
+                options.occluders.enabled = root.GetBool("occluders");
+            String residency = root.GetAttributeLower("residency");
+            if (residency == "gpuonly")
+                options.residency = MORPH_RESIDENCY_GPU_ONLY;
+            else if (residency == "reload")
+                options.residency = MORPH_RESIDENCY_RELOAD;
+            else if (residency == "lazy")
+                options.residency = MORPH_RESIDENCY_LAZY;
+            String profile = root.GetAttributeLower("profile");
+            if (profile == "full")
+                options.profile = FBX_PROFILE_FULL;
+            else if (profile == "geometry")
+                options.profile = FBX_PROFILE_GEOMETRY;
+            String parser = root.GetAttributeLower("parser");
+            if (parser == "sdk")
+                options.parser = FBX_PARSER_SDK;
+            else if (parser == "native")
+                options.parser = FBX_PARSER_NATIVE;
+        }
+    }
+
+    loadMeshes_.Clear();
+    Vector<SharedPtr<MorphMeshData>> meshes;
+    if (!LoadFBXMeshes(context_, fileName, options, meshes))
+        return false;
+
+    // Кластеры и границы не требуют GPU, поэтому строятся здесь, в том числе на фоновом потоке
+    u64 memoryUse = sizeof(MorphModel);
+    for (const SharedPtr<MorphMeshData>& data : meshes)
+    {
+        if (!data->GetVertexCount() || !data->GetIndexCount())
+        {
+            log->Write(LOG_WARNING, "Skip empty mesh " + data->GetSourceMesh() + " of " + GetName());
+            continue;
+        }
+        if (!data->Commit())
+            continue;
+        memoryUse += data->GetMemoryStats().GetCpuTotal();
+        loadMeshes_.Push(data);
+    }
+    SetMemoryUse(memoryUse);
+    return true;
+}
+
+bool MorphModel::EndLoad()
+{
+    // Реестр не потокобезопасен, одинаковые меши заменяются уже загруженными
+    auto* registry = GetSubsystem<MorphMeshRegistry>();
+    meshes_.Clear();
+    for (MorphMeshData* data : loadMeshes_)
+        meshes_.Push(SharedPtr<MorphMeshData>(registry ? registry->Register(data) : data));
+    loadMeshes_.Clear();
+    GetSubsystem<Log>()->Write(LOG_INFO, "Loaded MorphModel " + GetName() + " with " + String(meshes_.Size()) + " meshes");
+    return true;
+}
+
+MorphMeshData* MorphModel::GetMesh(i32 index) const
+{
+    return index >= 0 && index < meshes_.Size() ? meshes_[index].Get() : nullptr;
+}
+
+MorphMeshData* MorphModel::GetMesh(const String& name) const
+{
+    for (const SharedPtr<MorphMeshData>& data : meshes_)
+    {
+        if (data->GetSourceMesh() == name)
+            return data;
+    }
+    return nullptr;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Urho3D/Resource/Resource.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include "MorphMeshData.h"
+
+namespace Urho3D
+{
+
+// Ресурс с мешами FBX-файла. Загружается через ResourceCache, в том числе в фоне: импорт, кластеры
+// и хэши считаются в BeginLoad, в EndLoad меши только регистрируются в MorphMeshRegistry.
+// Параметры импорта берутся из XML-файла рядом с FBX (repo.fbx -> repo.xml), если он есть:
+//   <morphmodel compress="true" merge="true" occluders="true" residency="keepall|gpuonly|reload|lazy" />
+class MorphModel : public ResourceWithMetadata
+{
+    URHO3D_OBJECT(MorphModel, ResourceWithMetadata);
+
+public:
+    explicit MorphModel(Context* context);
+    ~MorphModel() override = default;
+    static void RegisterObject(Context* context);
+
+    bool BeginLoad(Deserializer& source) override;
+    bool EndLoad() override;
+
+    i32 GetNumMeshes() const { return meshes_.Size(); }
+    const Vector<SharedPtr<MorphMeshData>>& GetMeshes() const { return meshes_; }
+    MorphMeshData* GetMesh(i32 index) const;
+    /// Return the mesh imported from the FBX node with the given name, or null.
+    MorphMeshData* GetMesh(const String& name) const;
+
+private:
+    // Меши, загруженные в BeginLoad и ещё не зарегистрированные
+    Vector<SharedPtr<MorphMeshData>> loadMeshes_;
+    Vector<SharedPtr<MorphMeshData>> meshes_;
+};
+
+}
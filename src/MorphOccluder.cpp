@@ -0,0 +1,133 @@
+#include "MorphOccluder.h"
+#include "MorphMeshData.h"
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+#include <cmath>
+
+namespace Urho3D
+{
+
+struct OccluderCell
+{
+    Vector3 position;
+    Vector3 normal;
+    // Наибольший сдвиг вершин ячейки морфами
+    float morphOffset;
+    i32 count;
+};
+
+static u64 PackTriangle(i32 a, i32 b, i32 c)
+{
+    // Треугольник с тем же обходом, начатым с другой вершины, считается тем же
+    if (b < a && b < c)
+        return PackTriangle(b, c, a);
+    if (c < a && c < b)
+        return PackTriangle(c, a, b);
+    return ((u64)a << 42) | ((u64)b << 21) | (u64)c;
+}
+
+bool BuildMorphOccluder(const Vector<MorphVertex>& vertices, const Vector<i32>& indices,
+    const Vector<Vector3>& minDelta, const Vector<Vector3>& maxDelta, const MorphOccluderSettings& settings,
+    MorphOccluder& occluder)
+{
+    occluder.positions.Clear();
+    occluder.indices.Clear();
+    if (vertices.Empty() || indices.Size() < 3)
+        return false;
+
+    BoundingBox box;
+    for (const MorphVertex& vertex : vertices)
+        box.Merge(vertex.position_);
+    const Vector3 size = box.Size();
+    if (size.Length() < settings.minSize)
+        return false;
+    const float cellSize = Max(Max(size.x_, size.y_), size.z_) / Max(settings.gridSize, 1);
+    if (cellSize <= 0.0f)
+        return false;
+
+    // Кластеризация вершин по ячейкам сетки
+    HashMap<u64, i32> cellIndices;
+    Vector<OccluderCell> cells;
+    Vector<i32> vertexCells(vertices.Size());
+    for (i32 i = 0; i < vertices.Size(); ++i)
+    {
+        const Vector3 local = (vertices[i].position_ - box.min_) / cellSize;
+        const u64 key = ((u64)FloorToInt(local.x_) << 42) | ((u64)FloorToInt(local.y_) << 21) | (u64)FloorToInt(local.z_);
+        auto it = cellIndices.Find(key);
+        i32 cell;
+        if (it == cellIndices.End())
+        {
+            cell = cells.Size();
+            cellIndices[key] = cell;
+            cells.Push({ Vector3::ZERO, Vector3::ZERO, 0.0f, 0 });
+        }
+        else
+            cell = it->second_;
+        vertexCells[i] = cell;
+        OccluderCell& c = cells[cell];
+        c.position += vertices[i].position_;
+        c.normal += vertices[i].normal_;
+        // Оси смещения независимы: наибольшее по модулю смещение по каждой оси из границ суммы каналов
+        if (i < minDelta.Size())
+            c.morphOffset = Max(c.morphOffset, VectorMax(maxDelta[i], -minDelta[i]).Length());
+        ++c.count;
+    }
+
+    // Вершина ячейки отходит от поверхности не дальше диагонали ячейки, на столько же она и сдвигается внутрь.
+    // Ячейки с разнонаправленными нормалями (тонкие части, острые углы) не могут быть сдвинуты надёжно
+    const float shrink = cellSize * 1.7321f;
+    Vector<bool> cellValid(cells.Size());
+    Vector<Vector3> positions(cells.Size());
+    for (i32 i = 0; i < cells.Size(); ++i)
+    {
+        OccluderCell& c = cells[i];
+        const float normalLength = c.normal.Length();
+        cellValid[i] = normalLength > c.count * 0.5f;
+        const Vector3 center = c.position / (float)c.count;
+        positions[i] = cellValid[i] ? center - c.normal / normalLength * (shrink + c.morphOffset) : center;
+    }
+
+    HashSet<u64> triangles;
+    Vector<i32> cellVertices(cells.Size(), -1);
+    for (i32 t = 0; t + 2 < indices.Size(); t += 3)
+    {
+        const i32 a = vertexCells[indices[t]];
+        const i32 b = vertexCells[indices[t + 1]];
+        const i32 c = vertexCells[indices[t + 2]];
+        if (a == b || b == c || a == c || !cellValid[a] || !cellValid[b] || !cellValid[c])
+            continue;
+
+        // Сжатый треугольник должен смотреть туда же, что и исходный
+        const Vector3& p0 = vertices[indices[t]].position_;
+        const Vector3 sourceNormal = (vertices[indices[t + 1]].position_ - p0).CrossProduct(vertices[indices[t + 2]].position_ - p0);
+        const Vector3 shrunkNormal = (positions[b] - positions[a]).CrossProduct(positions[c] - positions[a]);
+        if (sourceNormal.DotProduct(shrunkNormal) <= 0.0f)
+            continue;
+        const u64 key = PackTriangle(a, b, c);
+        if (triangles.Contains(key))
+            continue;
+        triangles.Insert(key);
+
+        for (i32 cell : { a, b, c })
+        {
+            if (cellVertices[cell] < 0)
+            {
+                cellVertices[cell] = occluder.positions.Size();
+                occluder.positions.Push(positions[cell]);
+            }
+            occluder.indices.Push(cellVertices[cell]);
+        }
+    }
+
+    if (occluder.indices.Empty() || occluder.indices.Size() / 3 > settings.maxTriangles)
+    {
+        occluder.positions.Clear();
+        occluder.indices.Clear();
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D
+{
+
+struct MorphVertex;
+
+struct MorphOccluderSettings
+{
+    // Строить окклюдер при импорте
+    bool enabled = false;
+    // Меши с меньшей диагональю границ окклюдерами не становятся
+    float minSize = 2.0f;
+    // Количество ячеек сетки упрощения вдоль самой длинной стороны
+    i32 gridSize = 16;
+    // Ограничение треугольников окклюдера, больший результат отбрасывается
+    i32 maxTriangles = 2000;
+};
+
+// Упрощённая и сжатая внутрь копия меша для программного буфера перекрытия
+struct MorphOccluder
+{
+    Vector<Vector3> positions;
+    Vector<i32> indices;
+};
+
+/// Simplify the mesh by vertex clustering and move every vertex inwards along its normal by the
+/// cluster size plus the largest morph offset, so the occluder stays inside the surface in any pose.
+/// Triangles that flip while shrinking (thin parts) are dropped. Returns false if nothing remains.
+/// minDelta and maxDelta bound the per-vertex offset of any combination of morphs with weights in [0, 1],
+/// as for BuildMorphClusters.
+bool BuildMorphOccluder(const Vector<MorphVertex>& vertices, const Vector<i32>& indices,
+    const Vector<Vector3>& minDelta, const Vector<Vector3>& maxDelta, const MorphOccluderSettings& settings,
+    MorphOccluder& occluder);
+
+}
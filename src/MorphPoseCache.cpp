@@ -0,0 +1,103 @@
+#include "MorphPoseCache.h"
+#include "MorphMeshData.h"
+#include <Urho3D/Math/MathDefs.h>
+
+namespace Urho3D
+{
+
+MorphPoseKey MorphPoseCache::MakeKey(const Vector<float>& weights)
+{
+    MorphPoseKey key;
+    key.weights.Resize(weights.Size());
+    // FNV-1a по квантованным весам
+    u32 hash = 2166136261u;
+    for (i32 i = 0; i < weights.Size(); ++i)
+    {
+        key.weights[i] = (u8)RoundToInt(Clamp(weights[i], 0.0f, 1.0f) * MORPH_POSE_WEIGHT_LEVELS);
+        hash = (hash ^ key.weights[i]) * 16777619u;
+    }
+    key.hash = hash;
+    return key;
+}
+
+MorphPose* MorphPoseCache::Get(MorphMeshData* data, const Vector<String>& morphs, const Vector<float>& weights)
+{
+    MorphPoseKey key = MakeKey(weights);
+    auto it = poses_.Find(key);
+    if (it != poses_.End())
+    {
+        ++hits_;
+        it->second_->lastUse = ++useCounter_;
+        return it->second_;
+    }
+
+    // Промах: поза вычисляется обычным путём по квантованным весам, чтобы совпадать с ключом
+    ++misses_;
+    Vector<float> quantized(key.weights.Size());
+    for (i32 i = 0; i < key.weights.Size(); ++i)
+        quantized[i] = key.weights[i] / (float)MORPH_POSE_WEIGHT_LEVELS;
+
+    SharedPtr<MorphPose> pose(new MorphPose());
+    if (!data->EvaluatePose(morphs, quantized, pose->deltas))
+        return nullptr;
+    pose->deltaBuffer = data->CreateDeltaBuffer(pose->deltas);
+    pose->geometry = data->CreateGeometry(pose->deltaBuffer);
+    pose->key = key;
+    pose->lastUse = ++useCounter_;
+
+    Evict(poses_.Size() + 1 - capacity_);
+    poses_[key] = pose;
+    return pose;
+}
+
+void MorphPoseCache::Evict(i32 count)
+{
+    // Кэш небольшой, поэтому самая старая поза ищется перебором
+    for (; count > 0 && !poses_.Empty(); --count)
+    {
+        auto oldest = poses_.Begin();
+        for (auto it = poses_.Begin(); it != poses_.End(); ++it)
+        {
+            if (it->second_->lastUse < oldest->second_->lastUse)
+                oldest = it;
+        }
+        poses_.Erase(oldest);
+        ++evictions_;
+    }
+}
+
+void MorphPoseCache::Clear()
+{
+    poses_.Clear();
+}
+
+void MorphPoseCache::SetCapacity(i32 capacity)
+{
+    capacity_ = Max(capacity, 1);
+    Evict(poses_.Size() - capacity_);
+}
+
+void MorphPoseCache::ResetStats()
+{
+    hits_ = 0;
+    misses_ = 0;
+    evictions_ = 0;
+}
+
+u64 MorphPoseCache::GetGpuMemory() const
+{
+    u64 size = 0;
+    for (const auto& pair : poses_)
+        size += (u64)pair.second_->deltaBuffer->GetVertexCount() * pair.second_->deltaBuffer->GetVertexSize();
+    return size;
+}
+
+u64 MorphPoseCache::GetCpuMemory() const
+{
+    u64 size = 0;
+    for (const auto& pair : poses_)
+        size += pair.second_->deltas.Capacity() * sizeof(Vector3) + pair.second_->key.weights.Capacity();
+    return size;
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/GraphicsAPI/VertexBuffer.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D
+{
+
+class MorphMeshData;
+
+// Число уровней квантования веса в ключе позы
+static const i32 MORPH_POSE_WEIGHT_LEVELS = 255;
+static const i32 MORPH_POSE_DEFAULT_CAPACITY = 32;
+
+// Веса каналов по номерам морферов, квантованные до MORPH_POSE_WEIGHT_LEVELS
+struct MorphPoseKey
+{
+    Vector<u8> weights;
+    u32 hash = 0;
+
+    bool operator ==(const MorphPoseKey& rhs) const { return hash == rhs.hash && weights == rhs.weights; }
+    bool operator !=(const MorphPoseKey& rhs) const { return !(*this == rhs); }
+    u32 ToHash() const { return hash; }
+};
+
+// Полностью вычисленная поза: сумма смещений всех каналов
+struct MorphPose : public RefCounted
+{
+    MorphPoseKey key;
+    // Копия для плавного перехода между позами
+    Vector<Vector3> deltas;
+    SharedPtr<VertexBuffer> deltaBuffer;
+    SharedPtr<Geometry> geometry;
+    u32 lastUse = 0;
+};
+
+// LRU-кэш поз одного MorphGeometry. Липсинк и мимика раз за разом повторяют небольшой набор
+// сочетаний весов (виземы, выражения покоя), поэтому их смещения вычисляются один раз и
+// остаются на GPU до вытеснения
+class MorphPoseCache
+{
+public:
+    /// Quantize the weights into a cache key.
+    static MorphPoseKey MakeKey(const Vector<float>& weights);
+
+    /// Return the cached pose, evaluating it through MorphMeshData on a miss. Returns null on failure.
+    MorphPose* Get(MorphMeshData* data, const Vector<String>& morphs, const Vector<float>& weights);
+    void Clear();
+
+    /// Set the maximum number of poses. Least recently used poses are evicted.
+    void SetCapacity(i32 capacity);
+    i32 GetCapacity() const { return capacity_; }
+    i32 GetNumPoses() const { return poses_.Size(); }
+    u32 GetNumHits() const { return hits_; }
+    u32 GetNumMisses() const { return misses_; }
+    u32 GetNumEvictions() const { return evictions_; }
+    void ResetStats();
+    /// Return the GPU size of the cached delta streams in bytes.
+    u64 GetGpuMemory() const;
+    /// Return the CPU size of the cached deltas in bytes.
+    u64 GetCpuMemory() const;
+
+private:
+    void Evict(i32 count);
+
+    HashMap<MorphPoseKey, SharedPtr<MorphPose>> poses_;
+    i32 capacity_ = MORPH_POSE_DEFAULT_CAPACITY;
+    u32 useCounter_ = 0;
+    u32 hits_ = 0;
+    u32 misses_ = 0;
+    u32 evictions_ = 0;
+};
+
+}
@@ -0,0 +1,427 @@
+#include "MorphStreamCodec.h"
+#include <Urho3D/IO/Compression.h>
+#include <LZ4/lz4.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MORPH_CODEC_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MORPH_CODEC_NEON
+#endif
+
+namespace Urho3D
+{
+
+// Значений на дорожку в блоке: 128 значений на 4 дорожки
+static const i32 MORPH_BLOCK_LANE_VALUES = MORPH_INDEX_BLOCK_SIZE / 4;
+
+static void AppendBytes(Vector<unsigned char>& output, const void* data, i32 size)
+{
+    const i32 offset = output.Size();
+    output.Resize(offset + size);
+    if (size)
+        memcpy(output.Buffer() + offset, data, size);
+}
+
+template <class T> static void AppendValue(Vector<unsigned char>& output, const T& value)
+{
+    AppendBytes(output, &value, sizeof(T));
+}
+
+template <class T> static const unsigned char* ReadValue(const unsigned char* data, const unsigned char* end, T& value)
+{
+    if (!data || end - data < (ptrdiff_t)sizeof(T))
+        return nullptr;
+    memcpy(&value, data, sizeof(T));
+    return data + sizeof(T);
+}
+
+static u32 ZigZag(i32 value)
+{
+    return ((u32)value << 1) ^ (u32)(value >> 31);
+}
+
+static u32 GetBitWidth(u32 value)
+{
+    u32 width = 0;
+    while (value)
+    {
+        ++width;
+        value >>= 1;
+    }
+    return width;
+}
+
+void EncodeMorphIndexes(const i32* indexes, i32 count, Vector<unsigned char>& output)
+{
+    u32 values[MORPH_INDEX_BLOCK_SIZE];
+    u32 words[MORPH_INDEX_BLOCK_SIZE];
+    i32 previous = 0;
+    for (i32 first = 0; first < count; first += MORPH_INDEX_BLOCK_SIZE)
+    {
+        // Хвост последнего блока дополняется нулями
+        const i32 blockCount = Min(count - first, MORPH_INDEX_BLOCK_SIZE);
+        u32 combined = 0;
+        for (i32 i = 0; i < MORPH_INDEX_BLOCK_SIZE; ++i)
+        {
+            if (i < blockCount)
+            {
+                values[i] = ZigZag(indexes[first + i] - previous);
+                previous = indexes[first + i];
+            }
+            else
+                values[i] = 0;
+            combined |= values[i];
+        }
+
+        // Значение i лежит в дорожке i % 4, слово w дорожки l - в words[w * 4 + l]
+        const u32 width = GetBitWidth(combined);
+        output.Push((unsigned char)width);
+        for (i32 lane = 0; lane < 4; ++lane)
+        {
+            u64 bits = 0;
+            u32 numBits = 0;
+            i32 word = 0;
+            for (i32 j = 0; j < MORPH_BLOCK_LANE_VALUES; ++j)
+            {
+                bits |= (u64)values[j * 4 + lane] << numBits;
+                numBits += width;
+                if (numBits >= 32)
+                {
+                    words[word * 4 + lane] = (u32)bits;
+                    bits >>= 32;
+                    numBits -= 32;
+                    ++word;
+                }
+            }
+        }
+        AppendBytes(output, words, width * 4 * sizeof(u32));
+    }
+}
+
+// Распаковка блока в 128 значений, разности накапливаются начиная с previous
+static i32 UnpackIndexBlock(const unsigned char* data, u32 width, i32 previous, i32* output)
+{
+#if defined(MORPH_CODEC_SSE2)
+    const __m128i mask = width < 32 ? _mm_set1_epi32((int)((1u << width) - 1)) : _mm_set1_epi32(-1);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i* words = reinterpret_cast<const __m128i*>(data);
+    __m128i word = width ? _mm_loadu_si128(words++) : zero;
+    __m128i carry = _mm_set1_epi32(previous);
+    u32 shift = 0;
+    for (i32 j = 0; j < MORPH_BLOCK_LANE_VALUES; ++j)
+    {
+        __m128i value = _mm_srl_epi32(word, _mm_cvtsi32_si128((int)shift));
+        shift += width;
+        if (shift >= 32)
+        {
+            shift -= 32;
+            if (j + 1 < MORPH_BLOCK_LANE_VALUES || shift)
+                word = _mm_loadu_si128(words++);
+            if (shift)
+                value = _mm_or_si128(value, _mm_sll_epi32(word, _mm_cvtsi32_si128((int)(width - shift))));
+        }
+        value = _mm_and_si128(value, mask);
+        // zigzag и накопление разностей по 4 дорожкам
+        value = _mm_xor_si128(_mm_srli_epi32(value, 1), _mm_sub_epi32(zero, _mm_and_si128(value, one)));
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+        value = _mm_add_epi32(value, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + j * 4), value);
+        carry = _mm_shuffle_epi32(value, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    return output[MORPH_INDEX_BLOCK_SIZE - 1];
+#elif defined(MORPH_CODEC_NEON)
+    const uint32x4_t mask = vdupq_n_u32(width < 32 ? (1u << width) - 1 : 0xffffffffu);
+    const uint32x4_t one = vdupq_n_u32(1);
+    const uint32x4_t zero = vdupq_n_u32(0);
+    const u32* words = reinterpret_cast<const u32*>(data);
+    uint32x4_t word = width ? vld1q_u32(words) : zero;
+    words += 4;
+    uint32x4_t carry = vdupq_n_u32((u32)previous);
+    i32 shift = 0;
+    for (i32 j = 0; j < MORPH_BLOCK_LANE_VALUES; ++j)
+    {
+        uint32x4_t value = vshlq_u32(word, vdupq_n_s32(-shift));
+        shift += (i32)width;
+        if (shift >= 32)
+        {
+            shift -= 32;
+            if (j + 1 < MORPH_BLOCK_LANE_VALUES || shift)
+            {
+                word = vld1q_u32(words);
+                words += 4;
+            }
+            if (shift)
+                value = vorrq_u32(value, vshlq_u32(word, vdupq_n_s32((i32)width - shift)));
+        }
+        value = vandq_u32(value, mask);
+        // zigzag и накопление разностей по 4 дорожкам
+        value = veorq_u32(vshrq_n_u32(value, 1), vsubq_u32(zero, vandq_u32(value, one)));
+        value = vaddq_u32(value, vextq_u32(zero, value, 3));
+        value = vaddq_u32(value, vextq_u32(zero, value, 2));
+        value = vaddq_u32(value, carry);
+        vst1q_s32(output + j * 4, vreinterpretq_s32_u32(value));
+        carry = vdupq_n_u32(vgetq_lane_u32(value, 3));
+    }
+    return output[MORPH_INDEX_BLOCK_SIZE - 1];
+#else
+    const u32 mask = width < 32 ? (1u << width) - 1 : 0xffffffffu;
+    for (i32 lane = 0; lane < 4; ++lane)
+    {
+        u64 bits = 0;
+        u32 numBits = 0;
+        i32 word = 0;
+        for (i32 j = 0; j < MORPH_BLOCK_LANE_VALUES; ++j)
+        {
+            if (numBits < width)
+            {
+                u32 next;
+                memcpy(&next, data + (word * 4 + lane) * sizeof(u32), sizeof(u32));
+                bits |= (u64)next << numBits;
+                numBits += 32;
+                ++word;
+            }
+            output[j * 4 + lane] = (i32)((u32)bits & mask);
+            bits >>= width;
+            numBits -= width;
+        }
+    }
+    for (i32 i = 0; i < MORPH_INDEX_BLOCK_SIZE; ++i)
+    {
+        const u32 value = (u32)output[i];
+        previous += (i32)((value >> 1) ^ (0u - (value & 1)));
+        output[i] = previous;
+    }
+    return previous;
+#endif
+}
+
+const unsigned char* DecodeMorphIndexes(const unsigned char* data, const unsigned char* end, i32 count, i32* indexes)
+{
+    i32 block[MORPH_INDEX_BLOCK_SIZE];
+    i32 previous = 0;
+    for (i32 first = 0; first < count; first += MORPH_INDEX_BLOCK_SIZE)
+    {
+        if (!data || data >= end)
+            return nullptr;
+        const u32 width = *data++;
+        const ptrdiff_t size = (ptrdiff_t)width * 4 * sizeof(u32);
+        if (width > 32 || end - data < size)
+            return nullptr;
+        // Полные блоки распаковываются сразу на место
+        const i32 blockCount = count - first;
+        if (blockCount >= MORPH_INDEX_BLOCK_SIZE)
+            previous = UnpackIndexBlock(data, width, previous, indexes + first);
+        else
+        {
+            UnpackIndexBlock(data, width, previous, block);
+            memcpy(indexes + first, block, blockCount * sizeof(i32));
+        }
+        data += size;
+    }
+    return data;
+}
+
+void EncodeMorphDeltas(const Vector3* deltas, i32 count, Vector<unsigned char>& output)
+{
+    Vector3 minDelta = count ? deltas[0] : Vector3::ZERO;
+    Vector3 maxDelta = minDelta;
+    for (i32 i = 1; i < count; ++i)
+    {
+        minDelta = VectorMin(minDelta, deltas[i]);
+        maxDelta = VectorMax(maxDelta, deltas[i]);
+    }
+    const Vector3 step = (maxDelta - minDelta) / (float)MORPH_DELTA_QUANT_STEPS;
+    AppendValue(output, minDelta);
+    AppendValue(output, step);
+
+    // Плоскости: младшие байты x, старшие байты x, затем y и z
+    Vector<unsigned char> planes(count * 6);
+    for (i32 c = 0; c < 3; ++c)
+    {
+        const float scale = step.Data()[c] > 0.0f ? 1.0f / step.Data()[c] : 0.0f;
+        unsigned char* low = planes.Buffer() + c * 2 * count;
+        unsigned char* high = low + count;
+        u16 previous = 0;
+        for (i32 i = 0; i < count; ++i)
+        {
+            const float position = (deltas[i].Data()[c] - minDelta.Data()[c]) * scale;
+            const u16 quantized = (u16)Clamp((i32)std::lround(position), 0, MORPH_DELTA_QUANT_STEPS);
+            const i16 difference = (i16)(u16)(quantized - previous);
+            const u16 coded = (u16)(((u16)difference << 1) ^ (u16)(difference >> 15));
+            low[i] = (unsigned char)(coded & 0xff);
+            high[i] = (unsigned char)(coded >> 8);
+            previous = quantized;
+        }
+    }
+
+    // Несжимаемые плоскости записываются как есть, размер 0
+    Vector<unsigned char> packed(EstimateCompressBound(planes.Size()));
+    u32 packedSize = planes.Empty() ? 0 : CompressData(packed.Buffer(), planes.Buffer(), planes.Size());
+    if (packedSize >= (u32)planes.Size())
+        packedSize = 0;
+    AppendValue(output, packedSize);
+    if (packedSize)
+        AppendBytes(output, packed.Buffer(), packedSize);
+    else
+        AppendBytes(output, planes.Buffer(), planes.Size());
+}
+
+const unsigned char* DecodeMorphDeltas(const unsigned char* data, const unsigned char* end, i32 count, Vector3* deltas)
+{
+    Vector3 minDelta;
+    Vector3 step;
+    u32 packedSize = 0;
+    data = ReadValue(data, end, minDelta);
+    data = ReadValue(data, end, step);
+    data = ReadValue(data, end, packedSize);
+    if (!data)
+        return nullptr;
+
+    const u32 planesSize = (u32)count * 6;
+    const unsigned char* planes = data;
+    Vector<unsigned char> unpacked;
+    if (packedSize)
+    {
+        if (end - data < (ptrdiff_t)packedSize)
+            return nullptr;
+        // DecompressData() доверяет входу и при испорченном файле читает за концом данных,
+        // поэтому используется проверяющая распаковка
+        unpacked.Resize(planesSize);
+        if (packedSize > (u32)M_MAX_INT || LZ4_decompress_safe(reinterpret_cast<const char*>(data),
+            reinterpret_cast<char*>(unpacked.Buffer()), (int)packedSize, (int)planesSize) != (int)planesSize)
+            return nullptr;
+        planes = unpacked.Buffer();
+        data += packedSize;
+    }
+    else
+    {
+        if (end - data < (ptrdiff_t)planesSize)
+            return nullptr;
+        data += planesSize;
+    }
+    if (!count)
+        return data;
+
+    float* output = &deltas[0].x_;
+    i32 i = 0;
+#if defined(MORPH_CODEC_SSE2)
+    // По 8 вершин: склейка плоскостей, zigzag, накопление разностей и деквантование по осям,
+    // затем перестановка xxxx yyyy zzzz в xyz
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i carry[3] = { zero, zero, zero };
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 axes[3][2];
+        for (i32 c = 0; c < 3; ++c)
+        {
+            const unsigned char* low = planes + c * 2 * count;
+            const unsigned char* high = low + count;
+            __m128i value = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(low + i)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(high + i)));
+            value = _mm_xor_si128(_mm_srli_epi16(value, 1), _mm_sub_epi16(zero, _mm_and_si128(value, one)));
+            value = _mm_add_epi16(value, _mm_slli_si128(value, 2));
+            value = _mm_add_epi16(value, _mm_slli_si128(value, 4));
+            value = _mm_add_epi16(value, _mm_slli_si128(value, 8));
+            value = _mm_add_epi16(value, carry[c]);
+            carry[c] = _mm_set1_epi16((short)_mm_extract_epi16(value, 7));
+            const __m128 scale = _mm_set1_ps(step.Data()[c]);
+            const __m128 offset = _mm_set1_ps(minDelta.Data()[c]);
+            axes[c][0] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(value, zero)), scale), offset);
+            axes[c][1] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(value, zero)), scale), offset);
+        }
+        for (i32 half = 0; half < 2; ++half)
+        {
+            const __m128 x = axes[0][half];
+            const __m128 y = axes[1][half];
+            const __m128 z = axes[2][half];
+            const __m128 xyLow = _mm_unpacklo_ps(x, y);
+            const __m128 xyHigh = _mm_unpackhi_ps(x, y);
+            const __m128 yzLow = _mm_unpacklo_ps(y, z);
+            const __m128 yzHigh = _mm_unpackhi_ps(y, z);
+            const __m128 zxLow = _mm_unpacklo_ps(z, x);
+            const __m128 zxHigh = _mm_unpackhi_ps(z, x);
+            float* destination = output + (i + half * 4) * 3;
+            _mm_storeu_ps(destination, _mm_shuffle_ps(xyLow, zxLow, _MM_SHUFFLE(3, 0, 1, 0)));
+            _mm_storeu_ps(destination + 4, _mm_shuffle_ps(yzLow, xyHigh, _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm_storeu_ps(destination + 8, _mm_shuffle_ps(zxHigh, yzHigh, _MM_SHUFFLE(3, 2, 3, 0)));
+        }
+    }
+    u16 previous[3] = { (u16)_mm_extract_epi16(carry[0], 0), (u16)_mm_extract_epi16(carry[1], 0),
+        (u16)_mm_extract_epi16(carry[2], 0) };
+#elif defined(MORPH_CODEC_NEON)
+    const uint16x8_t zero = vdupq_n_u16(0);
+    const uint16x8_t one = vdupq_n_u16(1);
+    uint16x8_t carry[3] = { zero, zero, zero };
+    for (; i + 8 <= count; i += 8)
+    {
+        float32x4x3_t axes[2];
+        for (i32 c = 0; c < 3; ++c)
+        {
+            const unsigned char* low = planes + c * 2 * count;
+            const unsigned char* high = low + count;
+            uint16x8_t value = vorrq_u16(vmovl_u8(vld1_u8(low + i)), vshlq_n_u16(vmovl_u8(vld1_u8(high + i)), 8));
+            value = veorq_u16(vshrq_n_u16(value, 1), vsubq_u16(zero, vandq_u16(value, one)));
+            value = vaddq_u16(value, vextq_u16(zero, value, 7));
+            value = vaddq_u16(value, vextq_u16(zero, value, 6));
+            value = vaddq_u16(value, vextq_u16(zero, value, 4));
+            value = vaddq_u16(value, carry[c]);
+            carry[c] = vdupq_n_u16(vgetq_lane_u16(value, 7));
+            const float32x4_t scale = vdupq_n_f32(step.Data()[c]);
+            const float32x4_t offset = vdupq_n_f32(minDelta.Data()[c]);
+            axes[0].val[c] = vmlaq_f32(offset, vcvtq_f32_u32(vmovl_u16(vget_low_u16(value))), scale);
+            axes[1].val[c] = vmlaq_f32(offset, vcvtq_f32_u32(vmovl_u16(vget_high_u16(value))), scale);
+        }
+        vst3q_f32(output + i * 3, axes[0]);
+        vst3q_f32(output + (i + 4) * 3, axes[1]);
+    }
+    u16 previous[3] = { vgetq_lane_u16(carry[0], 0), vgetq_lane_u16(carry[1], 0), vgetq_lane_u16(carry[2], 0) };
+#else
+    u16 previous[3] = { 0, 0, 0 };
+#endif
+
+    for (; i < count; ++i)
+    {
+        for (i32 c = 0; c < 3; ++c)
+        {
+            const unsigned char* low = planes + c * 2 * count;
+            const u16 coded = (u16)(low[i] | (low[count + i] << 8));
+            previous[c] = (u16)(previous[c] + ((coded >> 1) ^ (0u - (coded & 1))));
+            output[i * 3 + c] = minDelta.Data()[c] + (float)previous[c] * step.Data()[c];
+        }
+    }
+    return data;
+}
+
+void EncodeMorphChannel(const Vector<i32>& indexes, const Vector<Vector3>& deltas, Vector<unsigned char>& output)
+{
+    const i32 count = indexes.Size();
+    AppendValue(output, count);
+    EncodeMorphIndexes(indexes.Buffer(), count, output);
+    EncodeMorphDeltas(deltas.Buffer(), count, output);
+}
+
+bool DecodeMorphChannel(const unsigned char* data, u32 size, Vector<i32>& indexes, Vector<Vector3>& deltas)
+{
+    const unsigned char* end = data + size;
+    i32 count = -1;
+    data = ReadValue(data, end, count);
+    // Блок индексов занимает хотя бы байт ширины
+    if (!data || count < 0 || (u64)count > (u64)size * MORPH_INDEX_BLOCK_SIZE)
+        return false;
+    indexes.Resize(count);
+    deltas.Resize(count);
+    data = DecodeMorphIndexes(data, end, count, indexes.Buffer());
+    data = data ? DecodeMorphDeltas(data, end, count, deltas.Buffer()) : nullptr;
+    return data == end;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D
+{
+
+// Компактная запись каналов морфов для файла каналов.
+// Индексы: разности соседних индексов в zigzag, упакованные блоками по 128 с общей шириной в битах
+// (вертикальная раскладка по 4 дорожкам, распаковывается SSE2/NEON без ветвлений на значение).
+// Смещения: квантование до 16 бит в границах канала, разности соседних значений в zigzag,
+// младшие и старшие байты в отдельных плоскостях, плоскости сжимаются LZ4
+
+// Значений в блоке упакованных индексов
+static const i32 MORPH_INDEX_BLOCK_SIZE = 128;
+// Шаг квантования смещений - диапазон канала по оси, делённый на MORPH_DELTA_QUANT_STEPS
+static const i32 MORPH_DELTA_QUANT_STEPS = 65535;
+
+/// Append the count, bit-packed indexes and quantized deltas of a channel to the output.
+void EncodeMorphChannel(const Vector<i32>& indexes, const Vector<Vector3>& deltas, Vector<unsigned char>& output);
+/// Decode a channel written by EncodeMorphChannel. Returns false if the data is truncated or corrupt.
+bool DecodeMorphChannel(const unsigned char* data, u32 size, Vector<i32>& indexes, Vector<Vector3>& deltas);
+
+/// Append count indexes delta and zigzag coded and bit-packed in blocks.
+void EncodeMorphIndexes(const i32* indexes, i32 count, Vector<unsigned char>& output);
+/// Decode count indexes. Returns the end of the encoded data, null if it's truncated.
+const unsigned char* DecodeMorphIndexes(const unsigned char* data, const unsigned char* end, i32 count, i32* indexes);
+/// Append count deltas quantized to 16 bits and split into compressed byte planes.
+void EncodeMorphDeltas(const Vector3* deltas, i32 count, Vector<unsigned char>& output);
+/// Decode count deltas. Returns the end of the encoded data, null if it's truncated or corrupt.
+const unsigned char* DecodeMorphDeltas(const unsigned char* data, const unsigned char* end, i32 count, Vector3* deltas);
+
+}
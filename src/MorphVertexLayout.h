@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/GraphicsAPI/GraphicsDefs.h>
+#include <Urho3D/Math/Vector2.h>
+#include <Urho3D/Math/Vector3.h>
+#include <Urho3D/Math/Vector4.h>
+
+namespace Urho3D
+{
+
+// Вершина при импорте и на CPU: всегда со всеми атрибутами
+struct MorphVertex
+{
+    Vector3 position_;
+    Vector3 normal_;
+    Vector2 texCoord_;
+    Vector4 tangent_;
+};
+
+struct MorphVertexElementDesc
+{
+    VertexElementType type;
+    VertexElementSemantic semantic;
+};
+
+// Атрибуты для MorphVertexT. Каждый хранит своё поле и знает свой элемент вершинного буфера
+struct MorphPositionAttr
+{
+    static constexpr MorphVertexElementDesc element{ TYPE_VECTOR3, SEM_POSITION };
+    Vector3 position_;
+    void Assign(const MorphVertex& vertex) { position_ = vertex.position_; }
+};
+
+struct MorphNormalAttr
+{
+    static constexpr MorphVertexElementDesc element{ TYPE_VECTOR3, SEM_NORMAL };
+    Vector3 normal_;
+    void Assign(const MorphVertex& vertex) { normal_ = vertex.normal_; }
+};
+
+struct MorphTexCoordAttr
+{
+    static constexpr MorphVertexElementDesc element{ TYPE_VECTOR2, SEM_TEXCOORD };
+    Vector2 texCoord_;
+    void Assign(const MorphVertex& vertex) { texCoord_ = vertex.texCoord_; }
+};
+
+struct MorphTangentAttr
+{
+    static constexpr MorphVertexElementDesc element{ TYPE_VECTOR4, SEM_TANGENT };
+    Vector4 tangent_;
+    void Assign(const MorphVertex& vertex) { tangent_ = vertex.tangent_; }
+};
+
+// Вершина GPU-буфера из выбранных атрибутов. Поля идут в порядке атрибутов, как и элементы буфера
+template <class... Attrs>
+struct MorphVertexT : Attrs...
+{
+    static constexpr MorphVertexElementDesc elements[] = { Attrs::element... };
+    static constexpr i32 elementCount = sizeof...(Attrs);
+
+    void Assign(const MorphVertex& vertex) { (Attrs::Assign(vertex), ...); }
+
+    static Vector<VertexElement> GetElements()
+    {
+        Vector<VertexElement> result;
+        for (const MorphVertexElementDesc& element : elements)
+            result.Push(VertexElement(element.type, element.semantic));
+        return result;
+    }
+};
+
+using MorphVertexFull = MorphVertexT<MorphPositionAttr, MorphNormalAttr, MorphTexCoordAttr, MorphTangentAttr>;
+using MorphVertexNoTexCoord = MorphVertexT<MorphPositionAttr, MorphNormalAttr, MorphTangentAttr>;
+
+// Буфер заполняется побайтно, поэтому между полями не должно быть выравнивания
+static_assert(sizeof(MorphVertexFull) == sizeof(MorphVertex), "MorphVertexFull must be tightly packed");
+static_assert(sizeof(MorphVertexNoTexCoord) == sizeof(Vector3) * 2 + sizeof(Vector4), "MorphVertexNoTexCoord must be tightly packed");
+
+// Формат вершинного буфера меша. Поток смещений подключается отдельно и только при наличии каналов
+enum MorphVertexLayout
+{
+    MORPH_LAYOUT_FULL,
+    // Меш без UV: текстурные координаты не хранятся, шейдер получает NOUV
+    MORPH_LAYOUT_NO_TEXCOORD,
+};
+
+/// Return the vertex shader defines for the layout on top of the base material defines.
+/// MORPH_ENABLED is removed for meshes without a delta stream.
+inline String GetMorphLayoutDefines(const String& baseDefines, MorphVertexLayout layout, bool hasDeltas)
+{
+    Vector<String> defines = baseDefines.Split(' ');
+    if (!hasDeltas)
+        defines.Remove("MORPH_ENABLED");
+    else if (!defines.Contains("MORPH_ENABLED"))
+        defines.Push("MORPH_ENABLED");
+    if (layout == MORPH_LAYOUT_NO_TEXCOORD && !defines.Contains("NOUV"))
+        defines.Push("NOUV");
+    return String::Joined(defines, " ");
+}
+
+}
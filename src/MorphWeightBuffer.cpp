@@ -0,0 +1,159 @@
+#include "MorphWeightBuffer.h"
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/GraphicsEvents.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Renderer.h>
+#include <Urho3D/IO/Log.h>
+
+namespace Urho3D
+{
+
+MorphWeightBuffer::MorphWeightBuffer(Context* context) : Object(context)
+{
+    SubscribeToEvent(E_BEGINRENDERING, URHO3D_HANDLER(MorphWeightBuffer, HandleBeginRendering));
+}
+
+void MorphWeightBuffer::Configure()
+{
+    // Renderer и Graphics появляются после инициализации движка, позже регистрации подсистемы
+    configured_ = true;
+    auto* graphics = GetSubsystem<Graphics>();
+    auto* renderer = GetSubsystem<Renderer>();
+    if (!graphics || !renderer)
+    {
+        enabled_ = true;
+        return;
+    }
+
+    // Чтение текстуры в вершинном шейдере по целым координатам есть в D3D11 и GL3
+    const String& api = graphics->GetApiName();
+    if (!graphics->GetInstancingSupport() || (api != "D3D11" && api != "GL3"))
+    {
+        GetSubsystem<Log>()->Write(LOG_INFO, "Morph weights use material parameters on " + api);
+        return;
+    }
+
+    texture_ = new Texture2D(context_);
+    texture_->SetNumLevels(1);
+    texture_->SetFilterMode(FILTER_NEAREST);
+    texture_->SetAddressMode(COORD_U, ADDRESS_CLAMP);
+    texture_->SetAddressMode(COORD_V, ADDRESS_CLAMP);
+    enabled_ = true;
+}
+
+void MorphWeightBuffer::SetInstancing(bool enable)
+{
+    if (!configured_)
+        Configure();
+    auto* renderer = GetSubsystem<Renderer>();
+    if (enable == instancing_ || !texture_ || !renderer || materialWeights_)
+        return;
+
+    if (enable)
+    {
+        if (renderer->GetNumExtraInstancingBufferElements() > 0)
+        {
+            GetSubsystem<Log>()->Write(LOG_WARNING, "Renderer uses extra instancing data, morph weight slots stay in materials");
+            return;
+        }
+        savedMinInstances_ = renderer->GetMinInstances();
+        savedMaxInstanceTriangles_ = renderer->GetMaxInstanceTriangles();
+        renderer->SetNumExtraInstancingBufferElements(1);
+        // Номер ячейки передаётся только с инстансами, поэтому инстансами рисуются и одиночные батчи, и крупные меши
+        renderer->SetMinInstances(1);
+        renderer->SetMaxInstanceTriangles(M_MAX_INT);
+    }
+    else
+    {
+        renderer->SetNumExtraInstancingBufferElements(0);
+        renderer->SetMinInstances(savedMinInstances_);
+        renderer->SetMaxInstanceTriangles(savedMaxInstanceTriangles_);
+    }
+    instancing_ = enable;
+}
+
+i32 MorphWeightBuffer::AllocateSlot()
+{
+    if (!configured_)
+        Configure();
+
+    if (!freeSlots_.Empty())
+    {
+        const i32 slot = freeSlots_.Back();
+        freeSlots_.Pop();
+        SetWeight(slot, 0.0f);
+        return slot;
+    }
+    if (numSlots_ == weights_.Size())
+    {
+        // Текстура пересоздаётся при следующей загрузке целиком
+        const i32 rows = Max(weights_.Size() / MORPH_WEIGHT_TEXTURE_WIDTH * 2, 1);
+        weights_.Resize(rows * MORPH_WEIGHT_TEXTURE_WIDTH, 0.0f);
+    }
+    return numSlots_++;
+}
+
+void MorphWeightBuffer::FreeSlot(i32 slot)
+{
+    if (slot >= 0 && slot < numSlots_)
+        freeSlots_.Push(slot);
+}
+
+void MorphWeightBuffer::BindTexture(Material* material)
+{
+    if (texture_ && material && material->GetTexture(TU_CUSTOM1) != texture_)
+        material->SetTexture(TU_CUSTOM1, texture_);
+}
+
+void MorphWeightBuffer::Upload()
+{
+    uploaded_ = 0;
+    if (!texture_ || weights_.Empty())
+        return;
+
+    const i32 rows = weights_.Size() / MORPH_WEIGHT_TEXTURE_WIDTH;
+    if (texture_->GetHeight() != rows)
+    {
+        if (!texture_->SetSize(MORPH_WEIGHT_TEXTURE_WIDTH, rows, Graphics::GetFloat32Format(), TEXTURE_STATIC))
+        {
+            GetSubsystem<Log>()->Write(LOG_ERROR, "Can't create morph weight texture");
+            return;
+        }
+        dirtyBegin_ = 0;
+        dirtyEnd_ = weights_.Size();
+    }
+    else if (texture_->IsDataLost())
+    {
+        texture_->ClearDataLost();
+        dirtyBegin_ = 0;
+        dirtyEnd_ = weights_.Size();
+    }
+    if (dirtyBegin_ >= dirtyEnd_)
+        return;
+
+    // Диапазон внутри одной строки загружается как есть, иначе целыми строками
+    const i32 firstRow = dirtyBegin_ / MORPH_WEIGHT_TEXTURE_WIDTH;
+    const i32 lastRow = (dirtyEnd_ - 1) / MORPH_WEIGHT_TEXTURE_WIDTH;
+    if (firstRow == lastRow)
+    {
+        const i32 x = dirtyBegin_ - firstRow * MORPH_WEIGHT_TEXTURE_WIDTH;
+        texture_->SetData(0, x, firstRow, dirtyEnd_ - dirtyBegin_, 1, &weights_[dirtyBegin_]);
+        uploaded_ = dirtyEnd_ - dirtyBegin_;
+    }
+    else
+    {
+        const i32 numRows = lastRow - firstRow + 1;
+        texture_->SetData(0, 0, firstRow, MORPH_WEIGHT_TEXTURE_WIDTH, numRows, &weights_[firstRow * MORPH_WEIGHT_TEXTURE_WIDTH]);
+        uploaded_ = numRows * MORPH_WEIGHT_TEXTURE_WIDTH;
+    }
+    dirtyBegin_ = M_MAX_INT;
+    dirtyEnd_ = 0;
+}
+
+void MorphWeightBuffer::HandleBeginRendering(StringHash eventType, VariantMap& eventData)
+{
+    Upload();
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/GraphicsAPI/Texture2D.h>
+#include <Urho3D/Math/Vector4.h>
+
+namespace Urho3D
+{
+
+class Material;
+
+// Ширина текстуры весов в ячейках, высота удваивается по мере выдачи ячеек
+static const i32 MORPH_WEIGHT_TEXTURE_WIDTH = 1024;
+
+// Веса всех MorphGeometry в одной float-текстуре. Компонент получает ячейку и пишет в неё вес
+// при изменении, изменённый диапазон загружается на GPU один раз за кадр перед отрисовкой.
+// По умолчанию номер ячейки задаётся параметром собственной копии материала компонента, один раз.
+// С SetInstancing() номер приходит через дополнительный элемент буфера инстансинга, и батчи разных
+// компонентов с общим материалом собираются в инстансы
+class MorphWeightBuffer : public Object
+{
+    URHO3D_OBJECT(MorphWeightBuffer, Object);
+
+public:
+    explicit MorphWeightBuffer(Context* context);
+
+    /// Return whether shaders read weights from the buffer. False before the first slot is allocated,
+    /// for graphics without instancing or vertex texture fetch, and when the renderer uses other
+    /// extra instancing data, and with SetMaterialWeights(). Without Graphics nothing is drawn and weights are only tracked.
+    bool IsEnabled() const { return enabled_ && !materialWeights_; }
+    /// Pass weights through material copies even where the buffer is supported, e.g. to check that path headless.
+    /// Applies to components whose materials are set up afterwards.
+    void SetMaterialWeights(bool enable) { materialWeights_ = enable; }
+    bool IsMaterialWeights() const { return materialWeights_; }
+    /// Pass slots through instancing data, so components share materials and are drawn as instances.
+    /// Changes renderer settings for every drawable: one extra instancing element, instancing from a single
+    /// batch and no triangle limit. Disabling restores the previous values. Off by default. Applies to
+    /// components whose materials are set up afterwards.
+    void SetInstancing(bool enable);
+    bool IsInstancing() const { return instancing_; }
+    /// Return a free slot with zero weight.
+    i32 AllocateSlot();
+    void FreeSlot(i32 slot);
+    /// Set the weight of the slot, the texel is uploaded before rendering if the value changed.
+    void SetWeight(i32 slot, float weight)
+    {
+        if (weights_[slot] == weight)
+            return;
+        weights_[slot] = weight;
+        dirtyBegin_ = Min(dirtyBegin_, slot);
+        dirtyEnd_ = Max(dirtyEnd_, slot + 1);
+    }
+    float GetWeight(i32 slot) const { return weights_[slot]; }
+    /// Return the per-instance data of the slot: texel column and row.
+    static Vector4 GetSlotData(i32 slot)
+    {
+        return Vector4((float)(slot % MORPH_WEIGHT_TEXTURE_WIDTH), (float)(slot / MORPH_WEIGHT_TEXTURE_WIDTH), 0.0f, 0.0f);
+    }
+    /// Bind the weight texture to the material, if it isn't bound yet.
+    void BindTexture(Material* material);
+    Texture2D* GetTexture() const { return texture_; }
+    /// Upload the changed range. Called once per frame before rendering.
+    void Upload();
+
+    i32 GetNumSlots() const { return numSlots_ - freeSlots_.Size(); }
+    i32 GetCapacity() const { return weights_.Size(); }
+    /// Return bytes of the CPU copy and the texture together.
+    u64 GetMemoryUse() const { return (u64)weights_.Capacity() * sizeof(float) * 2; }
+    /// Return texels uploaded by the last Upload().
+    i32 GetNumUploaded() const { return uploaded_; }
+
+private:
+    void Configure();
+    void HandleBeginRendering(StringHash eventType, VariantMap& eventData);
+
+    // Копия содержимого текстуры, по строкам
+    Vector<float> weights_;
+    Vector<i32> freeSlots_;
+    i32 numSlots_ = 0;
+    // Изменённые ячейки [dirtyBegin_, dirtyEnd_)
+    i32 dirtyBegin_ = M_MAX_INT;
+    i32 dirtyEnd_ = 0;
+    i32 uploaded_ = 0;
+    SharedPtr<Texture2D> texture_;
+    bool configured_ = false;
+    bool enabled_ = false;
+    bool instancing_ = false;
+    bool materialWeights_ = false;
+    // Настройки Renderer до SetInstancing(true)
+    i32 savedMinInstances_ = 0;
+    i32 savedMaxInstanceTriangles_ = 0;
+};
+
+}
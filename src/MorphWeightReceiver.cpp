@@ -0,0 +1,245 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "MorphWeightReceiver.h"
+#include "MorphGeometry.h"
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include <cstring>
+
+namespace Urho3D
+{
+
+static const i32 HEADER_SIZE = 8;
+static const i32 MESSAGE_SIZE = 8;
+// Таймаут приёма, чтобы поток замечал Stop()
+static const i32 RECEIVE_TIMEOUT_MS = 100;
+
+static void CloseSocket(intptr_t socket)
+{
+#ifdef _WIN32
+    closesocket((SOCKET)socket);
+#else
+    close((int)socket);
+#endif
+}
+
+MorphWeightReceiver::MorphWeightReceiver(Context* context) : Object(context)
+{
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(MorphWeightReceiver, HandleUpdate));
+}
+
+MorphWeightReceiver::~MorphWeightReceiver()
+{
+    Stop();
+}
+
+bool MorphWeightReceiver::Start(u16 port)
+{
+    Log* log = context_->GetSubsystem<Log>();
+    Stop();
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        log->Write(LOG_ERROR, "Can't initialize Winsock for morph weight receiver");
+        return false;
+    }
+    SOCKET handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (handle == INVALID_SOCKET)
+    {
+        WSACleanup();
+        log->Write(LOG_ERROR, "Can't create morph weight socket");
+        return false;
+    }
+    DWORD timeout = RECEIVE_TIMEOUT_MS;
+    setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+#else
+    int handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (handle < 0)
+    {
+        log->Write(LOG_ERROR, "Can't create morph weight socket");
+        return false;
+    }
+    timeval timeout{ 0, RECEIVE_TIMEOUT_MS * 1000 };
+    setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+
+    // Только локальные отправители
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(handle, (const sockaddr*)&address, sizeof(address)) != 0)
+    {
+        CloseSocket((intptr_t)handle);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        log->Write(LOG_ERROR, String("Can't bind morph weight receiver to port ") + String((i32)port));
+        return false;
+    }
+
+    socket_ = (intptr_t)handle;
+    head_.store(0);
+    tail_.store(0);
+    if (!Run())
+    {
+        Stop();
+        log->Write(LOG_ERROR, "Can't start morph weight receiver thread");
+        return false;
+    }
+    log->Write(LOG_INFO, String("Morph weight receiver listens on 127.0.0.1:") + String((i32)port));
+    return true;
+}
+
+void MorphWeightReceiver::Stop()
+{
+    Thread::Stop();
+    if (socket_ != -1)
+    {
+        CloseSocket(socket_);
+        socket_ = -1;
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+}
+
+void MorphWeightReceiver::SetTarget(u16 mesh, MorphGeometry* geometry)
+{
+    Target& target = targets_[mesh];
+    target.geometry = geometry;
+    target.weights.Clear();
+    target.dirty = false;
+}
+
+void MorphWeightReceiver::RemoveAllTargets()
+{
+    targets_.Clear();
+}
+
+bool MorphWeightReceiver::Push(const MorphWeightMessage& message)
+{
+    const u32 head = head_.load(std::memory_order_relaxed);
+    const u32 next = (head + 1) & (RING_SIZE - 1);
+    // Переполнение: основной поток не успевает, новые записи отбрасываются
+    if (next == tail_.load(std::memory_order_acquire))
+        return false;
+    ring_[head] = message;
+    head_.store(next, std::memory_order_release);
+    return true;
+}
+
+void MorphWeightReceiver::ThreadFunction()
+{
+    // Максимальный размер UDP-датаграммы
+    static const i32 BUFFER_SIZE = 65536;
+    unsigned char buffer[BUFFER_SIZE];
+
+    while (shouldRun_)
+    {
+#ifdef _WIN32
+        i32 size = recv((SOCKET)socket_, (char*)buffer, BUFFER_SIZE, 0);
+#else
+        i32 size = (i32)recv((int)socket_, buffer, BUFFER_SIZE, 0);
+#endif
+        if (size < HEADER_SIZE)
+            continue;
+
+        u32 magic;
+        u16 version;
+        u16 count;
+        memcpy(&magic, buffer, sizeof(magic));
+        memcpy(&version, buffer + 4, sizeof(version));
+        memcpy(&count, buffer + 6, sizeof(count));
+        if (magic != MORPH_WEIGHT_MAGIC || version != MORPH_WEIGHT_VERSION || HEADER_SIZE + count * MESSAGE_SIZE > size)
+            continue;
+
+        for (i32 i = 0; i < count; ++i)
+        {
+            const unsigned char* data = buffer + HEADER_SIZE + i * MESSAGE_SIZE;
+            MorphWeightMessage message;
+            memcpy(&message.mesh, data, sizeof(message.mesh));
+            memcpy(&message.channel, data + 2, sizeof(message.channel));
+            memcpy(&message.weight, data + 4, sizeof(message.weight));
+            // Clamp() пропускает NaN
+            if (IsNaN(message.weight))
+                continue;
+            if (Push(message))
+                received_.fetch_add(1, std::memory_order_relaxed);
+            else
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void MorphWeightReceiver::Drain()
+{
+    u32 tail = tail_.load(std::memory_order_relaxed);
+    const u32 head = head_.load(std::memory_order_acquire);
+    if (tail == head)
+        return;
+
+    for (; tail != head; tail = (tail + 1) & (RING_SIZE - 1))
+    {
+        const MorphWeightMessage& message = ring_[tail];
+        if (message.mesh == MORPH_WEIGHT_ALL_MESHES)
+        {
+            for (auto& pair : targets_)
+                Accumulate(pair.second_, message);
+            continue;
+        }
+        auto it = targets_.Find(message.mesh);
+        if (it != targets_.End())
+            Accumulate(it->second_, message);
+    }
+    tail_.store(tail, std::memory_order_release);
+
+    // Все каналы цели показываются одной потоковой позой. Веса меняются каждый кадр, поэтому кэш поз
+    // не используется и не вытесняет закэшированные виземы
+    for (auto& pair : targets_)
+    {
+        Target& target = pair.second_;
+        if (!target.dirty)
+            continue;
+        target.dirty = false;
+        MorphGeometry* geometry = target.geometry;
+        if (geometry && geometry->GetMeshData()->IsCommitted())
+            geometry->SetStreamedPose(target.weights);
+    }
+}
+
+void MorphWeightReceiver::Accumulate(Target& target, const MorphWeightMessage& message)
+{
+    MorphGeometry* geometry = target.geometry;
+    if (!geometry)
+        return;
+    // Список морферов мог смениться после SetTarget(), например при перезагрузке модели
+    const i32 numMorphers = geometry->GetNumMorphers();
+    if (target.weights.Size() != numMorphers)
+        target.weights.Resize(numMorphers, 0.0f);
+    if (message.channel >= numMorphers)
+        return;
+    target.weights[message.channel] = Clamp(message.weight, 0.0f, 1.0f);
+    target.dirty = true;
+}
+
+void MorphWeightReceiver::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    Drain();
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+
+#include <atomic>
+
+namespace Urho3D
+{
+
+class MorphGeometry;
+
+// Протокол: UDP-датаграмма на 127.0.0.1, little-endian.
+//   u32 magic (MORPH_WEIGHT_MAGIC), u16 version (MORPH_WEIGHT_VERSION), u16 count,
+//   затем count записей { u16 mesh, u16 channel, f32 weight }.
+// mesh - номер, заданный SetTarget(), MORPH_WEIGHT_ALL_MESHES - все цели.
+// channel - номер морфера из MorphGeometry::GetMorpherIndex(). Каналы без записей в кадре
+// сохраняют прежний вес, NaN отбрасывается
+static const u32 MORPH_WEIGHT_MAGIC = 0x5357544du;
+static const u16 MORPH_WEIGHT_VERSION = 1;
+static const u16 MORPH_WEIGHT_ALL_MESHES = 0xffff;
+static const u16 MORPH_WEIGHT_DEFAULT_PORT = 29170;
+
+struct MorphWeightMessage
+{
+    u16 mesh;
+    u16 channel;
+    float weight;
+};
+
+// Принимает веса от внешнего процесса на отдельном потоке. Записи проходят через
+// lock-free кольцевой буфер (один писатель - поток приёма, один читатель - основной поток)
+// и раз в кадр, по E_UPDATE, передаются в компоненты позой из весов всех каналов (MorphGeometry::SetStreamedPose)
+class MorphWeightReceiver : public Object, public Thread
+{
+    URHO3D_OBJECT(MorphWeightReceiver, Object);
+
+public:
+    explicit MorphWeightReceiver(Context* context);
+    ~MorphWeightReceiver() override;
+
+    /// Open the socket on the loopback interface and start the receiving thread.
+    bool Start(u16 port = MORPH_WEIGHT_DEFAULT_PORT);
+    /// Stop the thread and close the socket.
+    void Stop();
+    void SetTarget(u16 mesh, MorphGeometry* geometry);
+    void RemoveAllTargets();
+
+    /// Move received weights into the targets. Called once per frame.
+    void Drain();
+
+    u32 GetNumReceived() const { return received_.load(std::memory_order_relaxed); }
+    u32 GetNumDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    void ThreadFunction() override;
+
+private:
+    void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    bool Push(const MorphWeightMessage& message);
+
+    struct Target
+    {
+        WeakPtr<MorphGeometry> geometry;
+        // Веса каналов по номерам морферов, переживают кадр
+        Vector<float> weights;
+        // В этом кадре пришли записи
+        bool dirty = false;
+    };
+    void Accumulate(Target& target, const MorphWeightMessage& message);
+
+    // Размер кольца - степень двойки: несколько кадров при сотнях каналов на 60 Гц
+    static const u32 RING_SIZE = 16384;
+    MorphWeightMessage ring_[RING_SIZE];
+    std::atomic<u32> head_{0};
+    std::atomic<u32> tail_{0};
+    std::atomic<u32> received_{0};
+    std::atomic<u32> dropped_{0};
+
+    HashMap<u16, Target> targets_;
+    intptr_t socket_ = -1;
+};
+
+}
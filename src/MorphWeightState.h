@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+
+#include <atomic>
+#include <cstring>
+
+namespace Urho3D
+{
+
+// Значение morph в снимке, если смена морфа не запрашивалась
+static const i32 MORPH_UNCHANGED = -2;
+// Значение morph для пустого активного морфа
+static const i32 MORPH_NONE = -1;
+
+struct MorphWeightSnapshot
+{
+    // Вес или -1, если используется вес по умолчанию
+    float weight;
+    // Запрошенный номер морфа, MORPH_UNCHANGED или MORPH_NONE
+    i32 morph;
+};
+
+// Вес и запрошенный морф упакованы в одно 64-битное атомарное слово: запись из любого потока
+// выполняется без блокировок циклом CAS, чтение всегда видит согласованную пару
+class MorphWeightState
+{
+public:
+    MorphWeightState() { state_.store(Pack({ -1.0f, MORPH_UNCHANGED })); }
+
+    void SetWeight(float weight)
+    {
+        u64 expected = state_.load(std::memory_order_relaxed);
+        MorphWeightSnapshot snapshot;
+        do
+        {
+            snapshot = Unpack(expected);
+            snapshot.weight = weight;
+        } while (!state_.compare_exchange_weak(expected, Pack(snapshot), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void SetMorph(i32 morph)
+    {
+        u64 expected = state_.load(std::memory_order_relaxed);
+        MorphWeightSnapshot snapshot;
+        do
+        {
+            snapshot = Unpack(expected);
+            snapshot.morph = morph;
+        } while (!state_.compare_exchange_weak(expected, Pack(snapshot), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void Set(float weight, i32 morph) { state_.store(Pack({ weight, morph }), std::memory_order_release); }
+
+    /// Return the current state and clear the morph request. Only one thread may consume.
+    MorphWeightSnapshot Consume()
+    {
+        u64 expected = state_.load(std::memory_order_acquire);
+        MorphWeightSnapshot snapshot;
+        do
+        {
+            snapshot = Unpack(expected);
+            if (snapshot.morph == MORPH_UNCHANGED)
+                break;
+        } while (!state_.compare_exchange_weak(expected, Pack({ snapshot.weight, MORPH_UNCHANGED }),
+            std::memory_order_acq_rel, std::memory_order_acquire));
+        return snapshot;
+    }
+
+    MorphWeightSnapshot Get() const { return Unpack(state_.load(std::memory_order_acquire)); }
+
+private:
+    static u64 Pack(const MorphWeightSnapshot& snapshot)
+    {
+        u32 weightBits;
+        memcpy(&weightBits, &snapshot.weight, sizeof(weightBits));
+        return ((u64)(u32)snapshot.morph << 32) | weightBits;
+    }
+
+    static MorphWeightSnapshot Unpack(u64 value)
+    {
+        MorphWeightSnapshot snapshot;
+        u32 weightBits = (u32)value;
+        memcpy(&snapshot.weight, &weightBits, sizeof(weightBits));
+        snapshot.morph = (i32)(u32)(value >> 32);
+        return snapshot;
+    }
+
+    std::atomic<u64> state_;
+};
+
+}
@@ -0,0 +1,94 @@
+#include "PolygonTriangulation.h"
+
+namespace Urho3D
+{
+
+// Поворот в углу b относительно нормали полигона: > 0 для выпуклого угла
+static float CornerTurn(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& normal)
+{
+    return (b - a).CrossProduct(c - b).DotProduct(normal);
+}
+
+static bool IsInsideTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& normal)
+{
+    return (b - a).CrossProduct(p - a).DotProduct(normal) >= 0.0f &&
+        (c - b).CrossProduct(p - b).DotProduct(normal) >= 0.0f &&
+        (a - c).CrossProduct(p - c).DotProduct(normal) >= 0.0f;
+}
+
+void TriangulatePolygon(const Vector3* corners, i32 count, i32* triangles, Vector<i32>& remaining)
+{
+    if (count < 3)
+        return;
+
+    // Нормаль Ньюэлла устойчива для неплоских и вырожденных полигонов
+    Vector3 normal = Vector3::ZERO;
+    for (i32 i = 0; i < count; ++i)
+    {
+        const Vector3& a = corners[i];
+        const Vector3& b = corners[(i + 1) % count];
+        normal.x_ += (a.y_ - b.y_) * (a.z_ + b.z_);
+        normal.y_ += (a.z_ - b.z_) * (a.x_ + b.x_);
+        normal.z_ += (a.x_ - b.x_) * (a.y_ + b.y_);
+    }
+
+    bool convex = true;
+    for (i32 i = 0; i < count && convex && count > 3; ++i)
+        convex = CornerTurn(corners[(i + count - 1) % count], corners[i], corners[(i + 1) % count], normal) >= 0.0f;
+
+    if (convex)
+    {
+        for (i32 i = 1; i + 1 < count; ++i)
+        {
+            *triangles++ = 0;
+            *triangles++ = i;
+            *triangles++ = i + 1;
+        }
+        return;
+    }
+
+    // Отсечение ушей
+    remaining.Resize(count);
+    for (i32 i = 0; i < count; ++i)
+        remaining[i] = i;
+
+    while (remaining.Size() > 3)
+    {
+        const i32 size = remaining.Size();
+        i32 ear = -1;
+        for (i32 r = 0; r < size && ear < 0; ++r)
+        {
+            const i32 prev = remaining[(r + size - 1) % size];
+            const i32 cur = remaining[r];
+            const i32 next = remaining[(r + 1) % size];
+            if (CornerTurn(corners[prev], corners[cur], corners[next], normal) <= 0.0f)
+                continue;
+
+            bool empty = true;
+            for (i32 k = 0; k < size && empty; ++k)
+            {
+                const i32 other = remaining[k];
+                if (other == prev || other == cur || other == next)
+                    continue;
+                empty = !IsInsideTriangle(corners[other], corners[prev], corners[cur], corners[next], normal);
+            }
+            if (empty)
+                ear = r;
+        }
+
+        // Самопересекающийся или вырожденный полигон: отрезаем первый угол, чтобы гарантировать count - 2 треугольника
+        if (ear < 0)
+            ear = 0;
+
+        *triangles++ = remaining[(ear + size - 1) % size];
+        *triangles++ = remaining[ear];
+        *triangles++ = remaining[(ear + 1) % size];
+        remaining.Erase(ear);
+    }
+
+    *triangles++ = remaining[0];
+    *triangles++ = remaining[1];
+    *triangles++ = remaining[2];
+}
+
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D
+{
+
+/// Split a planar polygon into count - 2 triangles keeping its winding. Convex polygons are fanned
+/// from the first corner, concave ones are ear clipped. Writes (count - 2) * 3 corner numbers
+/// (0 .. count - 1) to triangles. Ear clipping keeps the corners left in remaining, which is reused
+/// between calls so that a stream of polygons doesn't allocate per polygon.
+void TriangulatePolygon(const Vector3* corners, i32 count, i32* triangles, Vector<i32>& remaining);
+
+}
@@ -0,0 +1,275 @@
+#include "ShaderWarmup.h"
+#include "SceneUtils.h"
+#include "MorphGeometry.h"
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/Light.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Renderer.h>
+#include <Urho3D/Graphics/RenderPath.h>
+#include <Urho3D/Graphics/Technique.h>
+#include <Urho3D/Graphics/Zone.h>
+#include <Urho3D/GraphicsAPI/Shader.h>
+#include <Urho3D/GraphicsAPI/ShaderVariation.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+using namespace Urho3D;
+
+// Файл в каталоге кэша шейдеров с хэшами исходников, для которых сохранён байткод
+static const char* SHADER_CACHE_MANIFEST = "MorphShaderCache.txt";
+
+// Варианты геометрии, которые может получить MorphGeometry: обычная отрисовка и инстансинг
+static const char* geometryVariations[] = { "", "INSTANCED " };
+static const char* heightFogVariations[] = { "", "HEIGHTFOG " };
+
+struct WarmupState
+{
+    Graphics* graphics;
+    ResourceCache* cache;
+    HashSet<ShaderVariation*> compiled;
+    HashSet<String> checkedSources;
+    HashMap<String, hash32> manifest;
+    bool manifestDirty;
+    i32 failed;
+};
+
+static String GetShaderCacheDir(ResourceCache* cache, Graphics* graphics)
+{
+    String dir = graphics->GetShaderCacheDir();
+    if (IsAbsolutePath(dir) || cache->GetResourceDirs().Empty())
+        return dir;
+    return cache->GetResourceDirs()[0] + dir;
+}
+
+static void LoadManifest(Context* context, WarmupState& state)
+{
+    String fileName = GetShaderCacheDir(state.cache, state.graphics) + SHADER_CACHE_MANIFEST;
+    if (!context->GetSubsystem<FileSystem>()->FileExists(fileName))
+        return;
+    File file(context, fileName, FILE_READ);
+    while (!file.IsEof()) {
+        Vector<String> parts = file.ReadLine().Split(' ');
+        if (parts.Size() == 2)
+            state.manifest[parts[0]] = ToU32(parts[1]);
+    }
+}
+
+static void SaveManifest(Context* context, WarmupState& state)
+{
+    String dir = GetShaderCacheDir(state.cache, state.graphics);
+    context->GetSubsystem<FileSystem>()->CreateDir(dir);
+    File file(context, dir + SHADER_CACHE_MANIFEST, FILE_WRITE);
+    for (const auto& pair : state.manifest)
+        file.WriteLine(pair.first_ + " " + String(pair.second_));
+}
+
+// Расширение файлов байткода в кэше шейдеров. OpenGL компилирует шейдеры из исходников
+// при каждом запуске и байткод не сохраняет, поэтому проверять там нечего
+static String GetByteCodeExtension(Graphics* graphics, ShaderType type)
+{
+    const String& api = graphics->GetApiName();
+    if (api == "D3D11")
+        return type == VS ? ".vs4" : ".ps4";
+    if (api == "D3D9")
+        return type == VS ? ".vs3" : ".ps3";
+    return String::EMPTY;
+}
+
+// Кэш байткода в движке проверяется только по времени изменения файла. Здесь ключом
+// служит хэш исходника (вместе со всеми include), а определения входят в имя файла кэша.
+static void ValidateCachedByteCode(Context* context, WarmupState& state, const String& shaderName, ShaderType type)
+{
+    String extension = GetByteCodeExtension(state.graphics, type);
+    if (extension.Empty())
+        return;
+    String key = shaderName + (type == VS ? ".vs" : ".ps");
+    if (state.checkedSources.Contains(key))
+        return;
+    state.checkedSources.Insert(key);
+
+    auto* shader = state.cache->GetResource<Shader>(state.graphics->GetShaderPath() + shaderName + state.graphics->GetShaderExtension());
+    if (!shader)
+        return;
+    hash32 sourceHash = StringHash(shader->GetSourceCode(type)).Value();
+    auto it = state.manifest.Find(key);
+    if (it != state.manifest.End() && it->second_ == sourceHash)
+        return;
+
+    auto* fileSystem = context->GetSubsystem<FileSystem>();
+    String dir = GetShaderCacheDir(state.cache, state.graphics);
+    Vector<String> files;
+    fileSystem->ScanDir(files, dir, "*" + extension, SCAN_FILES, false);
+    for (const String& file : files) {
+        if (file.StartsWith(shaderName + "_"))
+            fileSystem->Delete(dir + file);
+    }
+
+    state.manifest[key] = sourceHash;
+    state.manifestDirty = true;
+}
+
+static void CompileVariation(Context* context, WarmupState& state, ShaderType type, const String& name, const String& defines)
+{
+    ValidateCachedByteCode(context, state, name, type);
+    ShaderVariation* variation = state.graphics->GetShader(type, name, defines);
+    if (!variation || state.compiled.Contains(variation))
+        return;
+    state.compiled.Insert(variation);
+    if (!variation->Create()) {
+        ++state.failed;
+        context->GetSubsystem<Log>()->Write(LOG_WARNING, String("Can't warm up shader ") + name + " (" + defines + "): " + variation->GetCompilerOutput());
+    }
+}
+
+static String GetShadowDefines(Renderer* renderer)
+{
+    switch (renderer->GetShadowQuality()) {
+    case SHADOWQUALITY_SIMPLE_16BIT:
+    case SHADOWQUALITY_SIMPLE_24BIT:
+        return "SIMPLE_SHADOW ";
+    case SHADOWQUALITY_PCF_16BIT:
+    case SHADOWQUALITY_PCF_24BIT:
+        return "PCF_SHADOW ";
+    default:
+        return "VSM_SHADOW ";
+    }
+}
+
+static String GetLightDefines(Light* light, bool drawShadows)
+{
+    String defines = "PERPIXEL ";
+    switch (light->GetLightType()) {
+    case LIGHT_DIRECTIONAL:
+        defines += "DIRLIGHT ";
+        break;
+    case LIGHT_SPOT:
+        defines += "SPOTLIGHT ";
+        break;
+    default:
+        defines += "POINTLIGHT ";
+        break;
+    }
+    if (drawShadows && light->GetCastShadows())
+        defines += "SHADOW ";
+    return defines;
+}
+
+static void WarmUpPass(Context* context, WarmupState& state, Pass* pass, const String& extraVS, const String& extraPS,
+    const Vector<Light*>& lights, i32 vertexLights, bool heightFog)
+{
+    auto* renderer = context->GetSubsystem<Renderer>();
+    bool drawShadows = renderer->GetDrawShadows();
+    String vsDefines = pass->GetEffectiveVertexShaderDefines() + " " + extraVS + " ";
+    String psDefines = pass->GetEffectivePixelShaderDefines() + " " + extraPS + " ";
+    i32 fogVariations = heightFog ? 2 : 1;
+
+    if (pass->GetLightingMode() == LIGHTING_PERPIXEL) {
+        for (Light* light : lights) {
+            if (light->GetPerVertex())
+                continue;
+            String lightVS = GetLightDefines(light, drawShadows);
+            if (drawShadows && light->GetCastShadows() && light->GetShadowBias().normalOffset_ > 0.0f)
+                lightVS += "NORMALOFFSET ";
+            String lightPS = GetLightDefines(light, drawShadows);
+            if (light->GetLightType() == LIGHT_POINT && light->GetShapeTexture())
+                lightPS += "CUBEMASK ";
+            if (renderer->GetSpecularLighting() && light->GetSpecularIntensity() > 0.0f)
+                lightPS += "SPECULAR ";
+            if (drawShadows && light->GetCastShadows())
+                lightPS += GetShadowDefines(renderer);
+
+            for (const char* geometry : geometryVariations)
+                CompileVariation(context, state, VS, pass->GetVertexShader(), vsDefines + lightVS + geometry);
+            for (i32 f = 0; f < fogVariations; ++f)
+                CompileVariation(context, state, PS, pass->GetPixelShader(), psDefines + lightPS + heightFogVariations[f]);
+        }
+        return;
+    }
+
+    for (const char* geometry : geometryVariations) {
+        if (pass->GetLightingMode() == LIGHTING_PERVERTEX) {
+            for (i32 l = 0; l <= vertexLights; ++l) {
+                String lightVS = l ? "NUMVERTEXLIGHTS=" + String(l) + " " : String::EMPTY;
+                CompileVariation(context, state, VS, pass->GetVertexShader(), vsDefines + lightVS + geometry);
+            }
+        } else {
+            CompileVariation(context, state, VS, pass->GetVertexShader(), vsDefines + geometry);
+        }
+    }
+    for (i32 f = 0; f < fogVariations; ++f)
+        CompileVariation(context, state, PS, pass->GetPixelShader(), psDefines + heightFogVariations[f]);
+}
+
+void WarmUpMorphShaders(Context* context, Scene* scene)
+{
+    auto* log = context->GetSubsystem<Log>();
+    auto* renderer = context->GetSubsystem<Renderer>();
+    auto* graphics = context->GetSubsystem<Graphics>();
+    if (!scene || !renderer || !graphics)
+        return;
+    HiresTimer timer;
+
+    WarmupState state{ graphics, context->GetSubsystem<ResourceCache>() };
+    LoadManifest(context, state);
+
+    Vector<Light*> lights = findAllComponents<Light>(scene);
+    i32 vertexLights = 0;
+    for (Light* light : lights) {
+        if (light->GetPerVertex())
+            ++vertexLights;
+    }
+    vertexLights = Min(vertexLights, 4);
+    bool heightFog = false;
+    for (Zone* zone : findAllComponents<Zone>(scene))
+        heightFog |= zone->GetHeightFog();
+
+    HashSet<Material*> materials;
+    for (MorphGeometry* geometry : findAllComponents<MorphGeometry>(scene)) {
+        // Варианты зависят от формата вершин меша, поэтому берётся материал батчей
+        if (geometry->GetBatchMaterial())
+            materials.Insert(geometry->GetBatchMaterial());
+        if (geometry->GetShadowMaterial())
+            materials.Insert(geometry->GetShadowMaterial());
+    }
+
+    // Проходы берём из команд текущего пути рендеринга, чтобы не компилировать лишнего
+    RenderPath* renderPath = renderer->GetDefaultRenderPath();
+    for (Material* material : materials) {
+        for (i32 t = 0; t < material->GetNumTechniques(); ++t) {
+            Technique* technique = material->GetTechnique(t);
+            if (!technique)
+                continue;
+            for (const RenderPathCommand& command : renderPath->commands_) {
+                if (!command.enabled_)
+                    continue;
+                if (command.type_ == CMD_SCENEPASS) {
+                    if (Pass* pass = technique->GetPass(command.pass_))
+                        WarmUpPass(context, state, pass, command.vertexShaderDefines_, command.pixelShaderDefines_, lights, vertexLights, heightFog);
+                } else if (command.type_ == CMD_FORWARDLIGHTS) {
+                    if (Pass* pass = technique->GetPass("litbase"))
+                        WarmUpPass(context, state, pass, command.vertexShaderDefines_, command.pixelShaderDefines_, lights, vertexLights, heightFog);
+                    if (Pass* pass = technique->GetPass("light"))
+                        WarmUpPass(context, state, pass, command.vertexShaderDefines_, command.pixelShaderDefines_, lights, vertexLights, heightFog);
+                }
+            }
+            if (renderer->GetDrawShadows()) {
+                if (Pass* pass = technique->GetPass("shadow"))
+                    WarmUpPass(context, state, pass, String::EMPTY, String::EMPTY, lights, vertexLights, false);
+            }
+        }
+    }
+
+    if (state.manifestDirty)
+        SaveManifest(context, state);
+    // Без кэша байткода (OpenGL) компиляция повторяется при каждом запуске, время прогрева
+    // пишется в лог, чтобы его рост был виден между запусками
+    const bool byteCodeCache = !GetByteCodeExtension(graphics, VS).Empty();
+    log->Write(LOG_INFO, String("Warmed up ") + String(state.compiled.Size()) + " shader variations in " +
+        String((i32)(timer.GetUSec(false) / 1000)) + " ms, failed " + String(state.failed) +
+        (byteCodeCache ? "" : ", compiled from source without bytecode cache"));
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <Urho3D/Scene/Scene.h>
+
+namespace Urho3D {
+    class Context;
+}
+
+/// Compile the shader variations that the morph materials and lights of the scene will request,
+/// so the first frames don't stall on lazy compilation. Cached bytecode of shaders whose source
+/// hash changed since the previous run is dropped so it gets recompiled and saved again. Only
+/// Direct3D saves bytecode; on OpenGL every run compiles from source, the warm-up time is logged.
+void WarmUpMorphShaders(Urho3D::Context* context, Urho3D::Scene* scene);